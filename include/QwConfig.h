@@ -28,12 +28,49 @@
     Mostly these control validation checks used for debugging.
 */
 
-// Cache line size. Used for rounding. TODO: provide runtime cache line size query.
+// Cache line size. Used for rounding, and the minimum alignment of nodes.
+// The actual line size is queried at runtime, see qw_cache_info.h.
 
 #ifndef CACHE_LINE_SIZE
 #define CACHE_LINE_SIZE ((size_t)64)
 #endif
 
+// QW_FALSE_SHARING_SIZE is the size of the padding that separates fields that
+// are written by different threads. It is two cache lines because x86 processors
+// prefetch adjacent line pairs, and some ARM and POWER processors have 128-byte
+// lines. qw_false_sharing_size() returns the value for the running machine.
+
+#ifndef QW_FALSE_SHARING_SIZE
+#define QW_FALSE_SHARING_SIZE ((size_t)128)
+#endif
+
+// QW_CACHE_LINE_ALIGNED aligns a variable or data member to CACHE_LINE_SIZE.
+// Place it before the declaration. MSVC requires a literal alignment, keep it
+// in sync with CACHE_LINE_SIZE.
+//
+// (Pre-C++17 operator new ignores over-alignment: objects with aligned members
+// must have static or automatic storage duration, or be constructed in suitably
+// aligned memory.)
+
+#if defined(_MSC_VER)
+#define QW_CACHE_LINE_ALIGNED __declspec(align(64))
+#else
+#define QW_CACHE_LINE_ALIGNED __attribute__((aligned(CACHE_LINE_SIZE)))
+#endif
+
+
+// QW_PREFETCH(p) hints that the cache line at address p will be read soon.
+// It doesn't fault if p is invalid.
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <xmmintrin.h>
+#define QW_PREFETCH(p) _mm_prefetch(reinterpret_cast<const char*>(p), _MM_HINT_T0)
+#elif defined(__GNUC__)
+#define QW_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define QW_PREFETCH(p) ((void)0)
+#endif
+
 
 // QW_VALIDATE_NODE_LINKS switches on the following behavior:
 //  - Node links are zeroed after use.
@@ -53,6 +90,23 @@
 #define QW_DEBUG_COUNT_NODE_ALLOCATIONS
 
 
+// QW_NODE_POOL_STATISTICS enables per-thread sharded counters of allocations,
+// deallocations, allocation failures and CAS retries in QwNodePool. Unlike
+// QW_DEBUG_COUNT_NODE_ALLOCATIONS, the counters are cheap enough for production
+// builds. Use QwRawNodePool::statistics_snapshot() to read them.
+
+//#define QW_NODE_POOL_STATISTICS
+
+
+// QW_THREAD_LOCAL declares a variable with thread storage duration.
+
+#if defined(_MSC_VER)
+#define QW_THREAD_LOCAL __declspec(thread)
+#else
+#define QW_THREAD_LOCAL __thread
+#endif
+
+
 #endif /* INCLUDED_QWCONFIG_H */
 
 /* -----------------------------------------------------------------------
@@ -60,6 +114,5 @@ Last reviewed: April 22, 2014
 Last reviewed by: Ross B.
 Status: OK
 Comments:
-- cache line size needs to be determined at runtime
 - consider tying debug checks to whether NDEBUG is define
 -------------------------------------------------------------------------- */
@@ -0,0 +1,193 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWDWCASNODEPOOL_H
+#define INCLUDED_QWDWCASNODEPOOL_H
+
+#include <algorithm>
+#include <cassert>
+
+#include "mintomic/mintomic.h"
+#include "qw_atomic.h"
+
+#include "QwConfig.h"
+#include "QwNodePool.h"
+#include "qw_freelist.h"
+
+/*
+    QwRawDwcasNodePool is an alternative implementation of QwRawNodePool that
+    uses double-width compare-and-swap (cmpxchg16b) instead of packing the
+    freelist top into 64 bits.
+
+    The freelist top is a (pointer, count) pair: a full node pointer and a
+    64-bit ABA-prevention count. Compared to QwRawNodePool:
+
+        - The ABA count doesn't lose bits as the pool gets larger. (With a
+          packed 64-bit word, a pool of 2^30 nodes leaves 34 count bits.)
+
+        - Nodes are linked by pointer, there is no index to pointer
+          translation in push and pop.
+
+    The interface is identical to QwRawNodePool, except that there is no
+    magazine depot, so QwNodePoolMagazineCache can not be used with this pool.
+    Use it with the typed wrapper as QwNodePool<NodeT, QwRawDwcasNodePool>.
+
+    Only available when QW_HAVE_ATOMIC128 is set (x64, see qw_atomic.h).
+*/
+
+#if QW_HAVE_ATOMIC128
+
+class QwRawDwcasNodePool {
+
+    int8_t padding1_[QW_FALSE_SHARING_SIZE]; // avoid false sharing
+
+    int8_t *nodeStorage_;       // nodes are stored in [nodeStorage_, nodeStorageEnd_)
+    int8_t *nodeStorageEnd_;
+    bool ownsStorage_;          // false if the storage was supplied by the client
+    size_t storageSize_;        // see QwRawNodePool::allocate_storage
+    int storageFlags_;
+    size_t nodeSize_;
+    size_t maxNodes_;
+
+    int8_t padding2_[QW_FALSE_SHARING_SIZE]; // avoid false sharing
+
+    // Freelist top. _nonatomic[0] is the node pointer, _nonatomic[1] is the ABA count.
+    qw_mint_atomic128_t top_;
+
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+    mint_atomic32_t allocCount_;
+#endif
+
+    int8_t padding3_[QW_FALSE_SHARING_SIZE]; // avoid false sharing
+
+    // High-water mark, as in QwRawNodePool. bumpIndex_ counts never-allocated nodes
+    // that have been handed out. freshOrder_ maps them to node positions.
+    mint_atomic64_t bumpIndex_;
+
+    QwFreshNodeOrder freshOrder_;
+
+    int8_t padding4_[QW_FALSE_SHARING_SIZE]; // avoid false sharing
+
+    // When stored on the stack, each node contains a next pointer at the start:
+    //
+    //  Node {
+    //     Node *next;
+    //  }
+    //
+    // The stack operations are QwDwcasFreelist's (see qw_freelist.h)
+
+    friend class QwDwcasFreelist;
+
+    // true if p could be a node pointer. Used to avoid dereferencing garbage while walking chains.
+    bool is_node_in_range( void *p ) const
+    {
+        return (static_cast<int8_t*>(p) >= nodeStorage_ && static_cast<int8_t*>(p) < nodeStorageEnd_
+                && (reinterpret_cast<uintptr_t>(p) & (CACHE_LINE_SIZE-1)) == 0);
+    }
+
+    // Reserve up to maxCount never-allocated nodes. see QwRawNodePool::bump_allocate.
+    // Returns false if all nodes have been allocated at least once.
+    bool bump_allocate( size_t maxCount, size_t& first, size_t& count )
+    {
+        if (mint_load_64_relaxed(&bumpIndex_) >= maxNodes_)
+            return false;
+
+        uint64_t index = mint_fetch_add_64_relaxed(&bumpIndex_, static_cast<int64_t>(maxCount));
+        if (index >= maxNodes_)
+            return false;
+
+        first = static_cast<size_t>(index);
+        count = std::min(maxCount, static_cast<size_t>(maxNodes_ - index));
+        return true;
+    }
+
+    void *fresh_node( size_t bumpIndex ) const
+    {
+        return nodeStorage_ + freshOrder_.position(bumpIndex) * nodeSize_;
+    }
+
+    void init( size_t nodeSize, size_t maxNodes, int8_t *storage, bool ownsStorage, QwFreshNodeOrder::Order freshOrder );
+
+    // not copyable
+    QwRawDwcasNodePool( const QwRawDwcasNodePool& );
+    QwRawDwcasNodePool& operator=( const QwRawDwcasNodePool& );
+
+public:
+    QwRawDwcasNodePool( size_t nodeSize, size_t maxNodes, int storageFlags=0,
+            QwFreshNodeOrder::Order freshOrder=QwFreshNodeOrder::ASCENDING_ADDRESS_ORDER );
+
+    // Construct a pool that uses client-supplied storage. storage must be aligned
+    // to CACHE_LINE_SIZE and be at least storage_size(nodeSize, maxNodes) bytes.
+    // The storage is not freed by the pool.
+    QwRawDwcasNodePool( size_t nodeSize, size_t maxNodes, void *storage,
+            QwFreshNodeOrder::Order freshOrder=QwFreshNodeOrder::ASCENDING_ADDRESS_ORDER );
+
+    ~QwRawDwcasNodePool();
+
+    // node sizes and storage requirements are the same as QwRawNodePool
+    static size_t node_size( size_t nodeSize ) { return QwRawNodePool::node_size(nodeSize); }
+    static size_t storage_size( size_t nodeSize, size_t maxNodes ) { return QwRawNodePool::storage_size(nodeSize, maxNodes); }
+
+    int storage_flags() const { return storageFlags_; }
+
+    size_t high_water_mark() const
+    {
+        uint64_t bumpIndex = mint_load_64_relaxed(const_cast<mint_atomic64_t*>(&bumpIndex_));
+        return static_cast<size_t>(std::min(bumpIndex, static_cast<uint64_t>(maxNodes_)));
+    }
+
+    void *allocate()
+    {
+        void *result = QwDwcasFreelist::pop(&top_);
+        if (!result) {
+            size_t first, count;
+            if (bump_allocate(1, first, count))
+                result = fresh_node(first);
+        }
+
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+        if (result)
+            mint_fetch_add_32_relaxed(&allocCount_,1);
+#endif
+        return result;
+    }
+
+    void deallocate( void *node )
+    {
+        assert( node != 0 );
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+        mint_fetch_add_32_relaxed(&allocCount_,-1);
+#endif
+        QwDwcasFreelist::push_chain(&top_, node, node);
+    }
+
+    // Batch operations. See QwRawNodePool.
+
+    static void*& chain_next( void *node ) { return *static_cast<void**>(node); }
+
+    void *allocate_chain( size_t maxCount, size_t& count );
+
+    void deallocate_chain( void *front, void *back );
+};
+
+#endif /* QW_HAVE_ATOMIC128 */
+
+#endif /* INCLUDED_QWDWCASNODEPOOL_H */
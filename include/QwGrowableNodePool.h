@@ -0,0 +1,228 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWGROWABLENODEPOOL_H
+#define INCLUDED_QWGROWABLENODEPOOL_H
+
+#include <cassert>
+
+#include "mintomic/mintomic.h"
+
+#include "QwConfig.h"
+#include "qw_freelist.h"
+
+/*
+    QwGrowableNodePool is a variant of QwNodePool that starts small and
+    grows on demand up to a configurable upper bound.
+
+    Nodes can be allocated and deallocated from any thread. allocate() and
+    deallocate() never call the system allocator, so they are safe to
+    call from real-time threads.
+
+    Storage is allocated in fixed-size segments. Segments are either added
+    explicitly from a non-real-time thread using grow(), or armed in advance
+    using reserve(). When the freelist is exhausted, allocate() activates an
+    armed segment (a single CAS), so real-time threads never stall on the
+    system allocator.
+
+    The implementation uses the same "IBM Freelist" as QwRawNodePool, with
+    the packed-pointer index space partitioned across multiple base arrays:
+
+        index = (segment << segmentBitShift_) | slot
+
+    The index-to-pointer translation goes through a segment table that is
+    only ever appended to, so it can be read without synchronisation.
+    Each segment is aligned to its (power-of-two) size and slot 0 of each
+    segment holds a header containing the segment's index base. This makes
+    pointer-to-index translation a mask and a load, without searching the
+    segment table. Slot 0 of segment 0 corresponds to the null index.
+*/
+
+class QwRawGrowableNodePool {
+
+    int8_t padding1_[QW_FALSE_SHARING_SIZE]; // avoid false sharing
+
+    typedef size_t nodeindex_t;
+    typedef QwPackedIndexFreelist<nodeindex_t, QwPackedIndexLayout> freelist_type; // see qw_freelist.h
+    template<typename, typename> friend class QwPackedIndexFreelist;
+
+    enum { NULL_NODE_INDEX=0, SEGMENT_HEADER_SLOT=0 };
+
+    size_t nodeSize_;               // power of two
+    int8_t nodeBitShift_;
+    size_t segmentNodeCount_;       // number of slots per segment, including the header slot. power of two
+    int8_t segmentBitShift_;        // log2(segmentNodeCount_)
+    nodeindex_t slotMask_;
+    size_t segmentSize_;            // segment size in bytes. segments are aligned to their size
+    size_t maxSegments_;
+
+    int8_t **segmentTable_;         // segment base addresses, indexed by segment number. maxSegments_ entries
+
+    QwPackedIndexLayout layout_; // (count,index) packing of top_
+
+    int8_t padding2_[QW_FALSE_SHARING_SIZE]; // avoid false sharing
+
+    mint_atomic64_t top_; // (node-index, aba-count)
+
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+    mint_atomic32_t allocCount_;
+#endif
+
+    int8_t padding3_[QW_FALSE_SHARING_SIZE]; // avoid false sharing
+
+    // Segments [0, activeSegmentCount_) have been pushed on to the freelist.
+    // Segments [activeSegmentCount_, allocatedSegmentCount_) are armed reserves.
+    mint_atomic32_t activeSegmentCount_;
+    mint_atomic32_t allocatedSegmentCount_;
+    mint_atomic32_t growLock_; // serialises segment allocation
+
+    int8_t padding4_[QW_FALSE_SHARING_SIZE]; // avoid false sharing
+
+    // Node representation. As in QwRawNodePool, free nodes contain a next index at the start.
+    // The header slot of each segment contains the segment's index base (segment << segmentBitShift_).
+
+    // convert a node pointer to an index: locate the segment by masking, then read its index base from the header
+    nodeindex_t index_of_node(void *node) const
+    {
+        int8_t *p = static_cast<int8_t*>(node);
+        int8_t *segmentBase = reinterpret_cast<int8_t*>(reinterpret_cast<uintptr_t>(p) & ~static_cast<uintptr_t>(segmentSize_-1));
+        nodeindex_t segmentIndexBase = *reinterpret_cast<nodeindex_t*>(segmentBase);
+        return segmentIndexBase | static_cast<nodeindex_t>((p - segmentBase) >> nodeBitShift_);
+    }
+
+    // convert an index to a pointer via the segment table
+    void *node_at_index(nodeindex_t index) const
+    {
+        int8_t *segmentBase = segmentTable_[index >> segmentBitShift_];
+        return segmentBase + (static_cast<ptrdiff_t>(index & slotMask_) << nodeBitShift_);
+    }
+
+    void stack_push( void *node )
+    {
+        assert( node != 0 );
+        freelist_type::push_chain(&top_, layout_, index_of_node(node), node);
+    }
+
+    // push a chain of nodes linked by their next links from front through to back
+    void stack_push_chain( void *front, void *back )
+    {
+        freelist_type::push_chain(&top_, layout_, index_of_node(front), back);
+    }
+
+    void *stack_pop()
+    {
+        return freelist_type::pop(&top_, layout_, *this);
+    }
+
+    // allocate and link a new segment, and arm it as a reserve. caller must hold growLock_
+    bool allocate_segment();
+
+    // push the lowest armed segment on to the freelist. real-time safe.
+    // returns false if there are no armed segments.
+    bool activate_reserved_segment();
+
+    bool try_lock_grow() { return mint_compare_exchange_strong_32_relaxed(&growLock_, 0, 1) == 0; }
+    void unlock_grow() { mint_thread_fence_release(); mint_store_32_relaxed(&growLock_, 0); }
+
+    // not copyable
+    QwRawGrowableNodePool( const QwRawGrowableNodePool& );
+    QwRawGrowableNodePool& operator=( const QwRawGrowableNodePool& );
+
+public:
+    // Each segment holds segmentNodeCount-1 nodes (segmentNodeCount is rounded up to a power of two).
+    // The pool will never hold more than maxSegments segments.
+    // initialSegmentCount segments are allocated and made available by the constructor.
+    QwRawGrowableNodePool( size_t nodeSize, size_t segmentNodeCount, size_t maxSegments, size_t initialSegmentCount=1 );
+    ~QwRawGrowableNodePool();
+
+    void *allocate()
+    {
+        void *result;
+        do {
+            result = stack_pop();
+        } while (!result && activate_reserved_segment());
+
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+        if (result)
+            mint_fetch_add_32_relaxed(&allocCount_,1);
+#endif
+        return result;
+    }
+
+    void deallocate( void *node )
+    {
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+        mint_fetch_add_32_relaxed(&allocCount_,-1);
+#endif
+        stack_push(node);
+    }
+
+    // The following operations allocate memory. Don't call them from a real-time thread.
+    // They return false if the maximum segment count has been reached, the
+    // system allocator fails, or another thread is concurrently growing the pool.
+
+    // allocate a new segment and make its nodes available immediately
+    bool grow();
+
+    // ensure that at least segmentCount armed segments are available for
+    // allocate() to activate when the freelist runs dry.
+    bool reserve( size_t segmentCount );
+
+    size_t nodes_per_segment() const { return segmentNodeCount_ - 1; }
+    size_t active_segment_count() const { return mint_load_32_relaxed(const_cast<mint_atomic32_t*>(&activeSegmentCount_)); }
+    size_t allocated_segment_count() const { return mint_load_32_relaxed(const_cast<mint_atomic32_t*>(&allocatedSegmentCount_)); }
+    size_t max_segment_count() const { return maxSegments_; }
+};
+
+
+template<typename NodeT>
+class QwGrowableNodePool{
+    QwRawGrowableNodePool rawPool_;
+public:
+
+    typedef NodeT node_type;
+
+    QwGrowableNodePool( size_t segmentNodeCount, size_t maxSegments, size_t initialSegmentCount=1 )
+        : rawPool_( sizeof(NodeT), segmentNodeCount, maxSegments, initialSegmentCount )
+    {}
+
+    node_type *allocate()
+    {
+        void *p = rawPool_.allocate();
+        return (p) ? new (p) node_type() : 0;
+    }
+
+    void deallocate( node_type *p )
+    {
+        p->~node_type();
+        rawPool_.deallocate(p);
+    }
+
+    bool grow() { return rawPool_.grow(); }
+    bool reserve( size_t segmentCount ) { return rawPool_.reserve(segmentCount); }
+
+    size_t nodes_per_segment() const { return rawPool_.nodes_per_segment(); }
+    size_t active_segment_count() const { return rawPool_.active_segment_count(); }
+    size_t allocated_segment_count() const { return rawPool_.allocated_segment_count(); }
+    size_t max_segment_count() const { return rawPool_.max_segment_count(); }
+};
+
+#endif /* INCLUDED_QWGROWABLENODEPOOL_H */
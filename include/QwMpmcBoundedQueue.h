@@ -0,0 +1,200 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWMPMCBOUNDEDQUEUE_H
+#define INCLUDED_QWMPMCBOUNDEDQUEUE_H
+
+#include <algorithm>
+#include <cassert>
+
+#include "mintomic/mintomic.h"
+
+#include "QwConfig.h"
+#include "qw_aligned_malloc.h"
+#include "qw_freelist.h"
+
+/*
+    QwMpmcBoundedQueue is a lock-free concurrent, multiple-producer multiple-consumer
+    bounded FIFO queue of node pointers.
+
+    Producer operations: try_push()
+    Consumer operations: try_pop(), empty()
+
+    All operations may be invoked concurrently.
+
+    Unlike the other Queue World queues, nodes are not linked. The queue stores node
+    pointers in a ring buffer, so there is no pointer chasing, and consecutive
+    elements share cache lines. The capacity is fixed at construction: try_push()
+    fails when the queue is full, which gives producers natural backpressure.
+
+    Implemented using Dmitry Vyukov's bounded MPMC queue:
+        http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+
+    Each slot has a sequence number that tells producers and consumers whether
+    the slot is ready for them in the current lap of the ring. A push or pop
+    claims a slot with a single CAS on the enqueue or dequeue position, then
+    publishes it by storing the slot's sequence number. No ABA protection is
+    needed: positions are 64-bit and never wrap.
+
+    A slot that has been claimed but not yet published blocks consumers (or, when
+    the queue is full, producers) of that slot: they see the queue as empty
+    (or full) until the slot is published.
+
+    The constructor allocates the ring. Other operations don't allocate.
+*/
+
+template<typename NodePtrT>
+class QwMpmcBoundedQueue {
+public:
+    typedef NodePtrT node_ptr_type;
+
+private:
+    struct Slot {
+        mint_atomic64_t sequence;
+        node_ptr_type node;
+    };
+
+    int8_t padding1_[QW_FALSE_SHARING_SIZE]; // avoid false sharing
+
+    Slot *slots_;               // ring of capacity slots. read-only after construction
+    size_t indexMask_;          // capacity - 1
+
+    int8_t padding2_[QW_FALSE_SHARING_SIZE]; // avoid false sharing between the ring description and producers
+
+    mint_atomic64_t enqueuePosition_;
+
+    int8_t padding3_[QW_FALSE_SHARING_SIZE]; // avoid false sharing between producers and consumers
+
+    mint_atomic64_t dequeuePosition_;
+
+    int8_t padding4_[QW_FALSE_SHARING_SIZE]; // avoid false sharing
+
+    // the largest power of two slot count whose ring size fits in a size_t
+    static size_t max_slot_count()
+    {
+        size_t result = 1;
+        while (result <= (~static_cast<size_t>(0)) / sizeof(Slot) / 2)
+            result <<= 1;
+        return result;
+    }
+
+    QwMpmcBoundedQueue( const QwMpmcBoundedQueue& );
+    QwMpmcBoundedQueue& operator=( const QwMpmcBoundedQueue& );
+
+public:
+    // capacity is rounded up to a power of two (at least 2). (capacities too large
+    // to allocate are clamped, so that the ring size doesn't overflow)
+    explicit QwMpmcBoundedQueue( size_t capacity )
+    {
+        size_t slotCount = std::max<size_t>(2, qw_round_up_to_power_of_two(std::min(capacity, max_slot_count())));
+        indexMask_ = slotCount - 1;
+
+        slots_ = static_cast<Slot*>(qw_aligned_malloc(sizeof(Slot) * slotCount, CACHE_LINE_SIZE));
+        assert( slots_ != 0 );
+
+        // slot i is ready for the push at position i
+        for (size_t i=0; i < slotCount; ++i) {
+            slots_[i].sequence._nonatomic = i;
+            slots_[i].node = 0;
+        }
+
+        enqueuePosition_._nonatomic = 0;
+        dequeuePosition_._nonatomic = 0;
+    }
+
+    ~QwMpmcBoundedQueue()
+    {
+        qw_aligned_free(slots_);
+    }
+
+    size_t capacity() const { return indexMask_ + 1; }
+
+    // returns false if the queue is full
+    bool try_push( node_ptr_type node )
+    {
+        assert( node != 0 );
+
+        Slot *slot;
+        uint64_t position = mint_load_64_relaxed(&enqueuePosition_);
+        for (;;) {
+            slot = &slots_[position & indexMask_];
+            uint64_t sequence = mint_load_64_relaxed(&slot->sequence);
+            mint_thread_fence_acquire(); // (the consumer of the previous lap has finished with the slot)
+            int64_t difference = static_cast<int64_t>(sequence - position);
+
+            if (difference == 0) {
+                // the slot is free in this lap. try to claim it
+                uint64_t previous = mint_compare_exchange_strong_64_relaxed(&enqueuePosition_, position, position + 1);
+                if (previous == position)
+                    break;
+                position = previous;
+            } else if (difference < 0) {
+                return false; // the slot still holds an element from the previous lap: full
+            } else {
+                position = mint_load_64_relaxed(&enqueuePosition_); // another producer claimed the slot
+            }
+        }
+
+        slot->node = node;
+        mint_thread_fence_release(); // (publish the node and its payload)
+        mint_store_64_relaxed(&slot->sequence, position + 1);
+        return true;
+    }
+
+    // returns 0 if the queue is empty
+    node_ptr_type try_pop()
+    {
+        Slot *slot;
+        uint64_t position = mint_load_64_relaxed(&dequeuePosition_);
+        for (;;) {
+            slot = &slots_[position & indexMask_];
+            uint64_t sequence = mint_load_64_relaxed(&slot->sequence);
+            mint_thread_fence_acquire(); // (acquire the node and its payload)
+            int64_t difference = static_cast<int64_t>(sequence - (position + 1));
+
+            if (difference == 0) {
+                // the slot holds an element in this lap. try to claim it
+                uint64_t previous = mint_compare_exchange_strong_64_relaxed(&dequeuePosition_, position, position + 1);
+                if (previous == position)
+                    break;
+                position = previous;
+            } else if (difference < 0) {
+                return 0; // the slot hasn't been filled in this lap: empty
+            } else {
+                position = mint_load_64_relaxed(&dequeuePosition_); // another consumer claimed the slot
+            }
+        }
+
+        node_ptr_type result = slot->node;
+        mint_thread_fence_release(); // (we have finished reading the slot before producers reuse it)
+        mint_store_64_relaxed(&slot->sequence, position + indexMask_ + 1); // ready for the push in the next lap
+        return result;
+    }
+
+    // returns true if the queue was empty when it was checked
+    bool empty() const
+    {
+        uint64_t position = mint_load_64_relaxed(const_cast<mint_atomic64_t*>(&dequeuePosition_));
+        return (mint_load_64_relaxed(const_cast<mint_atomic64_t*>(&slots_[position & indexMask_].sequence)) != position + 1);
+    }
+};
+
+#endif /* INCLUDED_QWMPMCBOUNDEDQUEUE_H */
@@ -0,0 +1,211 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWMPMCFIFOQUEUE_H
+#define INCLUDED_QWMPMCFIFOQUEUE_H
+
+#include <cassert>
+
+#include "mintomic/mintomic.h"
+#include "qw_atomic.h"
+
+#include "QwConfig.h"
+#include "QwSingleLinkNodeInfo.h"
+
+/*
+    QwMpmcFifoQueue is a concurrent, multiple-producer multiple-consumer FIFO queue.
+
+    Producer operations: push(), push_multiple()
+    Consumer operations: pop(), empty()
+
+    All operations may be invoked concurrently.
+
+    Implemented using the Michael and Scott queue algorithm (see ALGORITHMS.txt),
+    adapted to endogenous links:
+
+        - A node can't be handed to a consumer while the queue still uses its link.
+          In the MS-queue the dequeued node becomes the queue's dummy node. Here,
+          pop() returns the dummy node instead, once its successor has become
+          the new dummy. The queue owns a stub node that is pushed behind the
+          last element when there is no successor, and is skipped when it is
+          dequeued (cf. Vyukov's intrusive MPSC queue).
+
+        - Without a counter in each link, the MS-queue's CAS on the tail node's
+          link is subject to ABA when the node is recycled. Instead, push()
+          swaps the tail with a single exchange, then links the previous tail
+          to the new node. No ABA protection is required, and push() is wait-free.
+
+        - The head is a (pointer, count) pair updated with a double-width CAS,
+          as in QwRawDwcasNodePool.
+
+    A consumer that observes a push between its exchange and its link store
+    sees the queue as empty: pop() may return 0 while a push is in progress.
+    So the queue is not lock-free: a producer that stalls between the two
+    steps hides every node pushed after it from every consumer.
+
+    Nodes are read by concurrent pop() calls after they have been dequeued
+    (the reads are validated by the CAS on the head). Node memory must remain
+    readable while pop() may be running. Nodes allocated from a QwNodePool
+    satisfy this requirement.
+
+    Only available when QW_HAVE_ATOMIC128 is set (x64, see qw_atomic.h).
+*/
+
+#if QW_HAVE_ATOMIC128
+
+template<typename NodePtrT, int NEXT_LINK_INDEX>
+class QwMpmcFifoQueue {
+    typedef QwSingleLinkNodeInfo<NodePtrT,NEXT_LINK_INDEX> nodeinfo;
+
+public:
+    typedef typename nodeinfo::node_type node_type;
+    typedef typename nodeinfo::node_ptr_type node_ptr_type;
+    typedef typename nodeinfo::const_node_ptr_type const_node_ptr_type;
+
+private:
+    qw_mint_atomic128_t head_; // (dummy node pointer, count). the first element is the dummy, or its successor if the dummy is the stub
+    int8_t padding1_[QW_FALSE_SHARING_SIZE]; // avoid false sharing between consumers and producers
+
+    mint_atomicPtr_t tail_;
+    int8_t padding2_[QW_FALSE_SHARING_SIZE]; // avoid false sharing
+
+    // The stub node. Only its link is stored, the stub's node pointer is offset so that
+    // next_ptr(stub()) aliases stubNext_ (as in QwSTailList::before_begin()).
+    node_ptr_type stubNext_;
+    mint_atomic32_t stubInQueue_; // 1 from when a thread claims the stub to push it, until the stub is dequeued
+
+    node_ptr_type stub()
+    {
+        return reinterpret_cast<node_ptr_type>(reinterpret_cast<char*>(&stubNext_) - nodeinfo::offsetof_next_ptr());
+    }
+
+    const_node_ptr_type stub() const
+    {
+        return reinterpret_cast<const_node_ptr_type>(reinterpret_cast<const char*>(&stubNext_) - nodeinfo::offsetof_next_ptr());
+    }
+
+    void push_stub()
+    {
+        if (mint_compare_exchange_strong_32_relaxed(&stubInQueue_, 0, 1) != 0)
+            return; // another consumer is pushing the stub
+
+        mint_thread_fence_acquire(); // (the stub's last dequeuer has finished reading its link)
+        stubNext_ = 0;
+        push(stub());
+    }
+
+    QwMpmcFifoQueue( const QwMpmcFifoQueue& );
+    QwMpmcFifoQueue& operator=( const QwMpmcFifoQueue& );
+
+public:
+    QwMpmcFifoQueue()
+    {
+        assert( (reinterpret_cast<uintptr_t>(&head_) & 15) == 0 ); // cmpxchg16b requires 16-byte alignment
+
+        stubNext_ = 0;
+        stubInQueue_._nonatomic = 1;
+        head_._nonatomic[0] = reinterpret_cast<uint64_t>(stub());
+        head_._nonatomic[1] = 0;
+        tail_._nonatomic = stub();
+    }
+
+    void push( node_ptr_type node )
+    {
+        push_multiple(node, node);
+    }
+
+    // Push the chain of nodes linked from front through to back with a single exchange.
+    // front is the first of them to be dequeued.
+    // (NOTE: the opposite order to QwMpscFifoQueue::push_multiple.)
+    void push_multiple( node_ptr_type front, node_ptr_type back )
+    {
+        nodeinfo::check_node_is_unlinked( back );
+        nodeinfo::next_ptr(back) = 0; // (a popped node still links to its successor unless QW_VALIDATE_NODE_LINKS is defined)
+
+        mint_thread_fence_release(); // (publish the node payloads and back's 0 link)
+        node_ptr_type previous = static_cast<node_ptr_type>(qw_mint_exchange_ptr_relaxed(&tail_, back));
+        nodeinfo::next_ptr(previous) = front; // now consumers can reach front
+    }
+
+    // returns true if the queue was empty when it was checked
+    bool empty() const
+    {
+        uint64_t head[2];
+        qw_mint_load_128_relaxed_torn(const_cast<qw_mint_atomic128_t*>(&head_), head);
+        const_node_ptr_type h = reinterpret_cast<const_node_ptr_type>(head[0]);
+        return (h == stub() && stubNext_ == 0);
+    }
+
+    // returns 0 if the queue is empty
+    node_ptr_type pop()
+    {
+        uint64_t head[2];
+        qw_mint_load_128_relaxed_torn(&head_, head);
+
+        for (;;) {
+            mint_thread_fence_acquire(); // (acquire the dummy's link and its successor's payload)
+            node_ptr_type h = reinterpret_cast<node_ptr_type>(head[0]);
+            node_ptr_type next = nodeinfo::next_ptr(h);
+
+            if (next == 0) {
+                // h is the last node, or a push that links h to its successor is in progress
+                node_ptr_type tail = static_cast<node_ptr_type>(mint_load_ptr_relaxed(&tail_));
+
+                uint64_t current[2];
+                qw_mint_load_128_relaxed_torn(&head_, current);
+                if (current[0] != head[0] || current[1] != head[1]) { // head has changed, h and tail may be stale
+                    head[0] = current[0];
+                    head[1] = current[1];
+                    continue;
+                }
+
+                if (h == stub() || h != tail)
+                    return 0;
+
+                // h is the last element. Push the stub behind it so that h can be dequeued
+                push_stub();
+                continue;
+            }
+
+            // (release, so that the next consumer's acquire of the head also acquires next's payload)
+            mint_thread_fence_release();
+            if (qw_mint_compare_exchange_strong_128_relaxed(&head_, head, reinterpret_cast<uint64_t>(next), head[1] + 1)) {
+                if (h == stub()) {
+                    // skip the stub. it has left the queue and can be pushed again
+                    mint_thread_fence_release();
+                    mint_store_32_relaxed(&stubInQueue_, 0);
+
+                    head[0] = reinterpret_cast<uint64_t>(next);
+                    head[1] = head[1] + 1;
+                    continue;
+                }
+
+                nodeinfo::clear_node_link_for_validation( h );
+                return h;
+            }
+            // (the failed CAS loaded the current head)
+        }
+    }
+};
+
+#endif /* QW_HAVE_ATOMIC128 */
+
+#endif /* INCLUDED_QWMPMCFIFOQUEUE_H */
@@ -22,6 +22,7 @@
 #ifndef INCLUDED_QWMPSCFIFOQUEUE_H
 #define INCLUDED_QWMPSCFIFOQUEUE_H
 
+#include "QwConfig.h"
 #include "QwSingleLinkNodeInfo.h"
 #include "QwMpmcPopAllLifoStack.h"
 #include "QwSTailList.h"
@@ -31,7 +32,7 @@
     QwMpscFifoQueue is a lock-free concurrent, multiple-producer single-consumer FIFO queue.
 
     Producer(s) operations: push()
-    Consumer operations: consumer_empty(), pop().
+    Consumer operations: consumer_empty(), pop(), pop_all_fifo(), drain().
 
     There may be multiple producers, but only one consumer.
 
@@ -47,6 +48,7 @@ class QwMpscFifoQueue {
     typedef QwSingleLinkNodeInfo<NodePtrT,NEXT_LINK_INDEX> nodeinfo;
 
     QwMpmcPopAllLifoStack<NodePtrT, NEXT_LINK_INDEX> mpscLifo_;
+    int8_t padding_[QW_FALSE_SHARING_SIZE]; // avoid false sharing between producers and the consumer
     QwSTailList<NodePtrT, NEXT_LINK_INDEX> consumerLocalReversingQueue_;
 
 public:
@@ -54,6 +56,31 @@ public:
     typedef typename nodeinfo::node_ptr_type node_ptr_type;
     typedef typename nodeinfo::const_node_ptr_type const_node_ptr_type;
 
+    typedef QwSTailList<NodePtrT, NEXT_LINK_INDEX> fifo_list_type;
+
+private:
+    // move all nodes in the lifo to the back of consumerLocalReversingQueue_, in fifo order
+    void append_lifo_to_local_queue()
+    {
+        node_ptr_type n = mpscLifo_.pop_all();
+        if (!n)
+            return;
+
+        // Insert each node directly after the old back of the local queue. The lifo
+        // holds the newest node first, so this reverses the nodes into fifo order.
+        typename fifo_list_type::iterator before = (consumerLocalReversingQueue_.empty())
+                ? consumerLocalReversingQueue_.before_begin()
+                : typename fifo_list_type::iterator(consumerLocalReversingQueue_.back());
+        while (n) {
+            node_ptr_type next = nodeinfo::next_ptr(n);
+            nodeinfo::clear_node_link_for_validation(n);
+            consumerLocalReversingQueue_.insert_after(before, n);
+            n = next;
+        }
+    }
+
+public:
+
     void push( node_ptr_type n )
     {
         return mpscLifo_.push(n);
@@ -107,6 +134,43 @@ public:
             return consumerLocalReversingQueue_.pop_front();
         }
     }
+
+    // Pop all available nodes with a single atomic operation. The result is in fifo order.
+    fifo_list_type pop_all_fifo()
+    {
+        append_lifo_to_local_queue();
+
+        fifo_list_type result;
+        result.swap(consumerLocalReversingQueue_);
+        return result;
+    }
+
+    // Pop up to maxCount nodes and call f(node) for each of them, in fifo order.
+    // While f processes a node, the next node is prefetched. The lifo is only
+    // checked when the consumer's local queue runs out. f may push the node onto
+    // another queue or free it, but must not pop from this queue.
+    // Returns the number of nodes processed.
+    template<typename F>
+    size_t drain( F f, size_t maxCount )
+    {
+        size_t count = 0;
+        while (count < maxCount) {
+            if (consumerLocalReversingQueue_.empty()) {
+                append_lifo_to_local_queue();
+                if (consumerLocalReversingQueue_.empty())
+                    break;
+            }
+
+            node_ptr_type n = consumerLocalReversingQueue_.pop_front();
+            node_ptr_type next = consumerLocalReversingQueue_.front();
+            if (next)
+                QW_PREFETCH(next);
+
+            f(n);
+            ++count;
+        }
+        return count;
+    }
 };
 
 #endif /* INCLUDED_QWMPSCFIFOQUEUE_H */
@@ -0,0 +1,197 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWMPSCINTRUSIVEQUEUE_H
+#define INCLUDED_QWMPSCINTRUSIVEQUEUE_H
+
+#include "mintomic/mintomic.h"
+#include "qw_atomic.h"
+
+#include "QwConfig.h"
+#include "QwSingleLinkNodeInfo.h"
+
+/*
+    QwMpscIntrusiveQueue is a concurrent, multiple-producer single-consumer FIFO queue.
+
+    Producer(s) operations: push(), push_multiple()
+    Consumer operations: consumer_empty(), pop().
+
+    There may be multiple producers, but only one consumer.
+
+    All operations may be invoked concurrently.
+
+    The interface is the same as QwMpscFifoQueue, so the two can be swapped with
+    a typedef. The difference is in how the cost of FIFO ordering is paid:
+
+        - QwMpscFifoQueue pushes onto a LIFO. When the consumer runs out of nodes,
+          pop() reverses the whole LIFO, so the cost of a pop() is proportional to
+          the size of the backlog that arrived since the previous reversal.
+
+        - QwMpscIntrusiveQueue keeps the nodes in FIFO order. push() is a single
+          atomic exchange (wait-free), and every pop() is O(1).
+
+    Implemented using Dmitry Vyukov's intrusive MPSC node-based queue:
+        http://www.1024cores.net/home/lock-free-algorithms/queues/intrusive-mpsc-node-based-queue
+
+    push() exchanges the queue's tail with the new node, then links the previous
+    tail to it. Between these two steps the new node is not reachable: a consumer
+    that reaches the previous tail sees the queue as empty. So pop() is not
+    lock-free: it may return 0 while a push is in progress, even if other nodes
+    have been pushed since. The queue owns a stub node that is pushed behind the
+    last node so that the last node can be popped.
+
+    Unlike QwMpscFifoQueue, push( n, wasEmpty ) reports wasEmpty accurately.
+*/
+
+template<typename NodePtrT, int NEXT_LINK_INDEX>
+class QwMpscIntrusiveQueue {
+
+    typedef QwSingleLinkNodeInfo<NodePtrT,NEXT_LINK_INDEX> nodeinfo;
+
+public:
+    typedef typename nodeinfo::node_type node_type;
+    typedef typename nodeinfo::node_ptr_type node_ptr_type;
+    typedef typename nodeinfo::const_node_ptr_type const_node_ptr_type;
+
+private:
+    mint_atomicPtr_t tail_; // the most recently pushed node. exchanged by producers
+    int8_t padding_[QW_FALSE_SHARING_SIZE]; // avoid false sharing between producers and the consumer
+
+    node_ptr_type consumerFront_; // the next node to pop, or the stub. only referenced by the consumer
+
+    // The stub node. Only its link is stored, the stub's node pointer is offset so that
+    // next_ptr(stub()) aliases stubNext_ (as in QwSTailList::before_begin()).
+    node_ptr_type stubNext_;
+
+    node_ptr_type stub()
+    {
+        return reinterpret_cast<node_ptr_type>(reinterpret_cast<char*>(&stubNext_) - nodeinfo::offsetof_next_ptr());
+    }
+
+    const_node_ptr_type stub() const
+    {
+        return reinterpret_cast<const_node_ptr_type>(reinterpret_cast<const char*>(&stubNext_) - nodeinfo::offsetof_next_ptr());
+    }
+
+    // link front through to back in at the tail. returns the previous tail
+    node_ptr_type push_chain( node_ptr_type front, node_ptr_type back )
+    {
+        mint_thread_fence_release(); // (publish the node payloads and back's 0 link)
+        node_ptr_type previous = static_cast<node_ptr_type>(qw_mint_exchange_ptr_relaxed(&tail_, back));
+        nodeinfo::next_ptr(previous) = front; // now the consumer can reach front
+        return previous;
+    }
+
+    QwMpscIntrusiveQueue( const QwMpscIntrusiveQueue& );
+    QwMpscIntrusiveQueue& operator=( const QwMpscIntrusiveQueue& );
+
+public:
+    QwMpscIntrusiveQueue()
+    {
+        stubNext_ = 0;
+        tail_._nonatomic = stub();
+        consumerFront_ = stub();
+    }
+
+    void push( node_ptr_type n )
+    {
+        nodeinfo::check_node_is_unlinked( n );
+        nodeinfo::next_ptr(n) = 0; // (a popped node still links to its successor unless QW_VALIDATE_NODE_LINKS is defined)
+        push_chain(n, n);
+    }
+
+    // wasEmpty is set if the consumer had popped all previously pushed nodes.
+    // (The stub is only at the tail when the consumer has popped the last node.)
+    void push( node_ptr_type n, bool& wasEmpty )
+    {
+        nodeinfo::check_node_is_unlinked( n );
+        nodeinfo::next_ptr(n) = 0;
+        wasEmpty = (push_chain(n, n) == stub());
+    }
+
+    // NOTE: back will be the first item to be dequeued (the same order as
+    // QwMpscFifoQueue::push_multiple). The chain is reversed before it is pushed,
+    // which is O(n) in the length of the chain.
+    void push_multiple( node_ptr_type front, node_ptr_type back, bool& wasEmpty )
+    {
+        nodeinfo::check_node_is_unlinked( back );
+
+        // reverse the chain, so that it runs from back to front
+        node_ptr_type reversed = 0;
+        node_ptr_type n = front;
+        while (n != back) {
+            node_ptr_type next = nodeinfo::next_ptr(n);
+            nodeinfo::next_ptr(n) = reversed;
+            reversed = n;
+            n = next;
+        }
+        nodeinfo::next_ptr(back) = reversed;
+
+        wasEmpty = (push_chain(back, front) == stub());
+    }
+
+    // Returns false while a push is in progress (unlike pop(), which may return 0).
+    // A consumer that sleeps when the queue is empty, and is woken by producers
+    // that see wasEmpty, should only sleep when consumer_empty() returns true.
+    bool consumer_empty() const
+    {
+        return (consumerFront_ == stub() && stubNext_ == 0);
+    }
+
+    node_ptr_type pop()
+    {
+        node_ptr_type front = consumerFront_;
+        node_ptr_type next = nodeinfo::next_ptr(front);
+        mint_thread_fence_acquire(); // (acquire next's payload)
+
+        if (front == stub()) {
+            if (next == 0)
+                return 0;
+
+            // skip the stub
+            consumerFront_ = next;
+            front = next;
+            next = nodeinfo::next_ptr(front);
+            mint_thread_fence_acquire();
+        }
+
+        if (next == 0) {
+            // front is the last node, or a push that links front to its successor is in progress
+            if (front != static_cast<node_ptr_type>(mint_load_ptr_relaxed(&tail_)))
+                return 0;
+
+            // front is the last node. push the stub behind it so that front can be popped
+            stubNext_ = 0;
+            push_chain(stub(), stub());
+
+            next = nodeinfo::next_ptr(front);
+            mint_thread_fence_acquire();
+            if (next == 0)
+                return 0; // a producer pushed after front, its push is in progress
+        }
+
+        consumerFront_ = next;
+        nodeinfo::clear_node_link_for_validation( front );
+        return front;
+    }
+};
+
+#endif /* INCLUDED_QWMPSCINTRUSIVEQUEUE_H */
@@ -22,11 +22,15 @@
 #ifndef INCLUDED_QWNODEPOOL_H
 #define INCLUDED_QWNODEPOOL_H
 
+#include <algorithm>
 #include <cassert>
 
 #include "mintomic/mintomic.h"
 
 #include "QwConfig.h"
+#include "QwNodePoolStatistics.h"
+#include "qw_atomic.h"
+#include "qw_futex.h"
 
 /*
     QwNodePool provides a thread-safe, lock-free fixed-size pool of
@@ -37,11 +41,26 @@
     real-time audio threads.
 
     QwNodePool ensures that all nodes are aligned to cache line boundaries
-    to avoid false sharing.
+    to avoid false sharing. The line size is determined at runtime (see
+    qw_cache_info.h). The pool's own hot fields are separated by
+    QW_FALSE_SHARING_SIZE bytes.
+
+    Construction is O(1): nodes are only touched when they are first
+    allocated (see bumpIndex_), so storage for large pools is committed
+    on demand.
+
+    Threads that allocate and free at high rates can avoid contending on the
+    shared freelist by going through a per-thread QwNodePoolMagazineCache,
+    or a QwPerCpuNodePoolCache that is shared by all threads.
 
     The implementation uses the "IBM Freelist" lock-free stack algorithm.
     See ALGORITHMS.txt
 
+    Under contention, a push and a pop whose CAS on the freelist top fails
+    can exchange a node directly through an elimination array, without
+    touching the freelist top (Hendler, Shavit, Yerushalmi 2004, "A Scalable
+    Lock-free Stack Algorithm").
+
     This implementation may not be the most efficient. However, it is
     portable to 64-bit systems that lack 128-bit CAS. Tagged pointers
     are packed into 64 bit words as (count,index), where index can be
@@ -53,16 +72,88 @@
     Additional arrays need only be allocated on demand.
 */
 
+/*
+    QwFreshNodeOrder determines the order in which never-allocated nodes are
+    handed out by the pool. It maps the k-th fresh allocation to a node position
+    in [0, nodeCount).
+
+    ASCENDING_ADDRESS_ORDER: consecutive allocations have ascending addresses.
+        Friendly to hardware stream prefetchers when batches of fresh nodes are
+        filled and scanned in allocation order. This is the default.
+
+    DESCENDING_ADDRESS_ORDER: consecutive allocations have descending addresses.
+        (The order that earlier versions of QwNodePool produced.)
+
+    PAGE_INTERLEAVED_ORDER: consecutive allocations are spread across pages,
+        round-robin. Nodes that are allocated together then fall into different
+        cache sets and DRAM banks (cache coloring). Nodes in a final, partially
+        used page are allocated in ascending order.
+*/
+
+class QwFreshNodeOrder {
+public:
+    enum Order { ASCENDING_ADDRESS_ORDER, DESCENDING_ADDRESS_ORDER, PAGE_INTERLEAVED_ORDER };
+
+private:
+    Order order_;
+    size_t nodeCount_;
+    size_t nodesPerPage_;               // PAGE_INTERLEAVED_ORDER stride
+    size_t pageCount_;                  // number of full pages
+    size_t interleavedNodeCount_;       // pageCount_ * nodesPerPage_
+
+public:
+    void init( Order order, size_t nodeCount, size_t nodeSize, size_t pageSize )
+    {
+        order_ = order;
+        nodeCount_ = nodeCount;
+        nodesPerPage_ = std::max(pageSize / nodeSize, static_cast<size_t>(1));
+        pageCount_ = nodeCount / nodesPerPage_;
+        interleavedNodeCount_ = pageCount_ * nodesPerPage_;
+    }
+
+    size_t position( size_t k ) const
+    {
+        assert( k < nodeCount_ );
+        switch (order_) {
+        case DESCENDING_ADDRESS_ORDER:
+            return nodeCount_ - 1 - k;
+        case PAGE_INTERLEAVED_ORDER:
+            if (k < interleavedNodeCount_)
+                return (k % pageCount_) * nodesPerPage_ + (k / pageCount_);
+            return k;
+        default:
+            return k;
+        }
+    }
+};
+
+
 class QwRawNodePool {
 
-    int8_t padding1_[CACHE_LINE_SIZE]; // avoid false sharing. TODO FIXME: give this more thought
+    int8_t padding1_[QW_FALSE_SHARING_SIZE]; // avoid false sharing with whatever precedes the pool
 
     int8_t *nodeStorage_;       // The raw memory buffer that is allocated and freed
+    bool ownsStorage_;          // false if the storage was supplied by the client
+    size_t storageSize_;        // size of the allocation, when nodeStorage_ was allocated with qw_vm_allocate
+    int storageFlags_;          // StorageFlags that were actually applied to nodeStorage_
 
     enum { NULL_NODE_INDEX=0 };
     int8_t *nodeArrayBase_;     // base ptr indexed by the packed pointer indexes. 1-based. nodeArrayBase_[0] should not be dereferenced
-    size_t nodeSize_;           // nodes are allocated on cache-line boundaries. in this impl they also have power-of-two size
-    int8_t nodeBitShift_;       // index=(ptr-nodeArrayBase_)>>nodeBitShift_; (nodeArrayBase_+(index<<nodeBitShift_)) == ptr
+    size_t nodeSize_;           // nodes are allocated on cache-line boundaries. node size is a multiple of the cache line size
+    // nodeSize_ == nodeSizeOddFactor_ << nodeSizeShift_. Converting a pointer to an index is an exact division:
+    // index=((ptr-nodeArrayBase_)>>nodeSizeShift_)*nodeSizeOddInverse_; (nodeArrayBase_+(index*nodeSize_)) == ptr
+    int8_t nodeSizeShift_;
+    size_t nodeSizeOddInverse_; // multiplicative inverse of nodeSizeOddFactor_ modulo 2^N (N is the number of bits in size_t)
+    size_t maxNodeIndex_;       // valid node indices are [1,maxNodeIndex_]
+
+    // trim() works on blocks: the shortest runs of whole nodes that are also runs of whole
+    // pages (lcm(page size, nodeSize_) bytes). Blocks start at node position firstBlockNodePosition_.
+    size_t blockSize_;
+    size_t nodesPerBlock_;
+    size_t firstBlockNodePosition_;
+    size_t blockCount_;         // 0 if the storage can't be trimmed
+    size_t *blockNext_;         // released block stack links, indexed by 1-based block index. 0 if the storage can't be trimmed
+    mint_atomic64_t *parkedBlocks_; // trim()'s parking slots, indexed by block (blockCount_+1 entries). 0 if the storage can't be trimmed
 
     //////////////////////////////////////////////////////////////////////
     // Packed pointer representation with ABA-prevention count.
@@ -100,7 +191,71 @@ class QwRawNodePool {
     mint_atomic32_t allocCount_;
 #endif
 
-    int8_t padding2_[CACHE_LINE_SIZE]; // avoid false sharing
+#ifdef QW_NODE_POOL_STATISTICS
+    QwNodePoolStatisticsShards statistics_; // (padded internally)
+#endif
+
+    int8_t padding2_[QW_FALSE_SHARING_SIZE]; // avoid false sharing
+
+    // Magazine depot. A stack of full magazines returned by QwRawNodePoolMagazineCache.
+    // Uses the same algorithm as the freelist, but links magazines through a different node word.
+    mint_atomic64_t depotTop_;
+
+    // Released blocks. trim() returns the pages of fully free blocks to the operating
+    // system and pushes the blocks onto this stack. The contents of released pages are
+    // lost, so released blocks are linked through blockNext_ rather than through their nodes.
+    mint_atomic64_t releasedBlockTop_;
+
+    // Parked nodes. trim() detaches the freelist one block-sized run at a time and parks
+    // each node in the slot of the block that contains it (slot blockCount_ holds nodes
+    // that aren't in a block). A slot holds a chain linked by index and its length, packed
+    // like an abapointer_t with the length in place of the count. When a block's slot
+    // is full, trim() takes the whole chain and releases the block. Allocations that find
+    // the freelist and the depot empty take parked chains while trimParking_ is set.
+    mint_atomic32_t trimParking_;
+
+    int8_t padding3_[QW_FALSE_SHARING_SIZE]; // avoid false sharing between the freelist and the depot
+
+    // High-water mark. Nodes are not pushed onto the freelist at construction time.
+    // Instead, nodes that have never been allocated are handed out by atomically
+    // advancing bumpIndex_. This makes construction O(1) and leaves pages that hold
+    // never-allocated nodes untouched. Valid node indices below bumpIndex_ have been
+    // allocated at least once. bumpIndex_ may overshoot maxNodeIndex_+1 by at most
+    // the number of concurrently allocating threads.
+    mint_atomic64_t bumpIndex_;
+
+    QwFreshNodeOrder freshOrder_; // maps bumpIndex_ values to node indices
+
+    int8_t padding4_[QW_FALSE_SHARING_SIZE]; // avoid false sharing
+
+    // Elimination array. A push that fails to CAS the freelist top offers its node in
+    // a slot and waits briefly. A pop that fails to CAS the freelist top tries to take
+    // a node from a slot. Slots hold abapointers: NULL_NODE_INDEX means the slot is empty.
+    // The count prevents ABA when a pusher withdraws an offer.
+    //
+    // The backoff adapts to contention. Each thread keeps an estimate of the contention
+    // that it has observed (eliminationContention_), which persists between operations:
+    // failed CASes on the freelist top and collisions in the array raise it, operations
+    // that succeed at the first attempt and offers that no popper takes lower it. The higher
+    // the estimate, the more slots an operation spreads over and the longer a pusher waits.
+    enum { ELIMINATION_SLOT_COUNT=8, ELIMINATION_SPIN_COUNT=16, MAX_ELIMINATION_SPIN_SHIFT=4,
+           CONTENTION_PER_SLOT=4, MAX_CONTENTION=ELIMINATION_SLOT_COUNT*CONTENTION_PER_SLOT };
+
+    struct EliminationSlot {
+        mint_atomic64_t offer;
+        int8_t padding[QW_FALSE_SHARING_SIZE - sizeof(mint_atomic64_t)]; // one slot per false sharing granule
+    };
+
+    EliminationSlot eliminationSlots_[ELIMINATION_SLOT_COUNT];
+
+    // Eventcount for allocate_wait(). A waiter registers in waiterCount_, re-checks the
+    // pool and then sleeps on wakeEpoch_. Pushes onto the freelist or the depot only
+    // advance wakeEpoch_ and wake waiters (a system call) when waiterCount_ is non-zero.
+    // See notify_waiters()
+    mint_atomic32_t waiterCount_;
+    mint_atomic32_t wakeEpoch_;
+
+    int8_t padding5_[QW_FALSE_SHARING_SIZE]; // avoid false sharing
 
     // Node representation. Since this is a freelist, there is no node content.
     // When stored on the stack, each node contains a next index at the start:
@@ -108,6 +263,28 @@ class QwRawNodePool {
     //  Node {
     //     nodeindex_t next;
     //  }
+    //
+    // Nodes that are cached in a magazine (see QwNodePoolMagazineCache.h) are chained
+    // through the same next link. The first node of a magazine that is stored in the depot
+    // additionally holds the depot link and the number of nodes in the magazine:
+    //
+    //  MagazineHeadNode {
+    //     nodeindex_t next;            // next node in this magazine
+    //     nodeindex_t nextMagazine;    // next magazine in the depot
+    //     nodeindex_t magazineCount;   // number of nodes in this magazine
+    //  }
+
+    enum { NEXT_LINK_WORD=0, DEPOT_LINK_WORD=1, MAGAZINE_COUNT_WORD=2, MIN_NODE_WORDS=3 };
+
+    nodeindex_t& node_word_lvalue(void *node, int word) const
+    {
+        return static_cast<nodeindex_t*>(node)[word];
+    }
+
+    nodeindex_t node_word(void *node, int word) const
+    {
+        return static_cast<nodeindex_t*>(node)[word];
+    }
 
     // node->next = x; --> node_next_lvalue(node) = x
     nodeindex_t& node_next_lvalue(void *node) const 
@@ -124,14 +301,16 @@ class QwRawNodePool {
     // convert a node pointer to an array index
     nodeindex_t index_of_node(void *node)
     {
-        ptrdiff_t i = (static_cast<int8_t*>(node) - nodeArrayBase_) >> nodeBitShift_;
-        return static_cast<nodeindex_t>(i);
+        // The byte offset is an exact multiple of nodeSize_, so we can divide by shifting out
+        // the power-of-two factor and multiplying by the inverse of the odd factor.
+        size_t offset = static_cast<size_t>(static_cast<int8_t*>(node) - nodeArrayBase_);
+        return static_cast<nodeindex_t>((offset >> nodeSizeShift_) * nodeSizeOddInverse_);
     }
 
     // convert array index to a pointer
     void *node_at_index(nodeindex_t index)
     {
-        int8_t *p = nodeArrayBase_ + (static_cast<ptrdiff_t>(index) << nodeBitShift_);
+        int8_t *p = nodeArrayBase_ + static_cast<ptrdiff_t>(index * nodeSize_);
         return p;
     }
 
@@ -149,87 +328,551 @@ class QwRawNodePool {
     void stack_init()
     {
         top_._nonatomic = make_abapointer(NULL_NODE_INDEX, 0);
+        depotTop_._nonatomic = make_abapointer(NULL_NODE_INDEX, 0);
+        releasedBlockTop_._nonatomic = make_abapointer(NULL_NODE_INDEX, 0);
     }
 
-    // thread unsafe non-atomic version for construction time
-    void stack_push_nonatomic( void *node )
+    // Wake threads that are blocked in allocate_wait(), if there are any. Called after
+    // every push. The full fence orders our push before the load of waiterCount_, and pairs
+    // with the fence in allocate_wait() that orders the waiter's registration before its
+    // final allocation attempt: either the waiter sees our node or we see the waiter.
+    // (On x86 the fence is free, so the common case costs one relaxed load.)
+    //
+    // A push of a single node wakes one waiter: waking more would only have them race for
+    // the node and go back to sleep. Pushes of chains and magazines wake all waiters.
+    void notify_waiters( bool wakeAll )
     {
-        assert( node != 0 );
-        nodeindex_t nodeIndex = index_of_node(node);
-        node_next_lvalue(node) = ap_index(top_._nonatomic); // Link new node to head of list (node.next <- top.ptr)
-        top_._nonatomic = make_abapointer(nodeIndex,0); // Set top to new node. no need for ABA counter during thread-unsafe code
+        qw_mint_thread_fence_seq_cst_after_rmw();
+        if (mint_load_32_relaxed(&waiterCount_) != 0) {
+            mint_fetch_add_32_relaxed(&wakeEpoch_, 1);
+            if (wakeAll)
+                qw_futex_wake_all(&wakeEpoch_);
+            else
+                qw_futex_wake_one(&wakeEpoch_);
+        }
     }
 
-    void stack_push( void *node )
+    // The stack operations are parameterised by the stack top and the node word
+    // used as the link, so that they can be used for both the freelist (top_, NEXT_LINK_WORD)
+    // and the magazine depot (depotTop_, DEPOT_LINK_WORD).
+    //
+    // They don't use QwPackedIndexFreelist (qw_freelist.h): it links nodes through their
+    // first word only, and its loops have no hook for what we do after a failed CAS (try
+    // the elimination array, count retries for the statistics) or after a push (wake
+    // allocate_wait() waiters). Adding those hooks would slow down the other pools.
+
+    void stack_push( mint_atomic64_t *stackTop, int linkWord, void *node )
     {
         assert( node != 0 );
         nodeindex_t nodeIndex = index_of_node(node);
 
         abapointer_t top;
-        do {                                        // Keep trying until push is done
-            top = mint_load_64_relaxed(&top_);      // Read top.ptr and top.count together
-            node_next_lvalue(node) = ap_index(top); // Link new node to head of list (node.next <- top.ptr)
+        int attempts = 0;
+        for (;;) {                                  // Keep trying until push is done
+            ++attempts;
+            top = mint_load_64_relaxed(stackTop);   // Read top.ptr and top.count together
+            node_word_lvalue(node, linkWord) = ap_index(top); // Link new node to head of list (node.next <- top.ptr)
             mint_thread_fence_release();            // (Ensure node.next is visible to consumers)
             // Try to swing top to the new node:
-        } while (mint_compare_exchange_strong_64_relaxed(&top_, top, make_abapointer(nodeIndex,ap_count(top)+countIncrement_))!=top);
+            if (mint_compare_exchange_strong_64_relaxed(stackTop, top, make_abapointer(nodeIndex,ap_count(top)+countIncrement_))==top)
+                break;
+
+            // Contended. Try to hand the node directly to a popper
+            if (stackTop == &top_) {
+                raise_contention();
+                if (eliminate_push(nodeIndex)) {
+                    QW_NODE_POOL_COUNT( statistics_, ELIMINATIONS, 1 );
+                    break;
+                }
+            }
+        }
+
+        if (attempts == 1 && stackTop == &top_)
+            lower_contention();
+        QW_NODE_POOL_COUNT( statistics_, PUSH_RETRIES, attempts-1 );
+        notify_waiters(stackTop != &top_); // (a node pushed onto the depot is the head of a magazine)
+    }
+
+    // push a chain of nodes linked by NEXT_LINK_WORD from front through to back
+    void stack_push_chain( mint_atomic64_t *stackTop, void *front, void *back )
+    {
+        assert( front != 0 );
+        assert( back != 0 );
+        nodeindex_t frontIndex = index_of_node(front);
+
+        abapointer_t top;
+        int attempts = 0;
+        do {
+            ++attempts;
+            top = mint_load_64_relaxed(stackTop);
+            node_next_lvalue(back) = ap_index(top); // Link back of chain to head of list
+            mint_thread_fence_release();
+        } while (mint_compare_exchange_strong_64_relaxed(stackTop, top, make_abapointer(frontIndex,ap_count(top)+countIncrement_))!=top);
+
+        QW_NODE_POOL_COUNT( statistics_, PUSH_RETRIES, attempts-1 );
+        notify_waiters(true);
     }
 
-    void *stack_pop()
+    void *stack_pop( mint_atomic64_t *stackTop, int linkWord )
     {
         abapointer_t top;
         void *node;
-        do {                                        // Keep trying until pop is done
-            top = mint_load_64_relaxed(&top_);      // Read top
+        int attempts = 0;
+        for (;;) {                                  // Keep trying until pop is done
+            ++attempts;
+            top = mint_load_64_relaxed(stackTop);   // Read top
             mint_thread_fence_acquire();            // (Acquire top.next)
             nodeindex_t nodeIndex = ap_index(top);
-            if (nodeIndex==NULL_NODE_INDEX)         // Is the stack empty?
+            if (nodeIndex==NULL_NODE_INDEX) {       // Is the stack empty?
+                QW_NODE_POOL_COUNT( statistics_, POP_RETRIES, attempts-1 );
                 return 0;                           // The stack was empty, couldn't pop
+            }
             // Try to swing top to the next node:
             node = node_at_index(nodeIndex);
-        } while (mint_compare_exchange_strong_64_relaxed(&top_, top, make_abapointer(node_next(node),ap_count(top)+countIncrement_))!=top);
-        
+            if (mint_compare_exchange_strong_64_relaxed(stackTop, top, make_abapointer(node_word(node, linkWord),ap_count(top)+countIncrement_))==top)
+                break;
+
+            // Contended. Try to take a node directly from a pusher
+            if (stackTop == &top_) {
+                raise_contention();
+                node = eliminate_pop();
+                if (node) {
+                    QW_NODE_POOL_COUNT( statistics_, ELIMINATIONS, 1 );
+                    break;
+                }
+            }
+        }
+
+        if (attempts == 1 && stackTop == &top_)
+            lower_contention();
+        QW_NODE_POOL_COUNT( statistics_, POP_RETRIES, attempts-1 );
         return node;
     }
 
+    // pop up to maxCount nodes with a single successful CAS. returns the front of the
+    // chain, which remains linked by index. count receives the number of nodes popped.
+    void *stack_pop_chain( mint_atomic64_t *stackTop, size_t maxCount, size_t& count )
+    {
+        abapointer_t top;
+        void *front;
+        nodeindex_t nextIndex;
+        int attempts = 0;
+        do {
+            ++attempts;
+            top = mint_load_64_relaxed(stackTop);
+            mint_thread_fence_acquire();
+            nodeindex_t frontIndex = ap_index(top);
+            if (frontIndex==NULL_NODE_INDEX) {
+                QW_NODE_POOL_COUNT( statistics_, POP_RETRIES, attempts-1 );
+                return 0;
+            }
+            front = node_at_index(frontIndex);
+
+            // Walk the chain to find the new top. If another thread pops any of these nodes
+            // while we walk, we may read garbage links, but then our CAS will fail because
+            // top's count has changed. The range check avoids dereferencing garbage indices.
+            void *back = front;
+            count = 1;
+            nextIndex = node_next(back);
+            while (count < maxCount && nextIndex != NULL_NODE_INDEX && nextIndex <= maxNodeIndex_) {
+                back = node_at_index(nextIndex);
+                nextIndex = node_next(back);
+                ++count;
+            }
+        } while (mint_compare_exchange_strong_64_relaxed(stackTop, top, make_abapointer(nextIndex,ap_count(top)+countIncrement_))!=top);
+
+        QW_NODE_POOL_COUNT( statistics_, POP_RETRIES, attempts-1 );
+        return front;
+    }
+
+    // Elimination. See eliminationSlots_
+
+    // per-thread random number state, used to pick slots
+    static QW_THREAD_LOCAL uint32_t eliminationRandom_;
+
+    // per-thread contention estimate, in [0, MAX_CONTENTION]. shared by all pools that the thread uses
+    static QW_THREAD_LOCAL uint32_t eliminationContention_;
+
+    static void raise_contention()
+    {
+        if (eliminationContention_ < MAX_CONTENTION)
+            ++eliminationContention_;
+    }
+
+    static void lower_contention()
+    {
+        if (eliminationContention_ != 0) // (only a load when there is no contention)
+            --eliminationContention_;
+    }
+
+    EliminationSlot& random_elimination_slot()
+    {
+        uint32_t x = eliminationRandom_;
+        if (x == 0) // seed from the address of a stack variable, which differs between threads
+            x = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&x) >> 4) | 1;
+        x ^= x << 13; // xorshift32
+        x ^= x >> 17;
+        x ^= x << 5;
+        eliminationRandom_ = x;
+
+        // spread over 1 slot, plus one for every CONTENTION_PER_SLOT of contention
+        uint32_t width = 1 + eliminationContention_ / CONTENTION_PER_SLOT;
+        if (width > ELIMINATION_SLOT_COUNT)
+            width = ELIMINATION_SLOT_COUNT;
+        return eliminationSlots_[x % width];
+    }
+
+    // offer node to a popper. returns true if a popper took it
+    bool eliminate_push( nodeindex_t nodeIndex )
+    {
+        mint_atomic64_t *slot = &random_elimination_slot().offer;
+        abapointer_t empty = mint_load_64_relaxed(slot);
+        if (ap_index(empty) != NULL_NODE_INDEX) { // slot is occupied by another pusher
+            raise_contention();
+            return false;
+        }
+
+        abapointer_t offer = make_abapointer(nodeIndex, ap_count(empty)+countIncrement_);
+        mint_thread_fence_release(); // (Ensure node contents are visible to the popper)
+        if (mint_compare_exchange_strong_64_relaxed(slot, empty, offer) != empty) {
+            raise_contention();
+            return false;
+        }
+
+        uint32_t spinShift = std::min<uint32_t>(eliminationContention_ / CONTENTION_PER_SLOT, MAX_ELIMINATION_SPIN_SHIFT);
+        int spinCount = ELIMINATION_SPIN_COUNT << spinShift;
+        for (int i=0; i < spinCount; ++i) {
+            if (mint_load_64_relaxed(slot) != offer) // a popper took the node
+                return true;
+        }
+
+        // timed out. withdraw the offer. if that fails, a popper took the node.
+        if (mint_compare_exchange_strong_64_relaxed(slot, offer, make_abapointer(NULL_NODE_INDEX, ap_count(offer)+countIncrement_)) != offer)
+            return true;
+
+        lower_contention(); // (no popper came: poppers are more likely to meet us in fewer slots)
+        return false;
+    }
+
+    // take a node offered by a pusher. returns 0 if no node was available
+    void *eliminate_pop()
+    {
+        mint_atomic64_t *slot = &random_elimination_slot().offer;
+        abapointer_t offer = mint_load_64_relaxed(slot);
+        nodeindex_t nodeIndex = ap_index(offer);
+        if (nodeIndex == NULL_NODE_INDEX)
+            return 0;
+
+        if (mint_compare_exchange_strong_64_relaxed(slot, offer, make_abapointer(NULL_NODE_INDEX, ap_count(offer)+countIncrement_)) != offer) {
+            raise_contention(); // another popper took the node
+            return 0;
+        }
+
+        mint_thread_fence_acquire(); // (Acquire node contents)
+        return node_at_index(nodeIndex);
+    }
+
+    // Magazine depot operations. Used by QwRawNodePoolMagazineCache.
+    // A magazine is a chain of count nodes linked by their next links.
+
+    void depot_push_magazine( nodeindex_t headIndex, size_t count )
+    {
+        void *head = node_at_index(headIndex);
+        node_word_lvalue(head, MAGAZINE_COUNT_WORD) = static_cast<nodeindex_t>(count);
+        stack_push(&depotTop_, DEPOT_LINK_WORD, head);
+
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+        // magazines in the depot are counted as free
+        mint_fetch_add_32_relaxed(&allocCount_,-static_cast<int32_t>(count));
+#endif
+        QW_NODE_POOL_COUNT( statistics_, DEALLOCATIONS, count );
+    }
+
+    // pop a magazine without allocation counting. returns NULL_NODE_INDEX if the depot is empty
+    nodeindex_t depot_pop( size_t& count )
+    {
+        void *head = stack_pop(&depotTop_, DEPOT_LINK_WORD);
+        if (!head)
+            return NULL_NODE_INDEX;
+
+        count = static_cast<size_t>(node_word(head, MAGAZINE_COUNT_WORD));
+        return index_of_node(head);
+    }
+
+    // returns NULL_NODE_INDEX if the depot is empty
+    nodeindex_t depot_pop_magazine( size_t& count )
+    {
+        nodeindex_t result = depot_pop(count);
+        if (result==NULL_NODE_INDEX)
+            return NULL_NODE_INDEX;
+
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+        mint_fetch_add_32_relaxed(&allocCount_,static_cast<int32_t>(count));
+#endif
+        QW_NODE_POOL_COUNT( statistics_, ALLOCATIONS, count );
+        return result;
+    }
+
+    // Allocate up to maxCount nodes as a magazine (a chain linked by index). Detaches them
+    // from the freelist with a single CAS. If the freelist is empty, reclaims a released
+    // block, failing that reserves never-allocated nodes with a single atomic add.
+    // Returns NULL_NODE_INDEX if the pool is exhausted.
+    nodeindex_t allocate_magazine( size_t maxCount, size_t& count );
+
+    // Slow path for allocate() when the freelist is empty: take a magazine
+    // from the depot, return its first node and move the rest to the freelist.
+    // If the depot is empty, reclaim a released block (see trim()), failing that
+    // allocate a never-allocated node and set neverAllocated. (Doesn't do allocation counting.)
+    void *allocate_from_depot( bool& neverAllocated );
+
+    // Released block operations. See trim()
+
+    // the index of the block that contains node nodeIndex, or blockCount_ if the node isn't in a block
+    size_t block_of_node_index( nodeindex_t nodeIndex ) const
+    {
+        size_t position = static_cast<size_t>(nodeIndex - 1);
+        if (position < firstBlockNodePosition_)
+            return blockCount_;
+        return std::min((position - firstBlockNodePosition_) / nodesPerBlock_, blockCount_);
+    }
+
+    void released_block_push( size_t block );
+
+    // Pop a released block and push its nodes onto the freelist. This faults the block's
+    // pages back in. Returns false if there are no released blocks.
+    bool reclaim_released_block();
+
+    // Parked node operations. See trimParking_
+
+    // push node onto block's parking slot. returns the number of nodes now parked in the slot
+    size_t park_node( size_t block, void *node );
+
+    // Take the chain parked in block's slot. Returns NULL_NODE_INDEX if the slot is empty.
+    nodeindex_t take_parked_chain( size_t block, size_t& count );
+
+    // Take the chain parked in block's slot and push it onto the freelist.
+    // Returns false if the slot was empty.
+    bool unpark_block( size_t block );
+
+    // If trim() is running, take a parked chain and push it onto the freelist.
+    // Scans the parking slots. Returns false if no nodes are parked.
+    bool reclaim_parked_nodes();
+
+    // Reserve up to maxCount never-allocated nodes by advancing the high-water mark.
+    // Returns the first reserved bump index, or NULL_NODE_INDEX if all nodes have
+    // been allocated at least once. The reserved bump indices are consecutive.
+    // Use fresh_node_index() to convert bump indices to node indices.
+    nodeindex_t bump_allocate( size_t maxCount, size_t& count )
+    {
+        // poll first, so that bumpIndex_ doesn't keep growing once the pool is exhausted
+        if (mint_load_64_relaxed(&bumpIndex_) > maxNodeIndex_)
+            return NULL_NODE_INDEX;
+
+        // (no fence required: nodes above the high-water mark contain no data)
+        uint64_t index = mint_fetch_add_64_relaxed(&bumpIndex_, static_cast<int64_t>(maxCount));
+        if (index > maxNodeIndex_)
+            return NULL_NODE_INDEX;
+
+        count = std::min(maxCount, static_cast<size_t>(maxNodeIndex_ + 1 - index));
+        return static_cast<nodeindex_t>(index);
+    }
+
+    nodeindex_t fresh_node_index( nodeindex_t bumpIndex ) const
+    {
+        return static_cast<nodeindex_t>(freshOrder_.position(bumpIndex - 1) + 1); // (both are 1-based)
+    }
+
+    friend class QwRawNodePoolMagazineCache;
+
+    void init( size_t nodeSize, size_t maxNodes, int8_t *storage, bool ownsStorage, QwFreshNodeOrder::Order freshOrder );
+
 public:
-    QwRawNodePool( size_t nodeSize, size_t maxNodes );
+    // Storage policy flags. By default node storage is allocated from the heap.
+    // If any flag is specified, storage is allocated directly from the operating
+    // system (see qw_vm.h). Flags are applied on a best-effort basis. Use
+    // storage_flags() to determine which flags took effect.
+    enum StorageFlags {
+        HUGE_PAGE_STORAGE = 1,      // back nodes with huge pages to reduce TLB misses
+        PREFAULTED_STORAGE = 2,     // fault in all pages at construction
+        LOCKED_STORAGE = 4          // lock storage in physical memory (implies PREFAULTED_STORAGE)
+    };
+
+    // freshOrder determines the order in which never-allocated nodes are handed out.
+    // See QwFreshNodeOrder.
+    QwRawNodePool( size_t nodeSize, size_t maxNodes, int storageFlags=0,
+            QwFreshNodeOrder::Order freshOrder=QwFreshNodeOrder::ASCENDING_ADDRESS_ORDER );
+
+    // Construct a pool that uses client-supplied storage. storage must be aligned
+    // to CACHE_LINE_SIZE (ideally to qw_cache_line_size()) and be at least
+    // storage_size(nodeSize, maxNodes) bytes.
+    // The storage is not freed by the pool.
+    QwRawNodePool( size_t nodeSize, size_t maxNodes, void *storage,
+            QwFreshNodeOrder::Order freshOrder=QwFreshNodeOrder::ASCENDING_ADDRESS_ORDER );
+
     ~QwRawNodePool();
 
+    // the actual size of each node, after rounding nodeSize for alignment
+    static size_t node_size( size_t nodeSize );
+
+    // the number of bytes of storage needed for a pool of maxNodes nodes
+    static size_t storage_size( size_t nodeSize, size_t maxNodes );
+
+    int storage_flags() const { return storageFlags_; }
+
+    // Allocate and free node storage according to storageFlags. Used by the pool
+    // constructors and destructor, and by alternative pool implementations.
+    // allocatedSize and appliedStorageFlags receive the values that must be passed to free_storage().
+    static void *allocate_storage( size_t storageSize, int storageFlags, size_t& allocatedSize, int& appliedStorageFlags );
+    static void free_storage( void *storage, size_t allocatedSize, int appliedStorageFlags );
+
+#ifdef QW_NODE_POOL_STATISTICS
+    // Read the statistics counters. Can be called concurrently with allocation
+    // and deallocation. See QwNodePoolStatistics.h
+    QwNodePoolStatistics statistics_snapshot() const;
+#endif
+
+    // the number of distinct nodes that have ever been allocated
+    size_t high_water_mark() const
+    {
+        uint64_t bumpIndex = mint_load_64_relaxed(const_cast<mint_atomic64_t*>(&bumpIndex_));
+        return static_cast<size_t>(std::min(bumpIndex - 1, static_cast<uint64_t>(maxNodeIndex_)));
+    }
+
+    // the k-th node to be allocated for the first time, for k < high_water_mark()
+    void *fresh_node( size_t k )
+    {
+        assert( k < high_water_mark() );
+        return node_at_index(fresh_node_index(static_cast<nodeindex_t>(k + 1)));
+    }
+
     void *allocate()
     {
-        void *result = stack_pop();
+        bool neverAllocated;
+        return allocate(neverAllocated);
+    }
 
+    // neverAllocated is set to true if the node is being allocated for the first time
+    void *allocate( bool& neverAllocated )
+    {
+        neverAllocated = false;
+        void *result = stack_pop(&top_, NEXT_LINK_WORD);
+        if (!result)
+            result = allocate_from_depot(neverAllocated);
+
+        if (result) {
 #ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
-        if (result)
             mint_fetch_add_32_relaxed(&allocCount_,1);
 #endif
+            QW_NODE_POOL_COUNT( statistics_, ALLOCATIONS, 1 );
+        } else {
+            QW_NODE_POOL_COUNT( statistics_, ALLOCATION_FAILURES, 1 );
+        }
+
         return result;
     }
     
+    // Allocate a node, blocking until one is deallocated if the pool is exhausted.
+    // Waits for at most timeoutMs milliseconds, or without limit if timeoutMs is
+    // QW_FUTEX_WAIT_FOREVER. Returns 0 on timeout.
+    // Only nodes that reach the pool (its freelist, depot or released blocks) wake a waiter.
+    // Nodes held by a QwNodePoolMagazineCache or a QwPerCpuNodePoolCache count as allocated:
+    // allocate_wait() can sleep while such caches hold free nodes, until they give nodes back.
+    // Makes system calls: must not be called from real-time threads.
+    void *allocate_wait( int timeoutMs=QW_FUTEX_WAIT_FOREVER );
+
+    // Deallocation wakes threads that are blocked in allocate_wait(). When there are no
+    // waiters this costs a relaxed load (see notify_waiters()), no system call is made.
     void deallocate( void *node )
     {
 #ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
         mint_fetch_add_32_relaxed(&allocCount_,-1);
 #endif
-        stack_push(node);
+        QW_NODE_POOL_COUNT( statistics_, DEALLOCATIONS, 1 );
+        stack_push(&top_, NEXT_LINK_WORD, node);
     }
+
+    // Batch operations. Chains of nodes are linked through the first word of each
+    // node (see chain_next()), the last node of a chain has a 0 link.
+
+    static void*& chain_next( void *node ) { return *static_cast<void**>(node); }
+
+    // Allocate up to maxCount nodes, detaching them from the freelist with a single CAS.
+    // If the freelist holds fewer than maxCount nodes, the chain is topped up with
+    // never-allocated nodes. Returns the front of the chain, or 0 if the pool is empty.
+    // count receives the number of nodes allocated.
+    void *allocate_chain( size_t maxCount, size_t& count );
+
+    // Deallocate a chain of nodes linked from front through to back with a single CAS.
+    void deallocate_chain( void *front, void *back );
+
+    // Return the pages of fully free runs of nodes to the operating system, to reduce the
+    // resident size of the pool after a burst of allocations. Returns the number of bytes released.
+    //
+    // Released nodes remain available for allocation. Allocation prefers resident nodes:
+    // first the freelist and the depot, then released nodes (which are faulted back in a
+    // run at a time), then never-allocated nodes.
+    //
+    // trim() is O(n) in the number of free nodes, and is intended to be called periodically
+    // from a housekeeping thread. It may run concurrently with allocate() and deallocate(), but
+    // not with itself. It detaches the freelist one block-sized run at a time, and parks the
+    // detached nodes where concurrent allocations can take them back. A block is only
+    // released if all of its nodes are parked at once.
+    // Nodes that are cached in magazines are not released. Does nothing for LOCKED_STORAGE pools.
+    size_t trim();
 };
 
 
 template<typename NodeT>
+class QwNodePoolMagazineCache;
+
+template<typename NodeT>
+class QwPerCpuNodePoolCache;
+
+// QwNodePool is a typed wrapper around a raw pool. RawNodePoolT may be QwRawNodePool
+// or QwRawDwcasNodePool (see QwDwcasNodePool.h), which provide identical interfaces.
+// QwNodePoolMagazineCache and QwPerCpuNodePoolCache require QwRawNodePool.
+
+template<typename NodeT, typename RawNodePoolT=QwRawNodePool>
 class QwNodePool{
-    QwRawNodePool rawPool_;
+    RawNodePoolT rawPool_;
+
+    friend class QwNodePoolMagazineCache<NodeT>;
+    friend class QwPerCpuNodePoolCache<NodeT>;
 public:
 
     typedef NodeT node_type;
 
-    QwNodePool( size_t maxNodes )
-        : rawPool_( sizeof(NodeT), maxNodes )
+    QwNodePool( size_t maxNodes, int storageFlags=0,
+            QwFreshNodeOrder::Order freshOrder=QwFreshNodeOrder::ASCENDING_ADDRESS_ORDER )
+        : rawPool_( sizeof(NodeT), maxNodes, storageFlags, freshOrder )
     {}
 
+    int storage_flags() const { return rawPool_.storage_flags(); }
+
+    size_t high_water_mark() const { return rawPool_.high_water_mark(); }
+
+    // see QwRawNodePool::trim(). (not provided by QwRawDwcasNodePool)
+    size_t trim() { return rawPool_.trim(); }
+
+#ifdef QW_NODE_POOL_STATISTICS
+    QwNodePoolStatistics statistics_snapshot() const { return rawPool_.statistics_snapshot(); }
+#endif
+
+    // returns 0 if the pool is exhausted
     node_type *allocate()
     {
-        return new (rawPool_.allocate()) node_type();
+        void *p = rawPool_.allocate();
+        return (p) ? new (p) node_type() : 0;
+    }
+
+    // same as allocate(). the name makes the failure case explicit at the call site
+    node_type *try_allocate() { return allocate(); }
+
+    // see QwRawNodePool::allocate_wait(). (not provided by QwRawDwcasNodePool)
+    node_type *allocate_wait( int timeoutMs=QW_FUTEX_WAIT_FOREVER )
+    {
+        void *p = rawPool_.allocate_wait(timeoutMs);
+        return (p) ? new (p) node_type() : 0;
     }
 
     void deallocate( node_type *p )
@@ -237,6 +880,43 @@ public:
         p->~node_type();
         rawPool_.deallocate(p);
     }
+
+    // Allocate up to n nodes using a single CAS on the freelist. Nodes are
+    // constructed and pushed on to the front of result (a QwSList or QwSTailList).
+    // Returns the number of nodes allocated.
+    template<typename ListT>
+    size_t allocate_n( size_t n, ListT& result )
+    {
+        size_t count = 0;
+        void *p = rawPool_.allocate_chain(n, count);
+        while (p) {
+            void *next = RawNodePoolT::chain_next(p);
+            result.push_front( new (p) node_type() );
+            p = next;
+        }
+        return count;
+    }
+
+    // Deallocate all nodes in list using a single CAS on the freelist. list is left empty.
+    template<typename ListT>
+    void deallocate_all( ListT& list )
+    {
+        if (list.empty())
+            return;
+
+        node_type *back = list.pop_front();
+        back->~node_type();
+        void *front = back;
+
+        while (!list.empty()) {
+            node_type *n = list.pop_front();
+            n->~node_type();
+            RawNodePoolT::chain_next(n) = front;
+            front = n;
+        }
+
+        rawPool_.deallocate_chain(front, back);
+    }
 };
 
 #endif /* INCLUDED_QWNODEPOOL_H */
@@ -0,0 +1,217 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWNODEPOOLMAGAZINECACHE_H
+#define INCLUDED_QWNODEPOOLMAGAZINECACHE_H
+
+#include <algorithm>
+#include <cassert>
+
+#include "QwConfig.h"
+#include "QwNodePool.h"
+
+/*
+    QwNodePoolMagazineCache is a single-threaded cache that sits in front
+    of a QwNodePool. Each thread that allocates and frees nodes at a high
+    rate owns its own cache. Most allocate() and deallocate() calls only
+    touch the cache, the shared pool is accessed once per magazine exchange.
+
+    The implementation follows the magazine layer described in:
+
+        Jeff Bonwick and Jonathan Adams,
+        "Magazines and Vmem: Extending the Slab Allocator to Many CPUs and Arbitrary Resources,"
+        USENIX Annual Technical Conference, 2001.
+
+    Each cache holds a "loaded" and a "previous" magazine. A magazine is
+    a chain of free nodes linked through the pool's embedded next links,
+    so magazines require no additional storage. Full magazines are
+    exchanged with the pool's depot, which is a second IBM freelist stack
+    of magazines (see QwRawNodePool::depot_push_magazine()).
+
+    The previous magazine is always either full or empty. This guarantees
+    that at least magazineSize allocations or deallocations occur between
+    two depot accesses.
+
+    When the depot is empty, allocate() fills the loaded magazine from the
+    pool's freelist with a single CAS (QwRawNodePool::allocate_magazine()),
+    so a thread that only allocates still touches the freelist once per
+    magazine. deallocate() never touches the freelist.
+
+    Nodes held by a cache count as allocated. In particular they are
+    invisible to QwNodePool::allocate_wait(): a waiter is only woken when
+    a magazine reaches the depot. Call flush() (or destroy the cache)
+    before destroying the pool.
+
+    Usage:
+
+        QwNodePool<Node> pool( maxNodes );
+
+        // in each worker thread:
+        QwNodePoolMagazineCache<Node> cache( pool );
+        Node *n = cache.allocate();
+        ...
+        cache.deallocate(n);
+*/
+
+class QwRawNodePoolMagazineCache {
+    typedef QwRawNodePool::nodeindex_t nodeindex_t;
+
+    QwRawNodePool& pool_;
+    size_t magazineSize_; // number of nodes (rounds) in a full magazine
+
+    struct Magazine {
+        nodeindex_t head;
+        size_t count;
+    };
+
+    Magazine loaded_;
+    Magazine previous_;
+
+    static Magazine empty_magazine()
+    {
+        Magazine result;
+        result.head = QwRawNodePool::NULL_NODE_INDEX;
+        result.count = 0;
+        return result;
+    }
+
+    void *magazine_pop( Magazine& m )
+    {
+        assert( m.count > 0 );
+        void *node = pool_.node_at_index(m.head);
+        m.head = pool_.node_next(node);
+        --m.count;
+        return node;
+    }
+
+    void magazine_push( Magazine& m, void *node )
+    {
+        pool_.node_next_lvalue(node) = m.head;
+        m.head = pool_.index_of_node(node);
+        ++m.count;
+    }
+
+    // not copyable
+    QwRawNodePoolMagazineCache( const QwRawNodePoolMagazineCache& );
+    QwRawNodePoolMagazineCache& operator=( const QwRawNodePoolMagazineCache& );
+
+public:
+    enum { DEFAULT_MAGAZINE_SIZE = 32 };
+
+    explicit QwRawNodePoolMagazineCache( QwRawNodePool& pool, size_t magazineSize=DEFAULT_MAGAZINE_SIZE )
+        : pool_( pool )
+        , magazineSize_( magazineSize )
+        , loaded_( empty_magazine() )
+        , previous_( empty_magazine() )
+    {
+        assert( magazineSize_ > 0 );
+    }
+
+    ~QwRawNodePoolMagazineCache()
+    {
+        flush();
+    }
+
+    void *allocate()
+    {
+        if (loaded_.count == 0) {
+            if (previous_.count == magazineSize_) {
+                std::swap(loaded_, previous_);
+            } else {
+                // both magazines are empty. try to get a full magazine from the depot,
+                // failing that fill a magazine from the freelist
+                size_t count = 0;
+                nodeindex_t head = pool_.depot_pop_magazine(count);
+                if (head == QwRawNodePool::NULL_NODE_INDEX)
+                    head = pool_.allocate_magazine(magazineSize_, count);
+                if (head == QwRawNodePool::NULL_NODE_INDEX)
+                    return pool_.allocate(); // the pool is (nearly) exhausted. (a magazine may have reached the depot since we looked)
+
+                loaded_.head = head;
+                loaded_.count = count;
+            }
+        }
+
+        return magazine_pop(loaded_);
+    }
+
+    void deallocate( void *node )
+    {
+        assert( node != 0 );
+
+        if (loaded_.count == magazineSize_) {
+            if (previous_.count == 0) {
+                std::swap(loaded_, previous_);
+            } else {
+                // both magazines are full. return the previous magazine to the depot
+                pool_.depot_push_magazine(previous_.head, previous_.count);
+                previous_ = loaded_;
+                loaded_ = empty_magazine();
+            }
+        }
+
+        magazine_push(loaded_, node);
+    }
+
+    // return all cached nodes to the pool's depot
+    void flush()
+    {
+        if (loaded_.count > 0)
+            pool_.depot_push_magazine(loaded_.head, loaded_.count);
+        if (previous_.count > 0)
+            pool_.depot_push_magazine(previous_.head, previous_.count);
+
+        loaded_ = empty_magazine();
+        previous_ = empty_magazine();
+    }
+};
+
+
+template<typename NodeT>
+class QwNodePoolMagazineCache{
+    QwRawNodePoolMagazineCache rawCache_;
+public:
+
+    typedef NodeT node_type;
+
+    explicit QwNodePoolMagazineCache( QwNodePool<NodeT>& pool, size_t magazineSize=QwRawNodePoolMagazineCache::DEFAULT_MAGAZINE_SIZE )
+        : rawCache_( pool.rawPool_, magazineSize )
+    {}
+
+    node_type *allocate()
+    {
+        void *p = rawCache_.allocate();
+        return (p) ? new (p) node_type() : 0;
+    }
+
+    void deallocate( node_type *p )
+    {
+        p->~node_type();
+        rawCache_.deallocate(p);
+    }
+
+    void flush()
+    {
+        rawCache_.flush();
+    }
+};
+
+#endif /* INCLUDED_QWNODEPOOLMAGAZINECACHE_H */
@@ -0,0 +1,118 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWNODEPOOLSTATISTICS_H
+#define INCLUDED_QWNODEPOOLSTATISTICS_H
+
+#include "mintomic/mintomic.h"
+
+#include "QwConfig.h"
+
+/*
+    Node pool statistics. Enabled by defining QW_NODE_POOL_STATISTICS (see QwConfig.h).
+
+    QW_DEBUG_COUNT_NODE_ALLOCATIONS uses a single atomic counter that all
+    threads contend on. Statistics counters are instead sharded: each thread
+    is assigned one of SHARD_COUNT cache-line-separated shards the first time
+    it touches any pool, and only updates counters in that shard. Snapshots sum
+    the shards without stopping the world. A snapshot taken while other threads
+    are active is not an atomic cut across all counters, but each counter is
+    exact once the pool is quiescent.
+
+    Nodes held in magazine caches (see QwNodePoolMagazineCache.h) are counted
+    as allocated.
+*/
+
+struct QwNodePoolStatistics {
+    uint64_t allocations;           // nodes allocated
+    uint64_t deallocations;         // nodes deallocated
+    uint64_t allocationFailures;    // allocation requests that failed because the pool was empty
+    uint64_t pushRetries;           // failed CAS attempts while pushing onto the freelist or depot
+    uint64_t popRetries;            // failed CAS attempts while popping from the freelist or depot
+    uint64_t eliminations;          // pushes and pops that were satisfied through the elimination array
+
+    size_t occupancy;               // nodes currently allocated (allocations - deallocations)
+    size_t highWaterOccupancy;      // the largest number of distinct nodes that have been allocated
+    size_t capacity;                // maximum number of nodes
+};
+
+
+class QwNodePoolStatisticsShards {
+public:
+    enum Counter { ALLOCATIONS, DEALLOCATIONS, ALLOCATION_FAILURES, PUSH_RETRIES, POP_RETRIES, ELIMINATIONS, COUNTER_COUNT };
+    enum { SHARD_COUNT = 16 };
+
+private:
+    struct Shard {
+        mint_atomic64_t counters[COUNTER_COUNT];
+        int8_t padding[QW_FALSE_SHARING_SIZE]; // avoid false sharing between shards
+    };
+
+    int8_t padding_[QW_FALSE_SHARING_SIZE]; // avoid false sharing
+    Shard shards_[SHARD_COUNT];
+
+    // per-thread shard assignment. 0 means not yet assigned, otherwise shard index + 1
+    static QW_THREAD_LOCAL int threadShard_;
+    static int assign_thread_shard();
+
+    static int thread_shard()
+    {
+        int shard = threadShard_;
+        if (shard == 0)
+            shard = assign_thread_shard();
+        return shard - 1;
+    }
+
+public:
+    void init()
+    {
+        for (int i=0; i < SHARD_COUNT; ++i)
+            for (int j=0; j < COUNTER_COUNT; ++j)
+                shards_[i].counters[j]._nonatomic = 0;
+    }
+
+    void count( Counter counter, uint64_t n )
+    {
+        if (n != 0) {
+            // shards may be shared when there are more threads than shards, so use an atomic add.
+            // in the common case the shard's cache line is not contended.
+            mint_fetch_add_64_relaxed(&shards_[thread_shard()].counters[counter], static_cast<int64_t>(n));
+        }
+    }
+
+    uint64_t sum( Counter counter ) const
+    {
+        uint64_t result = 0;
+        for (int i=0; i < SHARD_COUNT; ++i)
+            result += mint_load_64_relaxed(const_cast<mint_atomic64_t*>(&shards_[i].counters[counter]));
+        return result;
+    }
+};
+
+// QW_NODE_POOL_COUNT(shards, counter, n) adds n to a statistics counter, or does nothing
+// if QW_NODE_POOL_STATISTICS is not defined.
+#ifdef QW_NODE_POOL_STATISTICS
+#define QW_NODE_POOL_COUNT( shards, counter, n ) (shards).count( QwNodePoolStatisticsShards::counter, (n) )
+#else
+#define QW_NODE_POOL_COUNT( shards, counter, n ) ((void)(n))
+#endif
+
+#endif /* INCLUDED_QWNODEPOOLSTATISTICS_H */
@@ -0,0 +1,159 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWNUMANODEPOOL_H
+#define INCLUDED_QWNUMANODEPOOL_H
+
+#include <cassert>
+
+#include "qw_numa.h"
+
+#include "QwConfig.h"
+#include "QwNodePool.h"
+
+/*
+    QwNumaNodePool is a NUMA-aware variant of QwNodePool.
+
+    The pool keeps one QwRawNodePool sub-pool per NUMA memory node. Each
+    sub-pool's storage, including the sub-pool object (and hence its
+    freelist top), is placed on its memory node. allocate() takes nodes
+    from the sub-pool that is local to the calling thread's current CPU,
+    and only steals from remote sub-pools when the local one is empty.
+    deallocate() always returns a node to the sub-pool that owns it.
+
+    On systems with a single NUMA node (or without NUMA support) this
+    degrades to a single QwRawNodePool.
+
+    For testing and benchmarking on single-node machines, multiple NUMA
+    nodes can be simulated by passing simulatedNumaNodeCount > 0. CPUs are
+    then assigned to simulated nodes round-robin, and memory is not bound.
+*/
+
+class QwRawNumaNodePool {
+
+    struct SubPool {
+        QwRawNodePool *pool;        // placement-constructed at the start of region
+        int8_t *region;             // the bound memory region containing the pool and its nodes
+        int regionVmFlags;          // appliedFlags from qw_vm_allocate
+        int8_t *storageBegin;       // node storage. used to determine node ownership
+        int8_t *storageEnd;
+    };
+
+    int numaNodeCount_;
+    size_t regionSize_;
+    SubPool *subPools_;             // numaNodeCount_ entries
+
+    int cpuCount_;
+    int *cpuToNumaNode_;            // cpuCount_ entries
+
+    // not copyable
+    QwRawNumaNodePool( const QwRawNumaNodePool& );
+    QwRawNumaNodePool& operator=( const QwRawNumaNodePool& );
+
+public:
+    QwRawNumaNodePool( size_t nodeSize, size_t maxNodesPerNumaNode, int simulatedNumaNodeCount=0 );
+    ~QwRawNumaNodePool();
+
+    int numa_node_count() const { return numaNodeCount_; }
+
+    // the NUMA node of the CPU that the calling thread is running on
+    int current_numa_node() const
+    {
+        int cpu = qw_current_cpu();
+        return (cpu >= 0 && cpu < cpuCount_) ? cpuToNumaNode_[cpu] : 0;
+    }
+
+    // the NUMA node whose sub-pool owns node
+    int numa_node_of( const void *node ) const
+    {
+        const int8_t *p = static_cast<const int8_t*>(node);
+        for (int i=0; i < numaNodeCount_; ++i) {
+            if (p >= subPools_[i].storageBegin && p < subPools_[i].storageEnd)
+                return i;
+        }
+        assert( false ); // node doesn't belong to this pool
+        return 0;
+    }
+
+    // allocate from the given NUMA node's sub-pool, stealing from other nodes if it is empty
+    void *allocate( int preferredNumaNode )
+    {
+        assert( preferredNumaNode >= 0 && preferredNumaNode < numaNodeCount_ );
+
+        int numaNode = preferredNumaNode;
+        for (int i=0; i < numaNodeCount_; ++i) {
+            if (void *result = subPools_[numaNode].pool->allocate())
+                return result;
+
+            if (++numaNode == numaNodeCount_)
+                numaNode = 0;
+        }
+
+        return 0;
+    }
+
+    void *allocate()
+    {
+        return allocate(current_numa_node());
+    }
+
+    void deallocate( void *node )
+    {
+        subPools_[numa_node_of(node)].pool->deallocate(node);
+    }
+};
+
+
+template<typename NodeT>
+class QwNumaNodePool{
+    QwRawNumaNodePool rawPool_;
+public:
+
+    typedef NodeT node_type;
+
+    QwNumaNodePool( size_t maxNodesPerNumaNode, int simulatedNumaNodeCount=0 )
+        : rawPool_( sizeof(NodeT), maxNodesPerNumaNode, simulatedNumaNodeCount )
+    {}
+
+    int numa_node_count() const { return rawPool_.numa_node_count(); }
+    int current_numa_node() const { return rawPool_.current_numa_node(); }
+    int numa_node_of( const node_type *p ) const { return rawPool_.numa_node_of(p); }
+
+    node_type *allocate()
+    {
+        void *p = rawPool_.allocate();
+        return (p) ? new (p) node_type() : 0;
+    }
+
+    node_type *allocate( int preferredNumaNode )
+    {
+        void *p = rawPool_.allocate(preferredNumaNode);
+        return (p) ? new (p) node_type() : 0;
+    }
+
+    void deallocate( node_type *p )
+    {
+        p->~node_type();
+        rawPool_.deallocate(p);
+    }
+};
+
+#endif /* INCLUDED_QWNUMANODEPOOL_H */
@@ -0,0 +1,134 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWOBJECTCACHENODEPOOL_H
+#define INCLUDED_QWOBJECTCACHENODEPOOL_H
+
+#include <cassert>
+#include <new>
+
+#include "QwConfig.h"
+#include "QwNodePool.h"
+
+/*
+    QwObjectCacheNodePool is a typed node pool that caches constructed
+    objects, in the manner of Bonwick's slab allocator object caches
+    (Jeff Bonwick, "The Slab Allocator: An Object-Caching Kernel Memory
+    Allocator," USENIX Summer 1994).
+
+    QwNodePool<NodeT> constructs a NodeT on every allocate() and destroys
+    it on every deallocate(). QwObjectCacheNodePool<NodeT> instead:
+
+        - constructs each node once, the first time it is allocated.
+
+        - calls ResetPolicyT::reset(node) on deallocate(), which should
+          return the node to its freshly constructed state cheaply (e.g.
+          clear a length field rather than free and reallocate a buffer).
+
+        - destroys all nodes that were ever constructed when the pool is
+          destroyed.
+
+    This is useful for node types that own pre-sized buffers or other
+    state that is expensive to construct.
+
+    The freelist stores its next link in the first word of each free node,
+    so nodes are stored at an offset inside each pool node, where the link
+    doesn't overwrite them.
+
+    The default reset policy does nothing. Example policy:
+
+        struct MessageReset {
+            static void reset( Message *m ) { m->clear(); }
+        };
+
+        QwObjectCacheNodePool<Message, MessageReset> pool( maxNodes );
+*/
+
+template<typename NodeT>
+struct QwObjectCacheNoReset {
+    static void reset( NodeT* ) {}
+};
+
+// QwAlignmentOf<T>::value is the alignment requirement of T
+template<typename T>
+struct QwAlignmentOf {
+    struct S { char c; T t; };
+    enum { value = sizeof(S) - sizeof(T) };
+};
+
+template<typename NodeT, typename ResetPolicyT=QwObjectCacheNoReset<NodeT> >
+class QwObjectCacheNodePool{
+
+    // offset of the object within its pool node: past the freelist link, suitably aligned
+    enum { OBJECT_OFFSET = ((int)sizeof(size_t) > (int)QwAlignmentOf<NodeT>::value) ? (int)sizeof(size_t) : (int)QwAlignmentOf<NodeT>::value };
+
+    QwRawNodePool rawPool_;
+
+    static NodeT *object_of_node( void *node ) { return reinterpret_cast<NodeT*>(static_cast<int8_t*>(node) + OBJECT_OFFSET); }
+    static void *node_of_object( NodeT *p ) { return reinterpret_cast<int8_t*>(p) - OBJECT_OFFSET; }
+
+    // not copyable
+    QwObjectCacheNodePool( const QwObjectCacheNodePool& );
+    QwObjectCacheNodePool& operator=( const QwObjectCacheNodePool& );
+
+public:
+
+    typedef NodeT node_type;
+
+    explicit QwObjectCacheNodePool( size_t maxNodes, int storageFlags=0 )
+        : rawPool_( OBJECT_OFFSET + sizeof(NodeT), maxNodes, storageFlags )
+    {}
+
+    // Destroys every node that has been constructed. All nodes should have been deallocated.
+    ~QwObjectCacheNodePool()
+    {
+        for (size_t i=0, n=rawPool_.high_water_mark(); i < n; ++i)
+            object_of_node(rawPool_.fresh_node(i))->~node_type();
+    }
+
+    int storage_flags() const { return rawPool_.storage_flags(); }
+
+    // the number of nodes that have been constructed
+    size_t high_water_mark() const { return rawPool_.high_water_mark(); }
+
+    // returns 0 if the pool is exhausted
+    node_type *allocate()
+    {
+        bool neverAllocated;
+        void *p = rawPool_.allocate(neverAllocated);
+        if (!p)
+            return 0;
+
+        if (neverAllocated)
+            return new (object_of_node(p)) node_type();
+
+        return object_of_node(p);
+    }
+
+    void deallocate( node_type *p )
+    {
+        assert( p != 0 );
+        ResetPolicyT::reset(p);
+        rawPool_.deallocate(node_of_object(p));
+    }
+};
+
+#endif /* INCLUDED_QWOBJECTCACHENODEPOOL_H */
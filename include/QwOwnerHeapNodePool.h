@@ -0,0 +1,189 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWOWNERHEAPNODEPOOL_H
+#define INCLUDED_QWOWNERHEAPNODEPOOL_H
+
+#include <cassert>
+#include <new>
+
+#include "QwConfig.h"
+#include "QwMpmcPopAllLifoStack.h"
+
+/*
+    QwOwnerHeapNodePool is a fixed-size node pool partitioned into per-thread
+    heaps. It is intended for patterns where nodes are allocated by one thread
+    and freed by another (e.g. request/response messages), where a single
+    shared freelist top would bounce between cores on every free.
+
+    Each heap owns a contiguous slice of node storage, so the owning heap of
+    a node is determined from its address. Each heap has:
+
+        - a local freelist, only accessed by the owner thread (no atomics).
+
+        - a remote-free stack (QwMpmcPopAllLifoStack) that other threads push
+          onto when they deallocate one of the heap's nodes.
+
+    allocate(heap) pops from the local freelist. When the local freelist runs
+    dry, the owner reclaims all remotely freed nodes with a single pop_all().
+    Failing that, the owner takes never-allocated nodes from its slice. A heap
+    never takes nodes from another heap's slice: if a heap is exhausted,
+    allocate() returns 0.
+
+    deallocate(heap, node) pushes node onto the local freelist if heap owns
+    node, otherwise onto the owner's remote-free stack. Threads that don't own
+    a heap pass NO_HEAP.
+
+    This is the same scheme as mimalloc's thread-local free lists and
+    thread-delayed free lists.
+
+    Constraints:
+        - Each heap must only be used as the heap argument by a single thread
+          at a time (its owner).
+*/
+
+class QwRawOwnerHeapNodePool {
+
+    struct RawNode {
+        RawNode *links_[1];
+        enum { NEXT_LINK_INDEX };
+    };
+
+    typedef QwMpmcPopAllLifoStack<RawNode*, RawNode::NEXT_LINK_INDEX> remote_free_stack_t;
+
+    struct Heap {
+        int8_t padding1[QW_FALSE_SHARING_SIZE]; // avoid false sharing
+
+        // owner-only state
+        RawNode *localHead;         // local freelist
+        int8_t *sliceBegin;         // the heap's node storage
+        size_t freshCount;          // number of nodes in the slice that have been allocated at least once
+
+        int8_t padding2[QW_FALSE_SHARING_SIZE]; // avoid false sharing between the owner and remote threads
+
+        // shared state
+        remote_free_stack_t remoteFrees;
+    };
+
+    int8_t *nodeStorage_;
+    size_t storageSize_;            // see QwRawNodePool::allocate_storage
+    int storageFlags_;
+
+    size_t nodeSize_;
+    size_t nodesPerHeap_;
+    size_t sliceSize_;              // nodeSize_ * nodesPerHeap_. heap slices are packed back to back
+
+    int heapCount_;
+    Heap *heaps_;
+
+    static RawNode*& node_next( void *node ) { return static_cast<RawNode*>(node)->links_[RawNode::NEXT_LINK_INDEX]; }
+
+    void *allocate_slow( Heap& h );
+
+    // not copyable
+    QwRawOwnerHeapNodePool( const QwRawOwnerHeapNodePool& );
+    QwRawOwnerHeapNodePool& operator=( const QwRawOwnerHeapNodePool& );
+
+public:
+    enum { NO_HEAP = -1 };
+
+    // storageFlags are QwRawNodePool::StorageFlags
+    QwRawOwnerHeapNodePool( size_t nodeSize, size_t nodesPerHeap, int heapCount, int storageFlags=0 );
+    ~QwRawOwnerHeapNodePool();
+
+    int heap_count() const { return heapCount_; }
+
+    size_t nodes_per_heap() const { return nodesPerHeap_; }
+
+    // the heap that owns node
+    int owner_of( void *node ) const
+    {
+        assert( static_cast<int8_t*>(node) >= nodeStorage_ );
+        int result = static_cast<int>(static_cast<size_t>(static_cast<int8_t*>(node) - nodeStorage_) / sliceSize_);
+        assert( result < heapCount_ );
+        return result;
+    }
+
+    // must only be called by heap's owner thread. returns 0 if the heap is exhausted
+    void *allocate( int heap )
+    {
+        assert( heap >= 0 && heap < heapCount_ );
+        Heap& h = heaps_[heap];
+
+        RawNode *result = h.localHead;
+        if (result) {
+            h.localHead = node_next(result);
+            return result;
+        }
+
+        return allocate_slow(h);
+    }
+
+    // heap is the calling thread's heap, or NO_HEAP
+    void deallocate( int heap, void *node )
+    {
+        assert( node != 0 );
+        int owner = owner_of(node);
+
+        if (owner == heap) {
+            // local free
+            node_next(node) = heaps_[owner].localHead;
+            heaps_[owner].localHead = static_cast<RawNode*>(node);
+        } else {
+            // remote free
+            node_next(node) = 0; // (remote_free_stack_t checks that nodes are unlinked when QW_VALIDATE_NODE_LINKS is defined)
+            heaps_[owner].remoteFrees.push(static_cast<RawNode*>(node));
+        }
+    }
+};
+
+
+template<typename NodeT>
+class QwOwnerHeapNodePool{
+    QwRawOwnerHeapNodePool rawPool_;
+
+public:
+    typedef NodeT node_type;
+
+    enum { NO_HEAP = QwRawOwnerHeapNodePool::NO_HEAP };
+
+    QwOwnerHeapNodePool( size_t nodesPerHeap, int heapCount, int storageFlags=0 )
+        : rawPool_( sizeof(NodeT), nodesPerHeap, heapCount, storageFlags )
+    {}
+
+    int heap_count() const { return rawPool_.heap_count(); }
+    size_t nodes_per_heap() const { return rawPool_.nodes_per_heap(); }
+    int owner_of( node_type *p ) const { return rawPool_.owner_of(p); }
+
+    node_type *allocate( int heap )
+    {
+        void *p = rawPool_.allocate(heap);
+        return (p) ? new (p) node_type() : 0;
+    }
+
+    void deallocate( int heap, node_type *p )
+    {
+        p->~node_type();
+        rawPool_.deallocate(heap, p);
+    }
+};
+
+#endif /* INCLUDED_QWOWNERHEAPNODEPOOL_H */
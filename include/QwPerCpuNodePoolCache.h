@@ -0,0 +1,185 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWPERCPUNODEPOOLCACHE_H
+#define INCLUDED_QWPERCPUNODEPOOLCACHE_H
+
+#include <cassert>
+#include <new>
+
+#include "QwConfig.h"
+#include "QwNodePool.h"
+#include "qw_rseq.h"
+
+/*
+    QwPerCpuNodePoolCache is a thread-safe cache that sits in front of a
+    QwNodePool. Unlike QwNodePoolMagazineCache, which is owned by a single
+    thread, there is one cache per CPU, shared by all threads that run on
+    that CPU. This keeps the number of cached nodes proportional to the
+    number of CPUs rather than the number of threads, which matters when
+    there are many more threads than cores.
+
+    Each CPU's cache is a bounded stack of node pointers. allocate() and
+    deallocate() push and pop the current CPU's stack using restartable
+    sequences (see qw_rseq.h): a handful of ordinary loads and stores, no
+    atomic read-modify-write instructions, and no cache line transfers
+    unless threads migrate between CPUs.
+
+    When the current CPU's stack is empty, allocate() moves a batch of nodes
+    from the pool to the stack with a single CAS (QwRawNodePool::allocate_chain()).
+    When the stack is full, deallocate() moves a batch of nodes back to the pool.
+
+    When rseq is not available (non-Linux platforms, or glibc didn't register
+    rseq for the calling thread), allocate() and deallocate() go directly to
+    the pool's CAS based freelist.
+
+    Nodes held by the per-CPU stacks count as allocated, so allocate() can
+    fail while other CPUs' stacks hold free nodes, and QwNodePool::allocate_wait()
+    only wakes when a batch is moved back to the pool. Call flush() (or
+    destroy the cache) before destroying the pool. flush() must not be
+    called concurrently with allocate() or deallocate().
+
+    Usage:
+
+        QwNodePool<Node> pool( maxNodes );
+        QwPerCpuNodePoolCache<Node> cache( pool ); // shared by all threads
+
+        Node *n = cache.allocate();
+        ...
+        cache.deallocate(n);
+*/
+
+class QwRawPerCpuNodePoolCache {
+
+    // CPU_STACK_CAPACITY is chosen so that a CpuStack occupies exactly 4 cache lines
+    enum { CPU_STACK_CAPACITY = (4*CACHE_LINE_SIZE / sizeof(void*)) - 1 };
+
+    struct CpuStack {
+        intptr_t count;
+        void *nodes[CPU_STACK_CAPACITY];
+    };
+
+    QwRawNodePool& pool_;
+    size_t batchSize_;          // number of nodes moved between a CPU's stack and the pool at a time
+    int cpuCount_;
+    int8_t *cpuStacks_;         // CpuStacks indexed by CPU number, cpuStackStride_ bytes apart
+    size_t cpuStackStride_;     // sizeof(CpuStack) rounded up to the runtime qw_false_sharing_size()
+
+    CpuStack& cpu_stack( int cpu ) { return *reinterpret_cast<CpuStack*>(cpuStacks_ + cpu * cpuStackStride_); }
+
+    // push node onto the current CPU's stack. returns false if the stack is full or rseq is not available
+    bool cpu_stack_push( void *node )
+    {
+        for (;;) {
+            int cpu = qw_rseq_cpu_id();
+            if (cpu < 0 || cpu >= cpuCount_)
+                return false;
+
+            CpuStack& s = cpu_stack(cpu);
+            int result = qw_rseq_percpu_stack_push(cpu, &s.count, s.nodes, CPU_STACK_CAPACITY, node);
+            if (result != QW_RSEQ_ABORTED)
+                return (result == QW_RSEQ_OK);
+        }
+    }
+
+    // pop a node from the current CPU's stack. returns 0 if the stack is empty or rseq is not available
+    void *cpu_stack_pop()
+    {
+        for (;;) {
+            int cpu = qw_rseq_cpu_id();
+            if (cpu < 0 || cpu >= cpuCount_)
+                return 0;
+
+            CpuStack& s = cpu_stack(cpu);
+            void *node;
+            int result = qw_rseq_percpu_stack_pop(cpu, &s.count, s.nodes, node);
+            if (result != QW_RSEQ_ABORTED)
+                return (result == QW_RSEQ_OK) ? node : 0;
+        }
+    }
+
+    void *allocate_slow();
+    void deallocate_slow( void *node );
+
+    // not copyable
+    QwRawPerCpuNodePoolCache( const QwRawPerCpuNodePoolCache& );
+    QwRawPerCpuNodePoolCache& operator=( const QwRawPerCpuNodePoolCache& );
+
+public:
+    enum { DEFAULT_BATCH_SIZE = CPU_STACK_CAPACITY / 2 };
+
+    // batchSize must be in [1, CPU_STACK_CAPACITY]
+    explicit QwRawPerCpuNodePoolCache( QwRawNodePool& pool, size_t batchSize=DEFAULT_BATCH_SIZE );
+    ~QwRawPerCpuNodePoolCache();
+
+    // true if allocate() and deallocate() can use the per-CPU stacks on the calling thread
+    static bool is_per_cpu_available() { return qw_rseq_cpu_id() >= 0; }
+
+    void *allocate()
+    {
+        void *result = cpu_stack_pop();
+        return (result) ? result : allocate_slow();
+    }
+
+    void deallocate( void *node )
+    {
+        assert( node != 0 );
+        if (!cpu_stack_push(node))
+            deallocate_slow(node);
+    }
+
+    // return all cached nodes to the pool. must not be called concurrently with allocate() or deallocate()
+    void flush();
+};
+
+
+template<typename NodeT>
+class QwPerCpuNodePoolCache{
+    QwRawPerCpuNodePoolCache rawCache_;
+public:
+
+    typedef NodeT node_type;
+
+    explicit QwPerCpuNodePoolCache( QwNodePool<NodeT>& pool, size_t batchSize=QwRawPerCpuNodePoolCache::DEFAULT_BATCH_SIZE )
+        : rawCache_( pool.rawPool_, batchSize )
+    {}
+
+    static bool is_per_cpu_available() { return QwRawPerCpuNodePoolCache::is_per_cpu_available(); }
+
+    node_type *allocate()
+    {
+        void *p = rawCache_.allocate();
+        return (p) ? new (p) node_type() : 0;
+    }
+
+    void deallocate( node_type *p )
+    {
+        p->~node_type();
+        rawCache_.deallocate(p);
+    }
+
+    void flush()
+    {
+        rawCache_.flush();
+    }
+};
+
+#endif /* INCLUDED_QWPERCPUNODEPOOLCACHE_H */
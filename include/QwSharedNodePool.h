@@ -0,0 +1,230 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWSHAREDNODEPOOL_H
+#define INCLUDED_QWSHAREDNODEPOOL_H
+
+#include <cassert>
+#include <new>
+
+#include "mintomic/mintomic.h"
+
+#include "QwConfig.h"
+#include "qw_freelist.h"
+
+/*
+    QwSharedNodePool is a lock-free node pool that lives in a named shared
+    memory segment (or a memory-mapped file), so that several processes can
+    allocate and free nodes from the same pool. Combined with a queue of node
+    indices, this allows zero-copy handoff of nodes between processes.
+
+    The segment holds a header followed by the node array. All shared pool
+    state (the freelist top with its ABA count, and the high-water mark)
+    lives in the header. Each process maps the segment at a different
+    address, so node pointers are only meaningful within a process. Pass
+    node indices between processes: node_index() converts a node pointer to
+    its index, node_at_index() converts an index back to a pointer in the
+    calling process.
+
+    The algorithm is the same as QwRawNodePool's: an IBM freelist of
+    (count,index) packed pointers, plus lazy bump allocation of
+    never-allocated nodes. Node links are 64-bit indices, so 32-bit and
+    64-bit processes can share a pool. The elimination array and magazine
+    depot are not provided.
+
+    One process creates the segment (CREATE_SEGMENT). Other processes open
+    it by name. The creator publishes the header last, so a process that
+    opens a segment that is still being initialized sees is_open()==false
+    and should retry. The segment persists until remove_segment() is called,
+    even if all processes exit.
+
+    Constraints:
+        - Nodes must not contain pointers into process-local memory.
+        - Nodes are not reclaimed if a process dies while holding them.
+*/
+
+class QwRawSharedNodePool {
+
+    typedef uint64_t nodeindex_t;
+    typedef QwPackedIndexFreelist<nodeindex_t, QwPackedIndexLayout> freelist_type; // see qw_freelist.h
+
+    enum { NULL_NODE_INDEX=0 };
+
+    enum { SEGMENT_MAGIC = 0x51775350 }; // 'QwSP'
+    enum { SEGMENT_LAYOUT_VERSION = 2 };
+
+    struct SegmentHeader {
+        mint_atomic32_t magic;      // SEGMENT_MAGIC once the creator has initialized the segment
+        uint32_t layoutVersion;
+        uint64_t nodeSize;
+        uint64_t maxNodes;
+        int8_t padding1[QW_FALSE_SHARING_SIZE - 24];
+
+        mint_atomic64_t top;        // freelist top
+        int8_t padding2[QW_FALSE_SHARING_SIZE - 8];
+
+        mint_atomic64_t bumpIndex;  // high-water mark, see QwRawNodePool::bumpIndex_
+        int8_t padding3[QW_FALSE_SHARING_SIZE - 8];
+
+        mint_atomic32_t allocCount; // (only maintained when QW_DEBUG_COUNT_NODE_ALLOCATIONS is defined)
+        int8_t padding4[QW_FALSE_SHARING_SIZE - 4];
+    };
+
+    SegmentHeader *header_;     // start of the mapping. 0 if the pool isn't open
+    size_t segmentSize_;
+
+    int8_t *nodeArrayBase_;     // 1-based, see QwRawNodePool::nodeArrayBase_
+    size_t nodeSize_;
+    nodeindex_t maxNodeIndex_;
+
+    // (count,index) packing of the freelist top. All processes compute the same layout.
+    // When stored on the freelist, each node contains a next index at the start.
+    QwPackedIndexLayout layout_;
+
+    void map_header( void *segment, size_t segmentSize );
+
+    // not copyable
+    QwRawSharedNodePool( const QwRawSharedNodePool& );
+    QwRawSharedNodePool& operator=( const QwRawSharedNodePool& );
+
+public:
+    typedef nodeindex_t node_index_type;
+
+    enum SegmentFlags {
+        CREATE_SEGMENT = 1,     // create and initialize a new segment. fails if the segment exists
+        FILE_SEGMENT = 2        // name is the path of a file, rather than a shared memory object name
+    };
+
+    // Create (CREATE_SEGMENT) or open a pool. When opening, nodeSize and maxNodes
+    // are ignored. Check is_open() to determine whether the pool was mapped.
+    QwRawSharedNodePool( const char *name, int segmentFlags, size_t nodeSize=0, size_t maxNodes=0 );
+
+    // Unmaps the segment. Does not remove it.
+    ~QwRawSharedNodePool();
+
+    // Remove a segment from the system. Processes that have mapped it can continue to use it.
+    static bool remove_segment( const char *name, int segmentFlags );
+
+    // the number of bytes of shared memory needed for a pool of maxNodes nodes
+    static size_t segment_size( size_t nodeSize, size_t maxNodes );
+
+    bool is_open() const { return header_ != 0; }
+
+    size_t node_size() const { return nodeSize_; }
+    size_t max_nodes() const { return static_cast<size_t>(maxNodeIndex_); }
+
+    // Node indices are in [1, max_nodes()] and are the same in all processes.
+    node_index_type node_index( void *node ) const
+    {
+        assert( node != 0 );
+        return static_cast<node_index_type>((static_cast<int8_t*>(node) - nodeArrayBase_) / nodeSize_);
+    }
+
+    void *node_at_index( node_index_type index ) const
+    {
+        assert( index != NULL_NODE_INDEX && index <= maxNodeIndex_ );
+        return nodeArrayBase_ + static_cast<size_t>(index) * nodeSize_;
+    }
+
+    // the number of distinct nodes that have ever been allocated, by any process
+    size_t high_water_mark() const
+    {
+        uint64_t bumpIndex = mint_load_64_relaxed(const_cast<mint_atomic64_t*>(&header_->bumpIndex));
+        return static_cast<size_t>((bumpIndex - 1 < maxNodeIndex_) ? bumpIndex - 1 : maxNodeIndex_);
+    }
+
+    // returns 0 if the pool is exhausted
+    void *allocate()
+    {
+        assert( is_open() );
+
+        void *result = freelist_type::pop(&header_->top, layout_, *this);
+        if (!result) {
+            // the freelist is empty. allocate a never-allocated node
+            if (mint_load_64_relaxed(&header_->bumpIndex) > maxNodeIndex_)
+                return 0;
+            uint64_t index = mint_fetch_add_64_relaxed(&header_->bumpIndex, 1);
+            if (index > maxNodeIndex_)
+                return 0;
+            result = node_at_index(index);
+        }
+
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+        mint_fetch_add_32_relaxed(&header_->allocCount, 1);
+#endif
+        return result;
+    }
+
+    void deallocate( void *node )
+    {
+        assert( is_open() );
+        assert( node != 0 );
+
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+        mint_fetch_add_32_relaxed(&header_->allocCount, -1);
+#endif
+        freelist_type::push_chain(&header_->top, layout_, node_index(node), node);
+    }
+};
+
+
+template<typename NodeT>
+class QwSharedNodePool{
+    QwRawSharedNodePool rawPool_;
+
+public:
+    typedef NodeT node_type;
+    typedef QwRawSharedNodePool::node_index_type node_index_type;
+
+    enum {
+        CREATE_SEGMENT = QwRawSharedNodePool::CREATE_SEGMENT,
+        FILE_SEGMENT = QwRawSharedNodePool::FILE_SEGMENT
+    };
+
+    QwSharedNodePool( const char *name, int segmentFlags, size_t maxNodes=0 )
+        : rawPool_( name, segmentFlags, sizeof(NodeT), maxNodes )
+    {
+        assert( !rawPool_.is_open() || rawPool_.node_size() >= sizeof(NodeT) );
+    }
+
+    static bool remove_segment( const char *name, int segmentFlags ) { return QwRawSharedNodePool::remove_segment(name, segmentFlags); }
+
+    bool is_open() const { return rawPool_.is_open(); }
+    size_t max_nodes() const { return rawPool_.max_nodes(); }
+    size_t high_water_mark() const { return rawPool_.high_water_mark(); }
+
+    node_index_type node_index( node_type *p ) const { return rawPool_.node_index(p); }
+    node_type *node_at_index( node_index_type index ) const { return static_cast<node_type*>(rawPool_.node_at_index(index)); }
+
+    node_type *allocate()
+    {
+        void *p = rawPool_.allocate();
+        return (p) ? new (p) node_type() : 0;
+    }
+
+    void deallocate( node_type *p )
+    {
+        p->~node_type();
+        rawPool_.deallocate(p);
+    }
+};
+
+#endif /* INCLUDED_QWSHAREDNODEPOOL_H */
@@ -0,0 +1,129 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWSIZECLASSPOOL_H
+#define INCLUDED_QWSIZECLASSPOOL_H
+
+#include <cassert>
+
+#include "QwConfig.h"
+#include "QwNodePool.h"
+
+/*
+    QwSizeClassPool is a thread-safe, lock-free allocator for variable-sized
+    memory blocks. It is a set of QwRawNodePool freelists, one per size class.
+
+    Size classes are multiples of the cache line size. There are two classes
+    per power of two: 1, 2, 3, 4, 6, 8, 12, 16, 24, 32 ... cache lines, up to
+    the smallest class that can hold maxAllocationSize bytes.
+
+    allocate(size) picks the smallest class that fits using a table lookup
+    and pops a block from that class's freelist. It returns 0 if size is larger
+    than max_allocation_size(), or if the class is exhausted. (We don't fall back
+    to larger classes: if you need that, size the pool accordingly.)
+
+    All classes are carved out of a single arena, with an equal-sized,
+    power-of-two aligned region for each class. deallocate(p) recovers the
+    size class from the address with a subtract and a shift, so callers don't
+    need to remember allocation sizes.
+
+    Each class receives a region of bytesPerClass bytes, rounded up to a
+    power of two. Smaller classes therefore have more blocks than larger ones.
+    The arena is allocated with qw_vm_allocate. vmFlags (see qw_vm.h) can
+    request huge pages, prefaulting and locking.
+
+    All memory is allocated by the constructor. allocate() and deallocate()
+    make no system calls and are suitable for use in real-time threads.
+*/
+
+class QwSizeClassPool {
+
+    int8_t *arena_;
+    size_t arenaSize_;
+    int arenaVmFlags_;              // qw_vm flags applied to arena_
+
+    int8_t regionBitShift_;         // class region size is (1<<regionBitShift_) bytes
+    size_t classCount_;
+    size_t *classSizes_;            // classCount_ entries
+    QwRawNodePool **classPools_;    // classCount_ entries. class i pool stores nodes in region i of the arena
+
+    size_t maxAllocationSize_;
+    uint8_t *classOfLineCount_;     // maps ceil(size/CACHE_LINE_SIZE) to a class index. (maxAllocationSize_/CACHE_LINE_SIZE)+1 entries
+
+    // not copyable
+    QwSizeClassPool( const QwSizeClassPool& );
+    QwSizeClassPool& operator=( const QwSizeClassPool& );
+
+public:
+    QwSizeClassPool( size_t maxAllocationSize, size_t bytesPerClass, int vmFlags=0 );
+    ~QwSizeClassPool();
+
+    // the size of the largest class. at least the maxAllocationSize passed to the constructor
+    size_t max_allocation_size() const { return maxAllocationSize_; }
+
+    size_t class_count() const { return classCount_; }
+
+    size_t class_size( size_t classIndex ) const
+    {
+        assert( classIndex < classCount_ );
+        return classSizes_[classIndex];
+    }
+
+    // index of the smallest size class that can hold size bytes. size must be in [1, max_allocation_size()]
+    size_t class_index_of_size( size_t size ) const
+    {
+        assert( size > 0 && size <= maxAllocationSize_ );
+        return classOfLineCount_[(size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE];
+    }
+
+    // index of the size class that owns block p
+    size_t class_index_of_block( void *p ) const
+    {
+        assert( static_cast<int8_t*>(p) >= arena_ );
+        size_t result = static_cast<size_t>(static_cast<int8_t*>(p) - arena_) >> regionBitShift_;
+        assert( result < classCount_ );
+        return result;
+    }
+
+    // the usable size of block p. at least as large as the requested size
+    size_t block_size( void *p ) const
+    {
+        return classSizes_[class_index_of_block(p)];
+    }
+
+    void *allocate( size_t size )
+    {
+        if (size == 0)
+            size = 1;
+        if (size > maxAllocationSize_)
+            return 0;
+
+        return classPools_[class_index_of_size(size)]->allocate();
+    }
+
+    void deallocate( void *p )
+    {
+        assert( p != 0 );
+        classPools_[class_index_of_block(p)]->deallocate(p);
+    }
+};
+
+#endif /* INCLUDED_QWSIZECLASSPOOL_H */
@@ -0,0 +1,210 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWSPSCBOUNDEDQUEUE_H
+#define INCLUDED_QWSPSCBOUNDEDQUEUE_H
+
+#include <algorithm>
+#include <cassert>
+
+#include "mintomic/mintomic.h"
+
+#include "QwConfig.h"
+#include "qw_aligned_malloc.h"
+#include "qw_freelist.h"
+
+/*
+    QwSpscBoundedQueue is a wait-free single-producer single-consumer bounded
+    FIFO queue of node pointers.
+
+    Producer operations: try_push(), push_n()
+    Consumer operations: try_pop(), pop_n(), empty()
+
+    There may be only one producer and one consumer.
+
+    All operations may be invoked concurrently. All operations are wait-free
+    and don't allocate, so they are safe to use in a real-time audio callback.
+    The constructor allocates the ring.
+
+    Implemented as a Lamport ring buffer with monotonically increasing read
+    and write indices:
+
+        - The producer and the consumer each write their own index, on
+          separate cache lines.
+
+        - Each side keeps a private copy of the other side's index, and only
+          reloads it when the cached value says that the queue is full (or
+          empty). In steady state, neither side reads the line that the other
+          side writes.
+
+        - push_n() and pop_n() transfer a batch of nodes with a single index
+          store, so the other side sees one cache line transfer per batch.
+
+    Indices are 32-bit and wrap around: capacity is clamped to 2^31.
+*/
+
+template<typename NodePtrT>
+class QwSpscBoundedQueue {
+public:
+    typedef NodePtrT node_ptr_type;
+
+private:
+    int8_t padding1_[QW_FALSE_SHARING_SIZE]; // avoid false sharing
+
+    node_ptr_type *slots_;      // ring of capacity slots
+    uint32_t indexMask_;        // capacity - 1
+
+    int8_t padding2_[QW_FALSE_SHARING_SIZE]; // avoid false sharing
+
+    // producer
+    mint_atomic32_t writeIndex_;    // written by the producer, read by the consumer
+    uint32_t cachedReadIndex_;      // producer's copy of readIndex_
+
+    int8_t padding3_[QW_FALSE_SHARING_SIZE]; // avoid false sharing between the producer and the consumer
+
+    // consumer
+    mint_atomic32_t readIndex_;     // written by the consumer, read by the producer
+    uint32_t cachedWriteIndex_;     // consumer's copy of writeIndex_
+
+    int8_t padding4_[QW_FALSE_SHARING_SIZE]; // avoid false sharing
+
+    // producer: the number of free slots. reloads readIndex_ only if fewer than wanted are known to be free
+    uint32_t free_count( uint32_t writeIndex, uint32_t wanted )
+    {
+        uint32_t result = capacity() - (writeIndex - cachedReadIndex_);
+        if (result < wanted) {
+            cachedReadIndex_ = mint_load_32_relaxed(&readIndex_);
+            mint_thread_fence_acquire(); // (the consumer has finished reading the slots that it released)
+            result = capacity() - (writeIndex - cachedReadIndex_);
+        }
+        return result;
+    }
+
+    // consumer: the number of filled slots. reloads writeIndex_ only if fewer than wanted are known to be filled
+    uint32_t filled_count( uint32_t readIndex, uint32_t wanted )
+    {
+        uint32_t result = cachedWriteIndex_ - readIndex;
+        if (result < wanted) {
+            cachedWriteIndex_ = mint_load_32_relaxed(&writeIndex_);
+            mint_thread_fence_acquire(); // (acquire the nodes and their payloads)
+            result = cachedWriteIndex_ - readIndex;
+        }
+        return result;
+    }
+
+    QwSpscBoundedQueue( const QwSpscBoundedQueue& );
+    QwSpscBoundedQueue& operator=( const QwSpscBoundedQueue& );
+
+public:
+    // capacity is rounded up to a power of two (at least 2), and clamped to 2^31
+    explicit QwSpscBoundedQueue( size_t capacity )
+    {
+        const size_t maxCapacity = static_cast<size_t>(1) << 31;
+        size_t slotCount = std::max<size_t>(2, qw_round_up_to_power_of_two(std::min(capacity, maxCapacity)));
+        indexMask_ = static_cast<uint32_t>(slotCount - 1);
+
+        slots_ = static_cast<node_ptr_type*>(qw_aligned_malloc(sizeof(node_ptr_type) * slotCount, CACHE_LINE_SIZE));
+        assert( slots_ != 0 );
+
+        writeIndex_._nonatomic = 0;
+        cachedReadIndex_ = 0;
+        readIndex_._nonatomic = 0;
+        cachedWriteIndex_ = 0;
+    }
+
+    ~QwSpscBoundedQueue()
+    {
+        qw_aligned_free(slots_);
+    }
+
+    uint32_t capacity() const { return indexMask_ + 1; }
+
+    // returns false if the queue is full
+    bool try_push( node_ptr_type node )
+    {
+        uint32_t writeIndex = mint_load_32_relaxed(&writeIndex_); // (we are the only writer)
+        if (free_count(writeIndex, 1) == 0)
+            return false;
+
+        slots_[writeIndex & indexMask_] = node;
+        mint_thread_fence_release(); // (publish the node and its payload)
+        mint_store_32_relaxed(&writeIndex_, writeIndex + 1);
+        return true;
+    }
+
+    // Push up to count nodes from nodes[0..count-1], in order, and publish them
+    // with a single index store. Returns the number of nodes pushed, which is less
+    // than count if the queue becomes full.
+    size_t push_n( const node_ptr_type *nodes, size_t count )
+    {
+        uint32_t writeIndex = mint_load_32_relaxed(&writeIndex_);
+        uint32_t wanted = static_cast<uint32_t>(std::min(count, static_cast<size_t>(capacity())));
+        uint32_t n = std::min(free_count(writeIndex, wanted), wanted);
+        if (n == 0)
+            return 0;
+
+        for (uint32_t i=0; i < n; ++i)
+            slots_[(writeIndex + i) & indexMask_] = nodes[i];
+
+        mint_thread_fence_release();
+        mint_store_32_relaxed(&writeIndex_, writeIndex + n);
+        return n;
+    }
+
+    // returns 0 if the queue is empty
+    node_ptr_type try_pop()
+    {
+        uint32_t readIndex = mint_load_32_relaxed(&readIndex_); // (we are the only writer)
+        if (filled_count(readIndex, 1) == 0)
+            return 0;
+
+        node_ptr_type result = slots_[readIndex & indexMask_];
+        mint_thread_fence_release(); // (finish reading the slot before the producer can reuse it)
+        mint_store_32_relaxed(&readIndex_, readIndex + 1);
+        return result;
+    }
+
+    // Pop up to maxCount nodes into result[0..], in FIFO order, and release their
+    // slots with a single index store. Returns the number of nodes popped.
+    size_t pop_n( node_ptr_type *result, size_t maxCount )
+    {
+        uint32_t readIndex = mint_load_32_relaxed(&readIndex_);
+        uint32_t wanted = static_cast<uint32_t>(std::min(maxCount, static_cast<size_t>(capacity())));
+        uint32_t n = std::min(filled_count(readIndex, wanted), wanted);
+        if (n == 0)
+            return 0;
+
+        for (uint32_t i=0; i < n; ++i)
+            result[i] = slots_[(readIndex + i) & indexMask_];
+
+        mint_thread_fence_release();
+        mint_store_32_relaxed(&readIndex_, readIndex + n);
+        return n;
+    }
+
+    // consumer: returns true if the queue was empty when it was checked
+    bool empty()
+    {
+        return (filled_count(mint_load_32_relaxed(&readIndex_), 1) == 0);
+    }
+};
+
+#endif /* INCLUDED_QWSPSCBOUNDEDQUEUE_H */
@@ -27,6 +27,7 @@
 #include "mintomic/mintomic.h"
 #include "qw_atomic.h"
 
+#include "QwConfig.h"
 #include "QwSingleLinkNodeInfo.h"
 
 
@@ -56,6 +57,7 @@ public:
 
 private:
     mint_atomicPtr_t atomicLifoTop_; // LIFO. same algorithm as QwMpmcPopAllLifoStack. shared by producer and consumer
+    int8_t padding_[QW_FALSE_SHARING_SIZE]; // keep the consumer's fields out of the producer's way
     node_ptr_type consumerLocalHead_; // LIFO order reader queue. only referenced by the consumer
     size_t expectedResultCount_; // consumer increments this when making a request, pop() decrements it
 
@@ -0,0 +1,191 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWSTATICNODEPOOL_H
+#define INCLUDED_QWSTATICNODEPOOL_H
+
+#include <cassert>
+#include <new>
+
+#include "mintomic/mintomic.h"
+
+#include "QwConfig.h"
+#include "qw_freelist.h"
+
+/*
+    QwStaticNodePool<NodeT, MAX_NODES> is a QwNodePool whose capacity is
+    fixed at compile time and whose node storage is an array inside the
+    pool object. It has no constructor-time allocation, so pools can live
+    in static storage or on the stack.
+
+    The node size, index masks and count increment are compile-time
+    constants. Converting between node pointers and indices is a multiply
+    (or a division by a constant) relative to the pool's own address, so
+    allocate() and deallocate() compile to the minimal IBM freelist
+    sequence: a load, a CAS and a few ALU instructions.
+
+    Like QwRawNodePool, nodes that have never been allocated are handed out
+    by advancing a high-water mark, so construction is O(1) and doesn't
+    touch the node array. Unlike QwRawNodePool, there is no elimination
+    array, magazine depot or statistics.
+
+    Constraints:
+        - The pool is cache-line aligned (see QW_CACHE_LINE_ALIGNED). Don't
+          allocate it with operator new unless the allocation is aligned.
+
+    Usage:
+
+        static QwStaticNodePool<Node, 1024> pool;
+
+        Node *n = pool.allocate(); // 0 if the pool is exhausted
+        ...
+        pool.deallocate(n);
+*/
+
+template<typename NodeT, size_t MAX_NODES>
+class QwStaticNodePool {
+
+    typedef size_t nodeindex_t;
+
+    // (node-index, aba-count) packing with compile-time masks. valid node indices are [1,2^k) where 2^k > MAX_NODES
+    typedef QwStaticPackedIndexLayout<QwStaticPowerOfTwoAbove<MAX_NODES>::value> layout_type;
+    typedef QwPackedIndexFreelist<nodeindex_t, layout_type> freelist_type; // see qw_freelist.h
+    template<typename, typename> friend class QwPackedIndexFreelist;
+
+public:
+    typedef NodeT node_type;
+
+    // nodes are a multiple of the cache line size, and hold at least a next index
+    static const size_t NODE_SIZE = (((sizeof(NodeT) > sizeof(nodeindex_t)) ? sizeof(NodeT) : sizeof(nodeindex_t))
+            + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1);
+
+    static const size_t MAX_NODE_COUNT = MAX_NODES;
+
+private:
+    enum { NULL_NODE_INDEX=0 }; // node indices are 1-based
+
+    QW_CACHE_LINE_ALIGNED int8_t nodeStorage_[MAX_NODES * NODE_SIZE];
+
+    mint_atomic64_t top_; // (node-index, aba-count)
+    int8_t padding1_[QW_FALSE_SHARING_SIZE - sizeof(mint_atomic64_t)]; // avoid false sharing
+
+    mint_atomic64_t bumpCount_; // number of never-allocated nodes handed out. may overshoot MAX_NODES
+    int8_t padding2_[QW_FALSE_SHARING_SIZE - sizeof(mint_atomic64_t)]; // avoid false sharing
+
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+    mint_atomic32_t allocCount_;
+#endif
+
+    void *node_at_index( nodeindex_t index )
+    {
+        return nodeStorage_ + (index - 1) * NODE_SIZE;
+    }
+
+    nodeindex_t index_of_node( void *node )
+    {
+        return static_cast<nodeindex_t>((static_cast<int8_t*>(node) - nodeStorage_) / NODE_SIZE) + 1;
+    }
+
+    void *allocate_raw()
+    {
+        void *node = freelist_type::pop(&top_, layout_type(), *this);
+        return (node) ? node : allocate_fresh();
+    }
+
+    void *allocate_fresh()
+    {
+        // poll first, so that bumpCount_ doesn't keep growing once the pool is exhausted
+        if (mint_load_64_relaxed(&bumpCount_) >= MAX_NODES)
+            return 0;
+
+        uint64_t position = mint_fetch_add_64_relaxed(&bumpCount_, 1);
+        if (position >= MAX_NODES)
+            return 0;
+
+        return nodeStorage_ + static_cast<size_t>(position) * NODE_SIZE;
+    }
+
+    void deallocate_raw( void *node )
+    {
+        freelist_type::push_chain(&top_, layout_type(), index_of_node(node), node);
+    }
+
+    // not copyable
+    QwStaticNodePool( const QwStaticNodePool& );
+    QwStaticNodePool& operator=( const QwStaticNodePool& );
+
+public:
+    QwStaticNodePool()
+    {
+        top_._nonatomic = layout_type().make(NULL_NODE_INDEX, 0);
+        bumpCount_._nonatomic = 0;
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+        allocCount_._nonatomic = 0;
+#endif
+    }
+
+    ~QwStaticNodePool()
+    {
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+        assert( allocCount_._nonatomic == 0 );
+#endif
+    }
+
+    // the number of distinct nodes that have ever been allocated
+    size_t high_water_mark() const
+    {
+        uint64_t bumpCount = mint_load_64_relaxed(const_cast<mint_atomic64_t*>(&bumpCount_));
+        return static_cast<size_t>((bumpCount < MAX_NODES) ? bumpCount : MAX_NODES);
+    }
+
+    // returns 0 if the pool is exhausted
+    node_type *allocate()
+    {
+        void *p = allocate_raw();
+        if (!p)
+            return 0;
+
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+        mint_fetch_add_32_relaxed(&allocCount_, 1);
+#endif
+        return new (p) node_type();
+    }
+
+    void deallocate( node_type *p )
+    {
+        assert( p != 0 );
+        assert( reinterpret_cast<int8_t*>(p) >= nodeStorage_ && reinterpret_cast<int8_t*>(p) < nodeStorage_ + sizeof(nodeStorage_) );
+
+        p->~node_type();
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+        mint_fetch_add_32_relaxed(&allocCount_, -1);
+#endif
+        deallocate_raw(p);
+    }
+};
+
+template<typename NodeT, size_t MAX_NODES>
+const size_t QwStaticNodePool<NodeT, MAX_NODES>::NODE_SIZE;
+
+template<typename NodeT, size_t MAX_NODES>
+const size_t QwStaticNodePool<NodeT, MAX_NODES>::MAX_NODE_COUNT;
+
+#endif /* INCLUDED_QWSTATICNODEPOOL_H */
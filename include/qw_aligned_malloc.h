@@ -0,0 +1,41 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QW_ALIGNED_MALLOC_H
+#define INCLUDED_QW_ALIGNED_MALLOC_H
+
+#include <cstddef>
+
+/*
+    Aligned heap allocation.
+
+    qw_aligned_malloc returns a block of at least size bytes whose address
+    is a multiple of alignment (which must be a power of two), or 0 on failure.
+    Blocks must be freed with qw_aligned_free.
+
+    see also http://cottonvibes.blogspot.com.au/2011/01/dynamically-allocate-aligned-memory.html
+    and http://stackoverflow.com/questions/17378444/stdalign-and-stdaligned-storage-for-aligned-allocation-of-memory-blocks
+*/
+
+void *qw_aligned_malloc( size_t size, size_t alignment );
+void qw_aligned_free( void *memblock );
+
+#endif /* INCLUDED_QW_ALIGNED_MALLOC_H */
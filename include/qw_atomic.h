@@ -31,6 +31,8 @@
         qw_mint_exchange_64_relaxed
         qw_mint_exchange_ptr_relaxed
 
+        qw_mint_compare_exchange_strong_128_relaxed (x64 only, see below)
+
     Mintomic lacks atomic swap. I've posted an issue about this:
         https://github.com/mintomic/mintomic/issues/7
 
@@ -99,6 +101,97 @@ MINT_C_INLINE void* qw_mint_exchange_ptr_relaxed(mint_atomicPtr_t *object, void
 #error MINT_PTR_SIZE not set!
 #endif
 
+
+//--------------------------------------------------------------
+//  Full fence after a read-modify-write operation
+//--------------------------------------------------------------
+//
+// qw_mint_thread_fence_seq_cst_after_rmw is a full (StoreLoad) fence for use
+// immediately after an atomic read-modify-write operation such as a
+// compare-exchange. On x86 and x64, locked instructions are already full
+// barriers, so it is only a compiler barrier.
+// (cf. smp_mb__after_atomic() in the Linux kernel)
+
+#if MINT_CPU_X86 || MINT_CPU_X64
+
+MINT_C_INLINE void qw_mint_thread_fence_seq_cst_after_rmw()
+{
+    mint_signal_fence_seq_cst();
+}
+
+#else
+
+MINT_C_INLINE void qw_mint_thread_fence_seq_cst_after_rmw()
+{
+    mint_thread_fence_seq_cst();
+}
+
+#endif
+
+
+//--------------------------------------------------------------
+//  Double-width (128-bit) compare-and-swap
+//--------------------------------------------------------------
+//
+// QW_HAVE_ATOMIC128 is defined to 1 if qw_mint_atomic128_t and
+// qw_mint_compare_exchange_strong_128_relaxed are available (x64 with cmpxchg16b).
+//
+// qw_mint_compare_exchange_strong_128_relaxed compares the 128-bit value at
+// object with expected[0] (low word) and expected[1] (high word). If they are
+// equal it stores desiredLo and desiredHi and returns 1. Otherwise it returns 0
+// and stores the current value of object in expected.
+//
+// There is no 128-bit atomic load: qw_mint_load_128_relaxed_torn loads each
+// 64-bit half atomically, but the pair may be torn. That's sufficient for
+// algorithms (such as the IBM freelist) that validate the loaded value with a
+// subsequent compare-exchange.
+
+#if MINT_CPU_X64 && (MINT_COMPILER_MSVC || MINT_COMPILER_GCC)
+
+#define QW_HAVE_ATOMIC128 1
+
+#if MINT_COMPILER_MSVC
+typedef struct { __declspec(align(16)) volatile uint64_t _nonatomic[2]; } qw_mint_atomic128_t;
+#else
+typedef struct { volatile uint64_t _nonatomic[2]; } __attribute__((aligned(16))) qw_mint_atomic128_t;
+#endif
+
+MINT_C_INLINE void qw_mint_load_128_relaxed_torn(qw_mint_atomic128_t *object, uint64_t *result)
+{
+    result[0] = object->_nonatomic[0];
+    result[1] = object->_nonatomic[1];
+}
+
+#if MINT_COMPILER_MSVC
+
+MINT_C_INLINE int qw_mint_compare_exchange_strong_128_relaxed(qw_mint_atomic128_t *object, uint64_t *expected, uint64_t desiredLo, uint64_t desiredHi)
+{
+    return _InterlockedCompareExchange128((volatile __int64*)object->_nonatomic, (__int64)desiredHi, (__int64)desiredLo, (__int64*)expected);
+}
+
+#else
+
+MINT_C_INLINE int qw_mint_compare_exchange_strong_128_relaxed(qw_mint_atomic128_t *object, uint64_t *expected, uint64_t desiredLo, uint64_t desiredHi)
+{
+    // Use cmpxchg16b directly, GCC's __sync builtins require -mcx16 for 128-bit operands.
+    char result;
+    __asm__ __volatile__(
+        "lock; cmpxchg16b %1\n\t"
+        "setz %0"
+        : "=q"(result), "+m"(*object), "+a"(expected[0]), "+d"(expected[1])
+        : "b"(desiredLo), "c"(desiredHi)
+        : "cc", "memory");
+    return result;
+}
+
+#endif
+
+#else
+
+#define QW_HAVE_ATOMIC128 0
+
+#endif
+
 #endif /* INCLUDED_QW_ATOMIC_H */
 
 /* -----------------------------------------------------------------------
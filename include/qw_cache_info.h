@@ -0,0 +1,65 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QW_CACHE_INFO_H
+#define INCLUDED_QW_CACHE_INFO_H
+
+#include <cstddef>
+
+/*
+    Cache geometry of the machine that we are running on.
+
+    The geometry is queried on the first call to qw_cache_info(): on Linux
+    from sysconf and /sys/devices/system/cpu/cpu0/cache, on Mac OS X from
+    sysctl, and on Windows from GetLogicalProcessorInformation. On x86 the
+    line size falls back to the CLFLUSH line size reported by cpuid.
+    Unknown cache sizes are reported as 0.
+
+    Data structure layouts are fixed at compile time, so hot fields within
+    a structure are separated by QW_FALSE_SHARING_SIZE bytes of padding
+    (see QwConfig.h). The runtime values are used where layout is chosen at
+    run time: to size and align QwRawNodePool nodes, and to space the
+    per-CPU stacks of QwPerCpuNodePoolCache.
+
+    qw_cache_info() is thread-safe. The first call may make system calls.
+    Don't make it from a real-time thread.
+*/
+
+struct QwCacheInfo {
+    size_t lineSize;            // L1 data cache line size. at least CACHE_LINE_SIZE
+    // The granularity of false sharing. Larger than lineSize when the hardware
+    // prefetches lines in aligned groups: Intel and recent AMD x86 processors fetch
+    // adjacent line pairs into L2, so data that shares a 128-byte aligned
+    // pair of lines ping-pongs between cores as if it shared a line. (Inferred
+    // from the cpuid vendor and family, see qw_cache_info.cpp.)
+    size_t falseSharingSize;
+    size_t l1DataSize;          // per-core L1 data cache size in bytes
+    size_t l2Size;
+    size_t l3Size;
+};
+
+const QwCacheInfo& qw_cache_info();
+
+inline size_t qw_cache_line_size() { return qw_cache_info().lineSize; }
+
+inline size_t qw_false_sharing_size() { return qw_cache_info().falseSharingSize; }
+
+#endif /* INCLUDED_QW_CACHE_INFO_H */
@@ -0,0 +1,237 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QW_FREELIST_H
+#define INCLUDED_QW_FREELIST_H
+
+#include <cstddef>
+
+#include "mintomic/mintomic.h"
+#include "qw_atomic.h"
+
+/*
+    Building blocks shared by the node pool implementations. Not intended
+    for direct use by clients.
+
+    The pools use the "IBM Freelist" lock-free stack algorithm (see
+    ALGORITHMS.txt) with one of two tagged pointer representations:
+
+    QwPackedIndexFreelist: the stack top is a 64-bit word that packs a node
+    index in the low bits and an ABA-prevention count in the high bits. Free
+    nodes hold the index of the next free node in their first word. The
+    packing is described by a QwPackedIndexLayout (masks computed at runtime)
+    or a QwStaticPackedIndexLayout (compile-time constants). Used by
+    QwRawGrowableNodePool, QwRawSharedNodePool and QwStaticNodePool.
+
+    QwDwcasFreelist: the stack top is a (pointer, count) pair that is updated
+    with a 128-bit CAS. Free nodes hold a pointer to the next free node in
+    their first word. Used by QwRawDwcasNodePool. (x64 only)
+
+    QwRawNodePool has its own implementation of the packed-index freelist,
+    extended with elimination, statistics and a magazine depot.
+*/
+
+// The smallest power of two that is greater than or equal to x. T must be an unsigned integer type.
+template<typename T>
+inline T qw_round_up_to_power_of_two( T x )
+{
+    --x;
+    for (size_t shift=1; shift < sizeof(T)*8; shift *= 2)
+        x |= x >> shift;
+    return ++x;
+}
+
+// QwStaticPowerOfTwoAbove<X>::value is the smallest power of two greater than X
+template<size_t X, size_t P=1, bool DONE=(P > X)>
+struct QwStaticPowerOfTwoAbove {
+    static const size_t value = QwStaticPowerOfTwoAbove<X, P*2>::value;
+};
+
+template<size_t X, size_t P>
+struct QwStaticPowerOfTwoAbove<X, P, true> {
+    static const size_t value = P;
+};
+
+
+// (count,index) packing for node indices in [1, maxNodeIndex]. Index 0 is the null index.
+class QwPackedIndexLayout {
+    uint64_t indexMask_;
+    uint64_t countMask_;
+    uint64_t countIncrement_;
+
+public:
+    void init( uint64_t maxNodeIndex )
+    {
+        // index is stored in the low bits of the packed pointer, the count in the high bits
+        uint64_t nodeIndexEnd = qw_round_up_to_power_of_two(maxNodeIndex); // valid node indices are [1,nodeIndexEnd)
+        if (nodeIndexEnd == maxNodeIndex) // need an extra bit
+            nodeIndexEnd = nodeIndexEnd << 1;
+        init_index_end(nodeIndexEnd);
+    }
+
+    // nodeIndexEnd must be a power of two. valid node indices are [1,nodeIndexEnd)
+    void init_index_end( uint64_t nodeIndexEnd )
+    {
+        indexMask_ = nodeIndexEnd - 1;
+        countMask_ = ~indexMask_;
+        countIncrement_ = nodeIndexEnd;
+    }
+
+    uint64_t index( uint64_t ap ) const { return ap & indexMask_; }
+    uint64_t count( uint64_t ap ) const { return ap & countMask_; }
+    uint64_t next_count( uint64_t ap ) const { return count(ap) + countIncrement_; }
+    uint64_t make( uint64_t index, uint64_t count ) const { return index | (count & countMask_); }
+};
+
+// QwPackedIndexLayout with compile-time masks. Valid node indices are [1,INDEX_END)
+template<size_t INDEX_END>
+class QwStaticPackedIndexLayout {
+    static const uint64_t INDEX_MASK = static_cast<uint64_t>(INDEX_END) - 1;
+    static const uint64_t COUNT_MASK = ~INDEX_MASK;
+    static const uint64_t COUNT_INCREMENT = INDEX_END;
+
+public:
+    uint64_t index( uint64_t ap ) const { return ap & INDEX_MASK; }
+    uint64_t count( uint64_t ap ) const { return ap & COUNT_MASK; }
+    uint64_t next_count( uint64_t ap ) const { return count(ap) + COUNT_INCREMENT; }
+    uint64_t make( uint64_t index, uint64_t count ) const { return index | (count & COUNT_MASK); }
+};
+
+
+// IndexT is the type of the next index stored in free nodes. LayoutT is QwPackedIndexLayout
+// or QwStaticPackedIndexLayout. pop() converts indices to pointers by calling
+// nodeMap.node_at_index(index). (Pools that keep node_at_index() private can
+// befriend QwPackedIndexFreelist.)
+template<typename IndexT, typename LayoutT>
+class QwPackedIndexFreelist {
+public:
+    static IndexT& node_next( void *node ) { return *static_cast<IndexT*>(node); }
+
+    // push a chain of nodes linked by node_next() from front through to back. frontIndex is the index of front
+    static void push_chain( mint_atomic64_t *top, const LayoutT& layout, IndexT frontIndex, void *back )
+    {
+        uint64_t t;
+        do {
+            t = mint_load_64_relaxed(top);                      // Read top.ptr and top.count together
+            node_next(back) = static_cast<IndexT>(layout.index(t)); // Link back of chain to head of list
+            mint_thread_fence_release();                        // (Ensure node.next is visible to consumers)
+            // Try to swing top to the new node:
+        } while (mint_compare_exchange_strong_64_relaxed(top, t, layout.make(frontIndex, layout.next_count(t))) != t);
+    }
+
+    // returns 0 if the stack is empty
+    template<typename NodeMapT>
+    static void *pop( mint_atomic64_t *top, const LayoutT& layout, NodeMapT& nodeMap )
+    {
+        uint64_t t;
+        void *node;
+        do {
+            t = mint_load_64_relaxed(top);                      // Read top
+            mint_thread_fence_acquire();                        // (Acquire top.next)
+            IndexT nodeIndex = static_cast<IndexT>(layout.index(t));
+            if (nodeIndex == 0)                                 // Is the stack empty?
+                return 0;
+            node = nodeMap.node_at_index(nodeIndex);
+            // Try to swing top to the next node:
+        } while (mint_compare_exchange_strong_64_relaxed(top, t, layout.make(node_next(node), layout.next_count(t))) != t);
+
+        return node;
+    }
+};
+
+
+#if QW_HAVE_ATOMIC128
+
+// The stack top is a qw_mint_atomic128_t: _nonatomic[0] is the node pointer, _nonatomic[1] is the ABA count.
+class QwDwcasFreelist {
+public:
+    static void*& node_next( void *node ) { return *static_cast<void**>(node); }
+
+    static void init( qw_mint_atomic128_t *top )
+    {
+        top->_nonatomic[0] = 0;
+        top->_nonatomic[1] = 0;
+    }
+
+    // push a chain of nodes linked by node_next() from front through to back
+    static void push_chain( qw_mint_atomic128_t *top, void *front, void *back )
+    {
+        uint64_t t[2];
+        qw_mint_load_128_relaxed_torn(top, t);
+        do {
+            node_next(back) = reinterpret_cast<void*>(t[0]);    // Link back of chain to head of list
+            mint_thread_fence_release();                        // (Ensure node.next is visible to consumers)
+            // Try to swing top to the new node. On failure t is reloaded:
+        } while (!qw_mint_compare_exchange_strong_128_relaxed(top, t, reinterpret_cast<uint64_t>(front), t[1]+1));
+    }
+
+    // returns 0 if the stack is empty
+    static void *pop( qw_mint_atomic128_t *top )
+    {
+        uint64_t t[2];
+        qw_mint_load_128_relaxed_torn(top, t);
+        void *node;
+        do {
+            mint_thread_fence_acquire();                        // (Acquire top.next)
+            node = reinterpret_cast<void*>(t[0]);
+            if (node == 0)                                      // Is the stack empty?
+                return 0;
+            // Try to swing top to the next node. On failure t is reloaded:
+        } while (!qw_mint_compare_exchange_strong_128_relaxed(top, t, reinterpret_cast<uint64_t>(node_next(node)), t[1]+1));
+
+        return node;
+    }
+
+    // Pop up to maxCount nodes with a single successful CAS. Returns the front of the chain,
+    // which remains linked by node_next(). count receives the number of nodes popped.
+    // If another thread pops any of these nodes while we walk the chain, we may read garbage
+    // links, but then our CAS fails. nodeMap.is_node_in_range(p) must return false for pointers
+    // that don't point to a node, so that we don't dereference garbage.
+    template<typename NodeMapT>
+    static void *pop_chain( qw_mint_atomic128_t *top, size_t maxCount, size_t& count, const NodeMapT& nodeMap )
+    {
+        uint64_t t[2];
+        qw_mint_load_128_relaxed_torn(top, t);
+        void *front;
+        void *next;
+        do {
+            mint_thread_fence_acquire();
+            front = reinterpret_cast<void*>(t[0]);
+            if (front == 0)
+                return 0;
+
+            void *back = front;
+            count = 1;
+            next = node_next(back);
+            while (count < maxCount && next != 0 && nodeMap.is_node_in_range(next)) {
+                back = next;
+                next = node_next(back);
+                ++count;
+            }
+        } while (!qw_mint_compare_exchange_strong_128_relaxed(top, t, reinterpret_cast<uint64_t>(next), t[1]+1));
+
+        return front;
+    }
+};
+
+#endif /* QW_HAVE_ATOMIC128 */
+
+#endif /* INCLUDED_QW_FREELIST_H */
@@ -0,0 +1,53 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QW_FUTEX_H
+#define INCLUDED_QW_FUTEX_H
+
+#include "mintomic/mintomic.h"
+
+/*
+    Wait on, and wake waiters on, a 32-bit atomic word.
+
+    qw_futex_wait blocks the calling thread while *address == expected, for at
+    most timeoutMs milliseconds (QW_FUTEX_WAIT_FOREVER waits without a timeout).
+    It may return spuriously: callers must re-check their condition.
+
+    qw_futex_wake_one wakes one thread blocked in qw_futex_wait on address,
+    qw_futex_wake_all wakes all of them.
+
+    Implemented with futex(2) on Linux and WaitOnAddress on Windows. On other
+    platforms qw_futex_wait sleeps briefly and the wake functions do nothing.
+
+    These functions make system calls. qw_futex_wait must not be called from
+    a real-time thread.
+*/
+
+enum { QW_FUTEX_WAIT_FOREVER = -1 };
+
+void qw_futex_wait( mint_atomic32_t *address, uint32_t expected, int timeoutMs );
+void qw_futex_wake_one( mint_atomic32_t *address );
+void qw_futex_wake_all( mint_atomic32_t *address );
+
+// milliseconds since an arbitrary epoch, from a monotonic clock. for computing wait deadlines
+uint64_t qw_monotonic_milliseconds();
+
+#endif /* INCLUDED_QW_FUTEX_H */
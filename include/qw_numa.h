@@ -0,0 +1,61 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QW_NUMA_H
+#define INCLUDED_QW_NUMA_H
+
+#include <cstddef>
+
+/*
+    Minimal NUMA topology queries and memory placement.
+
+    On Linux the topology is read from /sys/devices/system/node and memory
+    is placed using the mbind system call directly, so there is no
+    dependency on libnuma. On other platforms, or when the information is
+    unavailable, the system is reported as having a single NUMA node and
+    qw_numa_bind_memory() does nothing.
+
+    NUMA nodes are numbered densely from 0 to qw_numa_node_count()-1, in
+    ascending order of the operating system's node ids. (The operating
+    system's ids may be sparse, e.g. when a node is offline.)
+
+    These functions may make system calls. Don't call them from a real-time
+    thread, except qw_current_cpu(), which is a vDSO call on Linux.
+*/
+
+// the number of online NUMA nodes. always at least 1
+int qw_numa_node_count();
+
+// the number of possible CPUs (highest CPU number + 1). always at least 1
+int qw_cpu_count();
+
+// the NUMA node that cpu belongs to, or 0 if unknown
+int qw_numa_node_of_cpu( int cpu );
+
+// the CPU that the calling thread is currently running on, or -1 if unknown
+int qw_current_cpu();
+
+// Set the memory policy of [p, p+size) to prefer numaNode. Must be called
+// before the memory is first touched. p must be page aligned.
+// Returns false if the policy couldn't be applied.
+bool qw_numa_bind_memory( void *p, size_t size, int numaNode );
+
+#endif /* INCLUDED_QW_NUMA_H */
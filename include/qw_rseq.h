@@ -0,0 +1,196 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QW_RSEQ_H
+#define INCLUDED_QW_RSEQ_H
+
+#include <cassert>
+#include <cstddef>
+
+#include "mintomic/mintomic.h"
+
+/*
+    Per-CPU operations using Linux restartable sequences (rseq).
+
+    A restartable sequence is a short instruction sequence that the kernel
+    aborts (by jumping to an abort handler) if the thread is preempted,
+    migrated or interrupted by a signal before the sequence's final
+    "commit" store. A sequence that operates on data belonging to the
+    current CPU is therefore atomic with respect to all other threads that
+    operate on the same data, without any atomic instructions.
+
+    See: Mathieu Desnoyers, "Restartable Sequences" (rseq(2)), and librseq.
+
+    We use the rseq area that glibc (2.35 and later) registers for each
+    thread. QW_HAVE_RSEQ is defined to 1 if rseq is supported on this
+    platform (Linux x64 with gcc or clang). Registration can still fail at
+    runtime (e.g. on old kernels, or when glibc.pthread.rseq=0):
+    qw_rseq_cpu_id() returns -1 in that case, and callers should fall back
+    to a CAS based algorithm.
+
+    Per-CPU stacks:
+
+    qw_rseq_percpu_stack_push() and qw_rseq_percpu_stack_pop() operate on
+    a bounded stack of pointers (count, slots[capacity]) that belongs to
+    cpu. They return:
+
+        QW_RSEQ_OK          the operation was performed.
+        QW_RSEQ_LIMIT       the stack was full (push) or empty (pop).
+        QW_RSEQ_ABORTED     the calling thread is not running on cpu, or
+                            the sequence was aborted. Re-read the CPU
+                            number with qw_rseq_cpu_id() and try again.
+
+    Same-CPU operations are totally ordered, and the kernel issues a full
+    barrier when a thread migrates, so no fences are required.
+*/
+
+enum { QW_RSEQ_OK=0, QW_RSEQ_LIMIT=1, QW_RSEQ_ABORTED=2 };
+
+#if defined(__linux__) && MINT_CPU_X64 && MINT_COMPILER_GCC && defined(__has_include)
+#if __has_include(<sys/rseq.h>)
+#define QW_HAVE_RSEQ 1
+#endif
+#endif
+
+#ifndef QW_HAVE_RSEQ
+#define QW_HAVE_RSEQ 0
+#endif
+
+#if QW_HAVE_RSEQ
+
+#include <sys/rseq.h>
+
+inline struct rseq *qw_rseq_area()
+{
+    char *threadPointer;
+    __asm__ ("movq %%fs:0, %0" : "=r"(threadPointer)); // (x64 TLS: the thread pointer points to itself)
+    return reinterpret_cast<struct rseq*>(threadPointer + __rseq_offset);
+}
+
+// the CPU that the calling thread is running on, or -1 if rseq is not registered
+inline int qw_rseq_cpu_id()
+{
+    if (__rseq_size == 0)
+        return -1;
+
+    int result = static_cast<int>(*static_cast<volatile uint32_t*>(&qw_rseq_area()->cpu_id));
+    return (result >= 0) ? result : -1; // (RSEQ_CPU_ID_UNINITIALIZED or RSEQ_CPU_ID_REGISTRATION_FAILED)
+}
+
+// The critical section descriptor (struct rseq_cs) is emitted into the __rseq_cs
+// section. The abort handler must be preceded by the signature that glibc registered
+// (RSEQ_SIG, encoded in a ud1 instruction as in librseq), and lives out of line.
+//
+// Labels: 1 = start, 2 = post-commit, 3 = descriptor, 4 = abort handler, 5 = limit, 6 = done.
+
+#define QW_RSEQ_BEGIN_CRITICAL_SECTION_ASM \
+        ".pushsection __rseq_cs, \"aw\"\n\t" \
+        ".balign 32\n\t" \
+        "3:\n\t" \
+        ".long 0, 0\n\t" \
+        ".quad 1f, (2f - 1f), 4f\n\t" \
+        ".popsection\n\t" \
+        "leaq 3b(%%rip), %%rax\n\t" \
+        "movq %%rax, %[rseqCs]\n\t" \
+        "1:\n\t" \
+        "cmpl %[cpu], %[cpuId]\n\t" \
+        "jnz 4f\n\t"
+
+#define QW_RSEQ_END_CRITICAL_SECTION_ASM \
+        "2:\n\t" \
+        "movl %[ok], %[result]\n\t" \
+        "jmp 6f\n\t" \
+        "5:\n\t" \
+        "movl %[limit], %[result]\n\t" \
+        "jmp 6f\n\t" \
+        ".pushsection __rseq_failure, \"ax\"\n\t" \
+        ".byte 0x0f, 0xb9, 0x3d\n\t" \
+        ".long 0x53053053\n\t" \
+        "4:\n\t" \
+        "movl %[aborted], %[result]\n\t" \
+        "jmp 6f\n\t" \
+        ".popsection\n\t" \
+        "6:\n\t"
+
+inline int qw_rseq_percpu_stack_push( int cpu, intptr_t *count, void **slots, intptr_t capacity, void *node )
+{
+    struct rseq *rs = qw_rseq_area();
+    int result;
+    __asm__ __volatile__ (
+        QW_RSEQ_BEGIN_CRITICAL_SECTION_ASM
+        "movq %[count], %%rax\n\t"
+        "cmpq %[capacity], %%rax\n\t"
+        "jae 5f\n\t"
+        "movq %[node], (%[slots], %%rax, 8)\n\t"
+        "incq %%rax\n\t"
+        "movq %%rax, %[count]\n\t" // commit
+        QW_RSEQ_END_CRITICAL_SECTION_ASM
+        : [result] "=&r"(result), [count] "+m"(*count), [rseqCs] "=m"(rs->rseq_cs)
+        : [cpu] "r"(cpu), [cpuId] "m"(rs->cpu_id), [slots] "r"(slots), [capacity] "r"(capacity), [node] "r"(node),
+          [ok] "i"(QW_RSEQ_OK), [limit] "i"(QW_RSEQ_LIMIT), [aborted] "i"(QW_RSEQ_ABORTED)
+        : "rax", "cc", "memory" );
+    return result;
+}
+
+inline int qw_rseq_percpu_stack_pop( int cpu, intptr_t *count, void **slots, void *& node )
+{
+    struct rseq *rs = qw_rseq_area();
+    int result;
+    void *popped = 0;
+    __asm__ __volatile__ (
+        QW_RSEQ_BEGIN_CRITICAL_SECTION_ASM
+        "movq %[count], %%rax\n\t"
+        "testq %%rax, %%rax\n\t"
+        "jz 5f\n\t"
+        "decq %%rax\n\t"
+        "movq (%[slots], %%rax, 8), %[popped]\n\t"
+        "movq %%rax, %[count]\n\t" // commit
+        QW_RSEQ_END_CRITICAL_SECTION_ASM
+        : [result] "=&r"(result), [popped] "+&r"(popped), [count] "+m"(*count), [rseqCs] "=m"(rs->rseq_cs)
+        : [cpu] "r"(cpu), [cpuId] "m"(rs->cpu_id), [slots] "r"(slots),
+          [ok] "i"(QW_RSEQ_OK), [limit] "i"(QW_RSEQ_LIMIT), [aborted] "i"(QW_RSEQ_ABORTED)
+        : "rax", "cc", "memory" );
+    node = popped;
+    return result;
+}
+
+#undef QW_RSEQ_BEGIN_CRITICAL_SECTION_ASM
+#undef QW_RSEQ_END_CRITICAL_SECTION_ASM
+
+#else /* !QW_HAVE_RSEQ */
+
+inline int qw_rseq_cpu_id() { return -1; }
+
+inline int qw_rseq_percpu_stack_push( int, intptr_t*, void**, intptr_t, void* )
+{
+    assert( false ); // qw_rseq_cpu_id() never succeeds
+    return QW_RSEQ_ABORTED;
+}
+
+inline int qw_rseq_percpu_stack_pop( int, intptr_t*, void**, void*& )
+{
+    assert( false ); // qw_rseq_cpu_id() never succeeds
+    return QW_RSEQ_ABORTED;
+}
+
+#endif /* QW_HAVE_RSEQ */
+
+#endif /* INCLUDED_QW_RSEQ_H */
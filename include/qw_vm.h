@@ -0,0 +1,104 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QW_VM_H
+#define INCLUDED_QW_VM_H
+
+#include <cstddef>
+
+/*
+    Page-granularity virtual memory allocation.
+
+    qw_vm_allocate returns zero-filled, page-aligned memory directly from
+    the operating system (mmap on POSIX, VirtualAlloc on Windows), or 0 on
+    failure. The flags request optional properties of the mapping. Each
+    property is applied on a best-effort basis: if it is unavailable
+    (e.g. no huge pages configured, or insufficient mlock limit) the
+    allocation still succeeds and the corresponding flag is cleared in
+    appliedFlags.
+
+    QW_VM_HUGE_PAGES    Back the memory with huge pages. On Linux we first try
+                        explicit huge pages (MAP_HUGETLB), then fall back to
+                        a huge-page aligned mapping with madvise(MADV_HUGEPAGE)
+                        (transparent huge pages). In the latter case the flag
+                        is reported as applied if the madvise call succeeds.
+
+    QW_VM_PREFAULT      Fault in all pages at allocation time, so that the first
+                        access to the memory doesn't take a page fault.
+
+    QW_VM_LOCK          Lock the pages in physical memory (mlock/VirtualLock).
+                        Implies QW_VM_PREFAULT.
+
+    Memory must be freed with qw_vm_free, passing the same size and the
+    appliedFlags returned by qw_vm_allocate.
+
+    These functions make system calls. Don't call them from a real-time thread.
+*/
+
+enum QwVmFlags {
+    QW_VM_HUGE_PAGES = 1,
+    QW_VM_PREFAULT = 2,
+    QW_VM_LOCK = 4
+};
+
+void *qw_vm_allocate( size_t size, int flags, int& appliedFlags );
+void qw_vm_free( void *p, size_t size, int appliedFlags );
+
+// Return the physical pages backing [p, p+size) to the operating system
+// (madvise(MADV_DONTNEED) on POSIX, MEM_RESET on Windows). The range remains
+// mapped: it is faulted back in when next touched, and its contents are
+// undefined. p and size must be multiples of the page size. The pages must
+// not be locked. Returns false if the pages couldn't be released.
+bool qw_vm_release_pages( void *p, size_t size );
+
+// the base virtual memory page size
+size_t qw_vm_page_size();
+
+// the huge page size, or 0 if huge pages are not supported
+size_t qw_vm_huge_page_size();
+
+/*
+    Shared memory segments.
+
+    qw_vm_map_shared maps a named segment that other processes can map too.
+    name is a shared memory object name (e.g. "/my_segment"), or with
+    QW_VM_SHARED_FILE, the path of a file to map.
+
+    With QW_VM_SHARED_CREATE a new zero-filled segment of size bytes is
+    created. This fails if the segment already exists. Otherwise an existing
+    segment is opened and size receives its size.
+
+    Returns 0 on failure. Segments must be unmapped with qw_vm_unmap_shared.
+    POSIX shared memory objects and files persist until qw_vm_remove_shared
+    is called. On Windows, shared memory objects are removed when the last
+    process unmaps them.
+*/
+
+enum QwVmSharedFlags {
+    QW_VM_SHARED_CREATE = 1,
+    QW_VM_SHARED_FILE = 2
+};
+
+void *qw_vm_map_shared( const char *name, int flags, size_t& size );
+void qw_vm_unmap_shared( void *p, size_t size );
+bool qw_vm_remove_shared( const char *name, int flags );
+
+#endif /* INCLUDED_QW_VM_H */
@@ -0,0 +1,139 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwDwcasNodePool.h"
+
+#include <cassert>
+
+#include "qw_vm.h"
+
+#if QW_HAVE_ATOMIC128
+
+QwRawDwcasNodePool::QwRawDwcasNodePool( size_t nodeSize, size_t maxNodes, int storageFlags, QwFreshNodeOrder::Order freshOrder )
+{
+    int8_t *storage = (int8_t*)QwRawNodePool::allocate_storage(storage_size(nodeSize, maxNodes), storageFlags, storageSize_, storageFlags_);
+    assert( storage != 0 );
+
+    init( nodeSize, maxNodes, storage, true, freshOrder );
+}
+
+QwRawDwcasNodePool::QwRawDwcasNodePool( size_t nodeSize, size_t maxNodes, void *storage, QwFreshNodeOrder::Order freshOrder )
+{
+    storageSize_ = 0;
+    storageFlags_ = 0;
+    init( nodeSize, maxNodes, static_cast<int8_t*>(storage), false, freshOrder );
+}
+
+void QwRawDwcasNodePool::init( size_t nodeSize, size_t maxNodes, int8_t *storage, bool ownsStorage, QwFreshNodeOrder::Order freshOrder )
+{
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+    allocCount_._nonatomic = 0;
+#endif
+
+    assert( storage != 0 );
+    assert( (reinterpret_cast<uintptr_t>(storage) & (CACHE_LINE_SIZE-1)) == 0 );
+    assert( (reinterpret_cast<uintptr_t>(&top_) & 15) == 0 ); // cmpxchg16b requires 16-byte alignment
+
+    nodeSize_ = node_size(nodeSize);
+    maxNodes_ = maxNodes;
+
+    nodeStorage_ = storage;
+    nodeStorageEnd_ = storage + nodeSize_ * maxNodes;
+    ownsStorage_ = ownsStorage;
+
+    QwDwcasFreelist::init(&top_);
+
+    // all nodes are above the high-water mark. they are not touched until they are first allocated
+    bumpIndex_._nonatomic = 0;
+    freshOrder_.init(freshOrder, maxNodes, nodeSize_, qw_vm_page_size());
+}
+
+QwRawDwcasNodePool::~QwRawDwcasNodePool()
+{
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+    assert( allocCount_._nonatomic == 0 );
+#endif
+
+    if (ownsStorage_)
+        QwRawNodePool::free_storage(nodeStorage_, storageSize_, storageFlags_);
+}
+
+void *QwRawDwcasNodePool::allocate_chain( size_t maxCount, size_t& count )
+{
+    count = 0;
+    if (maxCount == 0)
+        return 0;
+
+    // the freelist is linked through the same word as chain_next(), so popped chains need no conversion
+    void *front = QwDwcasFreelist::pop_chain(&top_, maxCount, count, *this);
+    void *back = 0;
+    if (front) {
+        back = front;
+        for (size_t i=1; i < count; ++i)
+            back = chain_next(back);
+        chain_next(back) = 0;
+    }
+
+    // top up the chain with never-allocated nodes
+    if (count < maxCount) {
+        size_t first, bumpCount;
+        if (bump_allocate(maxCount - count, first, bumpCount)) {
+            void *p = fresh_node(first);
+            if (back)
+                chain_next(back) = p;
+            else
+                front = p;
+
+            for (size_t i=1; i < bumpCount; ++i) {
+                void *next = fresh_node(first + i);
+                chain_next(p) = next;
+                p = next;
+            }
+            chain_next(p) = 0;
+            count += bumpCount;
+        }
+    }
+
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+    mint_fetch_add_32_relaxed(&allocCount_,static_cast<int32_t>(count));
+#endif
+
+    return front;
+}
+
+void QwRawDwcasNodePool::deallocate_chain( void *front, void *back )
+{
+    assert( front != 0 );
+    assert( back != 0 );
+
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+    int32_t count = 1;
+    for (void *p=front; p != back; p=chain_next(p)) {
+        assert( p != 0 ); // back must be reachable from front
+        ++count;
+    }
+    mint_fetch_add_32_relaxed(&allocCount_,-count);
+#endif
+
+    QwDwcasFreelist::push_chain(&top_, front, back);
+}
+
+#endif /* QW_HAVE_ATOMIC128 */
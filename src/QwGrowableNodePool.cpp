@@ -0,0 +1,171 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwGrowableNodePool.h"
+
+#undef max
+#undef min
+
+#include <algorithm>
+#include <cassert>
+
+#include "qw_aligned_malloc.h"
+#include "qw_cache_info.h"
+
+
+static int8_t log2OfPowerOfTwo(size_t x)
+{
+    int8_t result = 0;
+    while ((static_cast<size_t>(1) << result) < x)
+        ++result;
+    assert( (static_cast<size_t>(1) << result) == x );
+    return result;
+}
+
+
+QwRawGrowableNodePool::QwRawGrowableNodePool( size_t nodeSize, size_t segmentNodeCount, size_t maxSegments, size_t initialSegmentCount )
+{
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+    allocCount_._nonatomic = 0;
+#endif
+
+    assert( maxSegments > 0 );
+    assert( initialSegmentCount <= maxSegments );
+
+    // Align nodes on cache line boundaries to avoid false sharing.
+    // Nodes and segments have power-of-two sizes so that we can use shifts and masks to convert between pointers and indices
+    nodeSize_ = qw_round_up_to_power_of_two(std::max(nodeSize, std::max(sizeof(nodeindex_t),qw_cache_line_size())));
+    nodeBitShift_ = log2OfPowerOfTwo(nodeSize_);
+
+    segmentNodeCount_ = qw_round_up_to_power_of_two(std::max(segmentNodeCount, static_cast<size_t>(2))); // need at least one node in addition to the header
+    segmentBitShift_ = log2OfPowerOfTwo(segmentNodeCount_);
+    slotMask_ = segmentNodeCount_ - 1;
+    segmentSize_ = segmentNodeCount_ * nodeSize_;
+
+    maxSegments_ = maxSegments;
+    segmentTable_ = new int8_t*[maxSegments_];
+    for (size_t i=0; i < maxSegments_; ++i)
+        segmentTable_[i] = 0;
+
+    // valid node indices are [1,nodeIndexEnd)
+    layout_.init_index_end(static_cast<uint64_t>(qw_round_up_to_power_of_two(maxSegments_)) << segmentBitShift_);
+
+    top_._nonatomic = layout_.make(NULL_NODE_INDEX, 0);
+
+    activeSegmentCount_._nonatomic = 0;
+    allocatedSegmentCount_._nonatomic = 0;
+    growLock_._nonatomic = 0;
+
+    for (size_t i=0; i < initialSegmentCount; ++i) {
+        bool ok = allocate_segment();
+        assert( ok );
+        (void)ok;
+    }
+
+    while (activate_reserved_segment())
+        ;
+}
+
+QwRawGrowableNodePool::~QwRawGrowableNodePool()
+{
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+    assert( allocCount_._nonatomic == 0 );
+#endif
+
+    for (size_t i=0; i < allocatedSegmentCount_._nonatomic; ++i)
+        qw_aligned_free(segmentTable_[i]);
+
+    delete [] segmentTable_;
+}
+
+bool QwRawGrowableNodePool::allocate_segment()
+{
+    uint32_t segment = mint_load_32_relaxed(&allocatedSegmentCount_);
+    if (segment >= maxSegments_)
+        return false;
+
+    int8_t *segmentBase = (int8_t*)qw_aligned_malloc(segmentSize_, segmentSize_);
+    if (!segmentBase)
+        return false;
+
+    // write the segment header
+    nodeindex_t segmentIndexBase = static_cast<nodeindex_t>(segment) << segmentBitShift_;
+    *reinterpret_cast<nodeindex_t*>(segmentBase + (SEGMENT_HEADER_SLOT << nodeBitShift_)) = segmentIndexBase;
+
+    // link the segment's nodes into a chain from slot 1 to the last slot,
+    // so that activation is a single push.
+    for (size_t slot=1; slot < segmentNodeCount_-1; ++slot)
+        freelist_type::node_next(segmentBase + (slot << nodeBitShift_)) = segmentIndexBase | (slot+1);
+
+    segmentTable_[segment] = segmentBase;
+
+    mint_thread_fence_release(); // publish segment table entry and contents before the count
+    mint_store_32_relaxed(&allocatedSegmentCount_, segment+1);
+    return true;
+}
+
+bool QwRawGrowableNodePool::activate_reserved_segment()
+{
+    for (;;) {
+        uint32_t active = mint_load_32_relaxed(&activeSegmentCount_);
+        uint32_t allocated = mint_load_32_relaxed(&allocatedSegmentCount_);
+        mint_thread_fence_acquire(); // acquire segment table entries and contents
+
+        if (active >= allocated)
+            return false; // no armed segments
+
+        if (mint_compare_exchange_strong_32_relaxed(&activeSegmentCount_, active, active+1) == active) {
+            int8_t *segmentBase = segmentTable_[active];
+            void *front = segmentBase + (static_cast<size_t>(1) << nodeBitShift_);
+            void *back = segmentBase + ((segmentNodeCount_-1) << nodeBitShift_);
+            stack_push_chain(front, back);
+            return true;
+        }
+        // else another thread activated the segment. try again.
+    }
+}
+
+bool QwRawGrowableNodePool::grow()
+{
+    if (!try_lock_grow())
+        return false;
+
+    bool result = allocate_segment();
+    unlock_grow();
+
+    if (result)
+        activate_reserved_segment();
+
+    return result;
+}
+
+bool QwRawGrowableNodePool::reserve( size_t segmentCount )
+{
+    if (!try_lock_grow())
+        return false;
+
+    bool result = true;
+    while (result && allocated_segment_count() - active_segment_count() < segmentCount)
+        result = allocate_segment();
+
+    unlock_grow();
+    return result;
+}
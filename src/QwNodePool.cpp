@@ -27,92 +27,150 @@
 #include <algorithm>
 #include <cassert>
 
+#include "qw_aligned_malloc.h"
+#include "qw_cache_info.h"
+#include "qw_freelist.h"
+#include "qw_vm.h"
 
-// need x to be unsigned.
-// "C Standard Section 4.1.5 defines size_t as an unsigned integral type of the result of the sizeof operator"
-static size_t roundUpToNextPowerOfTwo(size_t x)
+
+// multiplicative inverse of odd x modulo 2^N, where N is the number of bits in size_t.
+// Newton's iteration: starting with y=x (correct to 3 bits), each step doubles the number of correct bits.
+static size_t oddInverse(size_t x)
 {
-    x--;
-    x |= x >> 1;  // handle  2 bit numbers
-    x |= x >> 2;  // handle  4 bit numbers
-    x |= x >> 4;  // handle  8 bit numbers
-    x |= x >> 8;  // handle 16 bit numbers
-    x |= x >> 16; // handle 32 bit numbers
-    x++;
+    assert( (x & 1) == 1 );
+    size_t y = x;
+    for (size_t correctBits=3; correctBits < sizeof(size_t)*8; correctBits *= 2)
+        y *= 2 - x * y;
+    return y;
+}
 
-    return x;
+static size_t greatestCommonDivisor(size_t a, size_t b)
+{
+    while (b != 0) {
+        size_t r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
 }
 
-#ifdef WIN32
+size_t QwRawNodePool::node_size( size_t nodeSize )
+{
+    size_t minNodeSize = MIN_NODE_WORDS*sizeof(nodeindex_t); // nodes need to be large enough to embed their next ptr and magazine header
+    // Align nodes on cache line boundaries to avoid false sharing.
+    // Sizes are rounded up to a multiple of the runtime cache line size. They need not be a power
+    // of two because index_of_node() uses an exact division to convert pointers to indices.
+    size_t lineSize = qw_cache_line_size();
+    return (std::max(nodeSize, minNodeSize) + lineSize - 1) & ~(lineSize - 1);
+}
 
-void *qw_aligned_malloc( size_t size, size_t alignment )
+size_t QwRawNodePool::storage_size( size_t nodeSize, size_t maxNodes )
 {
-    return _aligned_malloc(size, alignment);
+    return node_size(nodeSize) * maxNodes;
 }
 
-void qw_aligned_free( void *memblock )
+QW_THREAD_LOCAL uint32_t QwRawNodePool::eliminationRandom_ = 0;
+QW_THREAD_LOCAL uint32_t QwRawNodePool::eliminationContention_ = 0;
+
+static int storageFlagsToVmFlags( int storageFlags )
 {
-    _aligned_free(memblock);    
+    return ((storageFlags & QwRawNodePool::HUGE_PAGE_STORAGE) ? QW_VM_HUGE_PAGES : 0)
+            | ((storageFlags & QwRawNodePool::PREFAULTED_STORAGE) ? QW_VM_PREFAULT : 0)
+            | ((storageFlags & QwRawNodePool::LOCKED_STORAGE) ? QW_VM_LOCK : 0);
 }
 
-#else
+static int vmFlagsToStorageFlags( int vmFlags )
+{
+    return ((vmFlags & QW_VM_HUGE_PAGES) ? QwRawNodePool::HUGE_PAGE_STORAGE : 0)
+            | ((vmFlags & QW_VM_PREFAULT) ? QwRawNodePool::PREFAULTED_STORAGE : 0)
+            | ((vmFlags & QW_VM_LOCK) ? QwRawNodePool::LOCKED_STORAGE : 0);
+}
 
-void *qw_aligned_malloc( size_t size, size_t alignment )
+void *QwRawNodePool::allocate_storage( size_t storageSize, int storageFlags, size_t& allocatedSize, int& appliedStorageFlags )
 {
-    void *result = 0;
-    
-    if (posix_memalign(&result, alignment, size)!=0)
-        result = 0;
-    
+    if (storageFlags == 0) {
+        // Aligned allocation. Storage that spans pages is page aligned, so that trim() can release whole pages.
+        allocatedSize = 0;
+        appliedStorageFlags = 0;
+        size_t pageSize = qw_vm_page_size();
+        return qw_aligned_malloc(storageSize, (storageSize >= pageSize) ? pageSize : qw_cache_line_size());
+    }
+
+    if (storageFlags & HUGE_PAGE_STORAGE) {
+        // huge pages need the allocation to be a multiple of the huge page size
+        size_t hugePageSize = qw_vm_huge_page_size();
+        if (hugePageSize != 0)
+            storageSize = (storageSize + hugePageSize - 1) & ~(hugePageSize - 1);
+    }
+
+    int appliedVmFlags = 0;
+    void *result = qw_vm_allocate(storageSize, storageFlagsToVmFlags(storageFlags), appliedVmFlags);
+    allocatedSize = storageSize;
+    appliedStorageFlags = vmFlagsToStorageFlags(appliedVmFlags);
     return result;
 }
 
-void qw_aligned_free( void *memblock )
+void QwRawNodePool::free_storage( void *storage, size_t allocatedSize, int appliedStorageFlags )
 {
-    free(memblock);
+    if (allocatedSize != 0)
+        qw_vm_free(storage, allocatedSize, storageFlagsToVmFlags(appliedStorageFlags));
+    else
+        qw_aligned_free(storage);
 }
 
-#endif
+QwRawNodePool::QwRawNodePool( size_t nodeSize, size_t maxNodes, int storageFlags, QwFreshNodeOrder::Order freshOrder )
+{
+    int8_t *storage = (int8_t*)allocate_storage(storage_size(nodeSize, maxNodes), storageFlags, storageSize_, storageFlags_);
+    assert( storage != 0 );
 
+    init( nodeSize, maxNodes, storage, true, freshOrder );
+}
 
+QwRawNodePool::QwRawNodePool( size_t nodeSize, size_t maxNodes, void *storage, QwFreshNodeOrder::Order freshOrder )
+{
+    storageSize_ = 0;
+    storageFlags_ = 0;
+    init( nodeSize, maxNodes, static_cast<int8_t*>(storage), false, freshOrder );
+}
 
-QwRawNodePool::QwRawNodePool( size_t nodeSize, size_t maxNodes )
+void QwRawNodePool::init( size_t nodeSize, size_t maxNodes, int8_t *storage, bool ownsStorage, QwFreshNodeOrder::Order freshOrder )
 {
 #ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
     allocCount_._nonatomic = 0;
 #endif
 
-    assert( sizeof(top_) >= sizeof(abapointer_t) );
+#ifdef QW_NODE_POOL_STATISTICS
+    statistics_.init();
+#endif
 
-    // Align nodes on cache line boundaries to avoid false sharing
-    size_t minNodeSize = sizeof(nodeindex_t); // nodes need to be large enough to embed their next ptr
-    // Make node size a power of two to allow for using bit shift to convert between pointers and indices 
-    nodeSize_ = roundUpToNextPowerOfTwo(std::max(nodeSize, std::max(minNodeSize,CACHE_LINE_SIZE)));
+    assert( sizeof(top_) >= sizeof(abapointer_t) );
+    assert( storage != 0 );
+    assert( (reinterpret_cast<uintptr_t>(storage) & (CACHE_LINE_SIZE-1)) == 0 );
 
-    // Aligned allocation
-    // TODO: use posix_memalign on unix
-    // see also http://cottonvibes.blogspot.com.au/2011/01/dynamically-allocate-aligned-memory.html
-    // and http://stackoverflow.com/questions/17378444/stdalign-and-stdaligned-storage-for-aligned-allocation-of-memory-blocks
+    nodeSize_ = node_size(nodeSize);
 
-    nodeStorage_ = (int8_t*)qw_aligned_malloc(nodeSize_*maxNodes,CACHE_LINE_SIZE);
-    assert( nodeStorage_ != 0 );
+    nodeStorage_ = storage;
+    ownsStorage_ = ownsStorage;
 
     nodeArrayBase_ = nodeStorage_ - nodeSize_; // node index 0 is the null index, so we want nodeArrayBase_[1] --> nodeStorage_[0]
 
-    nodeBitShift_ = 0;
-    size_t x = 1;
-    while (x < nodeSize_) {
-        x = x << 1;
-        ++nodeBitShift_;
+    // factor node size into (odd << shift)
+    nodeSizeShift_ = 0;
+    size_t oddFactor = nodeSize_;
+    while ((oddFactor & 1) == 0) {
+        oddFactor = oddFactor >> 1;
+        ++nodeSizeShift_;
     }
-    assert( x == nodeSize_ ); // require node size to be a power of two
+    nodeSizeOddInverse_ = oddInverse(oddFactor);
+    assert( oddFactor * nodeSizeOddInverse_ == 1 );
 
-    size_t maxNodeIndex = maxNodes; // since node indices are 1-based, max index is N, not N-1
+    maxNodeIndex_ = maxNodes; // since node indices are 1-based, max index is N, not N-1
+    size_t maxNodeIndex = maxNodeIndex_;
 
     // index is stored in the low bits of the packed pointer.
     // generate a bit mask for it.
 
-    size_t nodeIndexEnd = roundUpToNextPowerOfTwo(maxNodeIndex); // valid node indices are [1,nodeIndexEnd)
+    size_t nodeIndexEnd = qw_round_up_to_power_of_two(maxNodeIndex); // valid node indices are [1,nodeIndexEnd)
     if (nodeIndexEnd==maxNodeIndex) // need an extra bit
         nodeIndexEnd = nodeIndexEnd << 1;
     indexMask_ = nodeIndexEnd-1;
@@ -120,23 +178,430 @@ QwRawNodePool::QwRawNodePool( size_t nodeSize, size_t maxNodes )
     countMask_ = ~indexMask_; // count is in the high part
     countIncrement_ = nodeIndexEnd;
     
-    // now that everything has been set up, push all nodes onto the stack
     stack_init();
 
-    int8_t *p = nodeStorage_;
-    for( size_t i=0; i < maxNodes; ++i ) {
-        stack_push_nonatomic(p);
-        p += nodeSize_;
+    for (int i=0; i < ELIMINATION_SLOT_COUNT; ++i)
+        eliminationSlots_[i].offer._nonatomic = make_abapointer(NULL_NODE_INDEX, 0);
+
+    waiterCount_._nonatomic = 0;
+    wakeEpoch_._nonatomic = 0;
+
+    trimParking_._nonatomic = 0;
+
+    // all nodes are above the high-water mark. they are not touched until they are first allocated
+    bumpIndex_._nonatomic = 1;
+    freshOrder_.init(freshOrder, maxNodes, nodeSize_, qw_vm_page_size());
+
+    // trim() blocks. Find the first node that starts on a page boundary
+    size_t pageSize = qw_vm_page_size();
+    if ((storageFlags_ & HUGE_PAGE_STORAGE) && qw_vm_huge_page_size() != 0)
+        pageSize = qw_vm_huge_page_size();
+
+    blockSize_ = (pageSize / greatestCommonDivisor(pageSize, nodeSize_)) * nodeSize_; // lcm(pageSize, nodeSize_)
+    nodesPerBlock_ = blockSize_ / nodeSize_;
+    firstBlockNodePosition_ = 0;
+    blockCount_ = 0;
+    blockNext_ = 0;
+    parkedBlocks_ = 0;
+    for (size_t i=0; i < nodesPerBlock_ && i < maxNodes; ++i) {
+        if ((reinterpret_cast<uintptr_t>(nodeStorage_ + i * nodeSize_) & (pageSize - 1)) == 0) {
+            firstBlockNodePosition_ = i;
+            blockCount_ = (maxNodes - i) / nodesPerBlock_;
+            break;
+        }
+    }
+
+    // trim()'s arrays are allocated here rather than by the first trim(), so that they
+    // are published to other threads with the pool itself
+    if (blockCount_ != 0 && !(storageFlags_ & LOCKED_STORAGE)) {
+        blockNext_ = new size_t[blockCount_ + 1];
+
+        // slot lengths are stored in the count bits. the slot for nodes that
+        // aren't in a block holds fewer than 2*nodesPerBlock_ nodes
+        assert( countMask_ / countIncrement_ >= 2*nodesPerBlock_ );
+        parkedBlocks_ = new mint_atomic64_t[blockCount_ + 1];
+        for (size_t block=0; block <= blockCount_; ++block)
+            parkedBlocks_[block]._nonatomic = make_abapointer(NULL_NODE_INDEX, 0);
+    }
+}
+
+void *QwRawNodePool::allocate_from_depot( bool& neverAllocated )
+{
+    size_t count = 0;
+    nodeindex_t headIndex = depot_pop(count);
+    if (headIndex==NULL_NODE_INDEX) {
+        // prefer nodes that trim() has parked, then released nodes, to never-allocated
+        // nodes, to keep the high-water mark low
+        while (reclaim_parked_nodes() || reclaim_released_block()) {
+            void *result = stack_pop(&top_, NEXT_LINK_WORD);
+            if (result)
+                return result;
+        }
+
+        nodeindex_t bumpIndex = bump_allocate(1, count);
+        if (bumpIndex==NULL_NODE_INDEX)
+            return 0;
+
+        neverAllocated = true;
+        return node_at_index(fresh_node_index(bumpIndex));
+    }
+
+    void *result = node_at_index(headIndex);
+    if (count > 1) {
+        // return the remainder of the magazine to the freelist with a single push
+        void *front = node_at_index(node_next(result));
+        void *back = front;
+        for (size_t i=2; i < count; ++i)
+            back = node_at_index(node_next(back));
+
+        stack_push_chain(&top_, front, back);
+    }
+
+    return result;
+}
+
+QwRawNodePool::nodeindex_t QwRawNodePool::allocate_magazine( size_t maxCount, size_t& count )
+{
+    assert( maxCount > 0 );
+    count = 0;
+
+    // popped chains are already linked by index
+    void *front = stack_pop_chain(&top_, maxCount, count);
+    if (!front && (reclaim_parked_nodes() || reclaim_released_block())) // prefer parked and released nodes to never-allocated nodes
+        front = stack_pop_chain(&top_, maxCount, count);
+
+    nodeindex_t result = NULL_NODE_INDEX;
+    if (front) {
+        result = index_of_node(front);
+    } else {
+        nodeindex_t bumpIndex = bump_allocate(maxCount, count);
+        if (bumpIndex == NULL_NODE_INDEX)
+            return NULL_NODE_INDEX;
+
+        result = fresh_node_index(bumpIndex);
+        nodeindex_t back = result;
+        for (size_t i=1; i < count; ++i) {
+            nodeindex_t next = fresh_node_index(bumpIndex + i);
+            node_next_lvalue(node_at_index(back)) = next;
+            back = next;
+        }
+    }
+
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+    mint_fetch_add_32_relaxed(&allocCount_,static_cast<int32_t>(count));
+#endif
+    QW_NODE_POOL_COUNT( statistics_, ALLOCATIONS, count );
+    return result;
+}
+
+void *QwRawNodePool::allocate_chain( size_t maxCount, size_t& count )
+{
+    count = 0;
+    if (maxCount == 0)
+        return 0;
+
+    void *front = stack_pop_chain(&top_, maxCount, count);
+    if (!front && (reclaim_parked_nodes() || reclaim_released_block())) // prefer parked and released nodes to never-allocated nodes
+        front = stack_pop_chain(&top_, maxCount, count);
+
+    // we own the chain now. convert its index links into pointer links
+    void *back = 0;
+    if (front) {
+        back = front;
+        for (size_t i=1; i < count; ++i) {
+            void *next = node_at_index(node_next(back));
+            chain_next(back) = next;
+            back = next;
+        }
+        chain_next(back) = 0;
+    }
+
+    // top up the chain with never-allocated nodes
+    if (count < maxCount) {
+        size_t bumpCount = 0;
+        nodeindex_t bumpIndex = bump_allocate(maxCount - count, bumpCount);
+        if (bumpIndex != NULL_NODE_INDEX) {
+            void *p = node_at_index(fresh_node_index(bumpIndex));
+            if (back)
+                chain_next(back) = p;
+            else
+                front = p;
+
+            for (size_t i=1; i < bumpCount; ++i) {
+                void *next = node_at_index(fresh_node_index(bumpIndex + i));
+                chain_next(p) = next;
+                p = next;
+            }
+            chain_next(p) = 0;
+            count += bumpCount;
+        }
+    }
+
+    if (!front) {
+        QW_NODE_POOL_COUNT( statistics_, ALLOCATION_FAILURES, 1 );
+        return 0;
+    }
+
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+    mint_fetch_add_32_relaxed(&allocCount_,static_cast<int32_t>(count));
+#endif
+    QW_NODE_POOL_COUNT( statistics_, ALLOCATIONS, count );
+
+    return front;
+}
+
+void QwRawNodePool::deallocate_chain( void *front, void *back )
+{
+    assert( front != 0 );
+    assert( back != 0 );
+
+    // convert pointer links into index links
+    size_t count = 1;
+    void *p = front;
+    while (p != back) {
+        void *next = chain_next(p);
+        assert( next != 0 ); // back must be reachable from front
+        node_next_lvalue(p) = index_of_node(next);
+        p = next;
+        ++count;
     }
+
+#ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
+    mint_fetch_add_32_relaxed(&allocCount_,-static_cast<int32_t>(count));
+#endif
+    QW_NODE_POOL_COUNT( statistics_, DEALLOCATIONS, count );
+
+    stack_push_chain(&top_, front, back);
+}
+
+void QwRawNodePool::released_block_push( size_t block )
+{
+    nodeindex_t blockIndex = static_cast<nodeindex_t>(block + 1); // (1-based)
+
+    abapointer_t top;
+    do {
+        top = mint_load_64_relaxed(&releasedBlockTop_);
+        blockNext_[blockIndex] = ap_index(top);
+        mint_thread_fence_release();
+    } while (mint_compare_exchange_strong_64_relaxed(&releasedBlockTop_, top, make_abapointer(blockIndex,ap_count(top)+countIncrement_))!=top);
+}
+
+bool QwRawNodePool::reclaim_released_block()
+{
+    abapointer_t top;
+    nodeindex_t blockIndex;
+    do {
+        top = mint_load_64_relaxed(&releasedBlockTop_);
+        mint_thread_fence_acquire();
+        blockIndex = ap_index(top);
+        if (blockIndex==NULL_NODE_INDEX)
+            return false;
+    } while (mint_compare_exchange_strong_64_relaxed(&releasedBlockTop_, top, make_abapointer(blockNext_[blockIndex],ap_count(top)+countIncrement_))!=top);
+
+    // link the block's nodes together and push them onto the freelist
+    nodeindex_t firstIndex = static_cast<nodeindex_t>(firstBlockNodePosition_ + (blockIndex - 1) * nodesPerBlock_ + 1);
+    nodeindex_t lastIndex = firstIndex + static_cast<nodeindex_t>(nodesPerBlock_ - 1);
+    for (nodeindex_t i=firstIndex; i < lastIndex; ++i)
+        node_next_lvalue(node_at_index(i)) = i + 1;
+
+    stack_push_chain(&top_, node_at_index(firstIndex), node_at_index(lastIndex));
+    return true;
+}
+
+size_t QwRawNodePool::park_node( size_t block, void *node )
+{
+    nodeindex_t nodeIndex = index_of_node(node);
+    mint_atomic64_t *slot = &parkedBlocks_[block];
+
+    // Only trim() pushes, and allocations only ever take the whole chain, so the
+    // slot can't return to a value that we have read: no ABA count is needed.
+    abapointer_t parked;
+    size_t count;
+    do {
+        parked = mint_load_64_relaxed(slot);
+        node_next_lvalue(node) = ap_index(parked);
+        mint_thread_fence_release();
+        count = static_cast<size_t>(ap_count(parked) / countIncrement_) + 1;
+    } while (mint_compare_exchange_strong_64_relaxed(slot, parked, make_abapointer(nodeIndex, count * countIncrement_))!=parked);
+
+    return count;
+}
+
+QwRawNodePool::nodeindex_t QwRawNodePool::take_parked_chain( size_t block, size_t& count )
+{
+    mint_atomic64_t *slot = &parkedBlocks_[block];
+
+    abapointer_t parked;
+    do {
+        parked = mint_load_64_relaxed(slot);
+        if (ap_index(parked)==NULL_NODE_INDEX)
+            return NULL_NODE_INDEX;
+    } while (mint_compare_exchange_strong_64_relaxed(slot, parked, make_abapointer(NULL_NODE_INDEX, 0))!=parked);
+    mint_thread_fence_acquire();
+
+    count = static_cast<size_t>(ap_count(parked) / countIncrement_);
+    return ap_index(parked);
+}
+
+bool QwRawNodePool::unpark_block( size_t block )
+{
+    size_t count = 0;
+    nodeindex_t frontIndex = take_parked_chain(block, count);
+    if (frontIndex==NULL_NODE_INDEX)
+        return false;
+
+    void *front = node_at_index(frontIndex);
+    void *back = front;
+    for (size_t i=1; i < count; ++i)
+        back = node_at_index(node_next(back));
+
+    stack_push_chain(&top_, front, back);
+    return true;
 }
 
+bool QwRawNodePool::reclaim_parked_nodes()
+{
+    if (mint_load_32_relaxed(&trimParking_) == 0)
+        return false;
+    mint_thread_fence_acquire(); // (pairs with the release fence in trim())
+
+    for (size_t block=0; block <= blockCount_; ++block) {
+        if (unpark_block(block))
+            return true;
+    }
+
+    return false;
+}
+
+size_t QwRawNodePool::trim()
+{
+    if (blockCount_ == 0 || (storageFlags_ & LOCKED_STORAGE))
+        return 0;
+
+    // From here on, allocations that find the freelist empty look for parked nodes.
+    // (The release fence orders the store before the CAS of our first pop from the freelist.
+    // An allocation that reads the emptied freelist and then acquires sees the store.)
+    mint_store_32_relaxed(&trimParking_, 1);
+    mint_thread_fence_release();
+
+    // Detach the freelist a block-sized run at a time, and park each detached node in its
+    // block's slot. We hold at most one run, and one full block while its pages are released.
+    // The number of runs is bounded so that trim() terminates under concurrent deallocation.
+    size_t result = 0;
+    size_t maxRunCount = maxNodeIndex_ / nodesPerBlock_ + 1;
+    for (size_t run=0; run < maxRunCount; ++run) {
+        size_t count = 0;
+        void *node = stack_pop_chain(&top_, nodesPerBlock_, count);
+        if (!node)
+            break;
+
+        for (size_t i=0; i < count; ++i) {
+            void *next = (i + 1 < count) ? node_at_index(node_next(node)) : 0; // (read before parking overwrites the link)
+
+            size_t block = block_of_node_index(index_of_node(node));
+            size_t parkedCount = park_node(block, node);
+            if (block != blockCount_ && parkedCount == nodesPerBlock_) {
+                // All of the block's nodes are parked. Take them back, unless an
+                // allocation got there first. (Only we park nodes, so if the slot
+                // isn't empty it still holds the whole block.)
+                if (take_parked_chain(block, parkedCount) != NULL_NODE_INDEX) {
+                    assert( parkedCount == nodesPerBlock_ );
+                    void *blockBegin = node_at_index(static_cast<nodeindex_t>(firstBlockNodePosition_ + block * nodesPerBlock_ + 1));
+                    if (qw_vm_release_pages(blockBegin, blockSize_))
+                        result += blockSize_;
+
+                    released_block_push(block);
+                }
+            }
+
+            node = next;
+        }
+    }
+
+    // return the nodes that are still parked to the freelist
+    for (size_t block=0; block <= blockCount_; ++block)
+        unpark_block(block);
+
+    mint_store_32_relaxed(&trimParking_, 0);
+
+    // allocations that found the freelist empty may be waiting for released blocks
+    notify_waiters(true);
+
+    return result;
+}
+
+void *QwRawNodePool::allocate_wait( int timeoutMs )
+{
+    void *result = allocate();
+    if (result)
+        return result;
+
+    uint64_t deadline = (timeoutMs >= 0) ? qw_monotonic_milliseconds() + static_cast<uint64_t>(timeoutMs) : 0;
+
+    for (;;) {
+        // read the epoch before registering, so that a push that happens after our
+        // final attempt below changes the epoch and qw_futex_wait returns immediately
+        uint32_t epoch = mint_load_32_relaxed(&wakeEpoch_);
+        mint_fetch_add_32_relaxed(&waiterCount_, 1);
+        qw_mint_thread_fence_seq_cst_after_rmw(); // (pairs with notify_waiters())
+
+        result = allocate();
+        if (result) {
+            mint_fetch_add_32_relaxed(&waiterCount_, -1);
+            return result;
+        }
+
+        int waitMs = QW_FUTEX_WAIT_FOREVER;
+        if (timeoutMs >= 0) {
+            uint64_t now = qw_monotonic_milliseconds();
+            waitMs = (now < deadline) ? static_cast<int>(deadline - now) : 0;
+        }
+
+        if (waitMs != 0)
+            qw_futex_wait(&wakeEpoch_, epoch, waitMs);
+
+        mint_fetch_add_32_relaxed(&waiterCount_, -1);
+
+        result = allocate();
+        if (result || waitMs == 0)
+            return result;
+    }
+}
+
+#ifdef QW_NODE_POOL_STATISTICS
+QwNodePoolStatistics QwRawNodePool::statistics_snapshot() const
+{
+    QwNodePoolStatistics result;
+    result.allocations = statistics_.sum(QwNodePoolStatisticsShards::ALLOCATIONS);
+    result.deallocations = statistics_.sum(QwNodePoolStatisticsShards::DEALLOCATIONS);
+    result.allocationFailures = statistics_.sum(QwNodePoolStatisticsShards::ALLOCATION_FAILURES);
+    result.pushRetries = statistics_.sum(QwNodePoolStatisticsShards::PUSH_RETRIES);
+    result.popRetries = statistics_.sum(QwNodePoolStatisticsShards::POP_RETRIES);
+    result.eliminations = statistics_.sum(QwNodePoolStatisticsShards::ELIMINATIONS);
+
+    // shards are read at different times, so deallocations may transiently exceed allocations
+    result.occupancy = (result.allocations > result.deallocations)
+            ? static_cast<size_t>(result.allocations - result.deallocations) : 0;
+
+    // allocate() only takes nodes from above the high-water mark when the freelist
+    // and depot are empty, so the high-water mark approximates (from above) peak occupancy.
+    result.highWaterOccupancy = high_water_mark();
+    result.capacity = maxNodeIndex_;
+    return result;
+}
+#endif
+
 QwRawNodePool::~QwRawNodePool()
 {
 #ifdef QW_DEBUG_COUNT_NODE_ALLOCATIONS
     assert( allocCount_._nonatomic == 0 );
 #endif
 
-    qw_aligned_free(nodeStorage_);
+    delete [] blockNext_;
+    delete [] parkedBlocks_;
+
+    if (ownsStorage_)
+        free_storage(nodeStorage_, storageSize_, storageFlags_);
 }
 
 /* -----------------------------------------------------------------------
@@ -146,5 +611,4 @@ Status: OK
 Comments:
 - constructor is a bit baroque
 - factor aligned allocation into a separate module
-- implement runtime cache line size query
 -------------------------------------------------------------------------- */
\ No newline at end of file
@@ -0,0 +1,77 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwNumaNodePool.h"
+
+#include <cassert>
+#include <new>
+
+#include "qw_cache_info.h"
+#include "qw_numa.h"
+#include "qw_vm.h"
+
+
+QwRawNumaNodePool::QwRawNumaNodePool( size_t nodeSize, size_t maxNodesPerNumaNode, int simulatedNumaNodeCount )
+{
+    bool simulated = (simulatedNumaNodeCount > 0);
+    numaNodeCount_ = (simulated) ? simulatedNumaNodeCount : qw_numa_node_count();
+
+    cpuCount_ = qw_cpu_count();
+    cpuToNumaNode_ = new int[cpuCount_];
+    for (int cpu=0; cpu < cpuCount_; ++cpu)
+        cpuToNumaNode_[cpu] = (simulated) ? (cpu % numaNodeCount_) : qw_numa_node_of_cpu(cpu);
+
+    // Each region contains the sub-pool object followed by its node storage.
+    // Regions are mapped directly from the OS (page aligned, untouched) so that
+    // they can be bound to a NUMA node before the first page fault.
+    size_t pageSize = qw_vm_page_size();
+    size_t lineSize = qw_cache_line_size();
+    size_t headerSize = (sizeof(QwRawNodePool) + lineSize - 1) & ~(lineSize - 1);
+    size_t storageSize = QwRawNodePool::storage_size(nodeSize, maxNodesPerNumaNode);
+    regionSize_ = (headerSize + storageSize + pageSize - 1) & ~(pageSize - 1);
+
+    subPools_ = new SubPool[numaNodeCount_];
+    for (int i=0; i < numaNodeCount_; ++i) {
+        SubPool& s = subPools_[i];
+        s.region = (int8_t*)qw_vm_allocate(regionSize_, 0, s.regionVmFlags);
+        assert( s.region != 0 );
+
+        // Bind before the sub-pool constructor first touches the memory.
+        // Binding failure is not an error: the memory is still usable, just not local.
+        if (!simulated && numaNodeCount_ > 1)
+            qw_numa_bind_memory(s.region, regionSize_, i);
+
+        s.storageBegin = s.region + headerSize;
+        s.storageEnd = s.storageBegin + storageSize;
+        s.pool = new (s.region) QwRawNodePool(nodeSize, maxNodesPerNumaNode, s.storageBegin);
+    }
+}
+
+QwRawNumaNodePool::~QwRawNumaNodePool()
+{
+    for (int i=0; i < numaNodeCount_; ++i) {
+        subPools_[i].pool->~QwRawNodePool();
+        qw_vm_free(subPools_[i].region, regionSize_, subPools_[i].regionVmFlags);
+    }
+
+    delete [] subPools_;
+    delete [] cpuToNumaNode_;
+}
@@ -0,0 +1,78 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwOwnerHeapNodePool.h"
+
+#include <cassert>
+
+#include "QwNodePool.h"
+
+
+QwRawOwnerHeapNodePool::QwRawOwnerHeapNodePool( size_t nodeSize, size_t nodesPerHeap, int heapCount, int storageFlags )
+{
+    assert( heapCount > 0 );
+    assert( nodesPerHeap > 0 );
+
+    nodeSize_ = QwRawNodePool::node_size(nodeSize);
+    nodesPerHeap_ = nodesPerHeap;
+    heapCount_ = heapCount;
+
+    // Slices are packed back to back, so that PREFAULTED_STORAGE and
+    // LOCKED_STORAGE only commit memory that can hold nodes. (Spacing the
+    // slices a power of two apart would make owner_of() a shift rather than a
+    // division, but would prefault and lock the gaps.)
+    sliceSize_ = nodeSize_ * nodesPerHeap_;
+
+    nodeStorage_ = (int8_t*)QwRawNodePool::allocate_storage(sliceSize_ * heapCount_, storageFlags, storageSize_, storageFlags_);
+    assert( nodeStorage_ != 0 );
+
+    heaps_ = new Heap[heapCount_];
+    for (int i=0; i < heapCount_; ++i) {
+        Heap& h = heaps_[i];
+        h.localHead = 0;
+        h.sliceBegin = nodeStorage_ + static_cast<size_t>(i) * sliceSize_;
+        h.freshCount = 0;
+    }
+}
+
+QwRawOwnerHeapNodePool::~QwRawOwnerHeapNodePool()
+{
+    delete [] heaps_;
+    QwRawNodePool::free_storage(nodeStorage_, storageSize_, storageFlags_);
+}
+
+void *QwRawOwnerHeapNodePool::allocate_slow( Heap& h )
+{
+    // the local freelist is empty. reclaim nodes that other threads have freed
+    if (!h.remoteFrees.empty()) {
+        RawNode *result = h.remoteFrees.pop_all();
+        if (result) {
+            h.localHead = node_next(result);
+            return result;
+        }
+    }
+
+    // take a never-allocated node
+    if (h.freshCount < nodesPerHeap_)
+        return h.sliceBegin + (h.freshCount++) * nodeSize_;
+
+    return 0;
+}
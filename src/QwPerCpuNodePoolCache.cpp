@@ -0,0 +1,127 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwPerCpuNodePoolCache.h"
+
+#include <cassert>
+
+#include "qw_aligned_malloc.h"
+#include "qw_cache_info.h"
+#include "qw_numa.h"
+
+
+QwRawPerCpuNodePoolCache::QwRawPerCpuNodePoolCache( QwRawNodePool& pool, size_t batchSize )
+    : pool_( pool )
+    , batchSize_( batchSize )
+{
+    assert( batchSize_ > 0 && batchSize_ <= CPU_STACK_CAPACITY );
+
+    cpuCount_ = qw_cpu_count();
+    // The stacks are allocated at run time, so they can be spaced by the false sharing
+    // granularity of the machine we're running on rather than the compile-time guess.
+    size_t falseSharingSize = qw_false_sharing_size();
+    cpuStackStride_ = (sizeof(CpuStack) + falseSharingSize - 1) & ~(falseSharingSize - 1);
+    cpuStacks_ = static_cast<int8_t*>(qw_aligned_malloc(cpuStackStride_ * cpuCount_, falseSharingSize));
+    assert( cpuStacks_ != 0 );
+
+    for (int i=0; i < cpuCount_; ++i)
+        cpu_stack(i).count = 0;
+}
+
+QwRawPerCpuNodePoolCache::~QwRawPerCpuNodePoolCache()
+{
+    flush();
+    qw_aligned_free(cpuStacks_);
+}
+
+void *QwRawPerCpuNodePoolCache::allocate_slow()
+{
+    if (!is_per_cpu_available())
+        return pool_.allocate();
+
+    // The current CPU's stack is empty. Refill it with a batch of nodes from the pool.
+    size_t count = 0;
+    void *result = pool_.allocate_chain(batchSize_, count);
+    if (!result)
+        return 0;
+
+    void *p = QwRawNodePool::chain_next(result);
+    while (p) {
+        void *next = QwRawNodePool::chain_next(p);
+        if (!cpu_stack_push(p)) {
+            // Another thread refilled the stack, or we migrated to a CPU with a full stack.
+            // Give the rest of the batch back.
+            void *back = p;
+            while (QwRawNodePool::chain_next(back))
+                back = QwRawNodePool::chain_next(back);
+            pool_.deallocate_chain(p, back);
+            break;
+        }
+        p = next;
+    }
+
+    return result;
+}
+
+void QwRawPerCpuNodePoolCache::deallocate_slow( void *node )
+{
+    if (is_per_cpu_available()) {
+        // The current CPU's stack is full. Move a batch of nodes to the pool,
+        // then try again to keep the (cache-hot) node on this CPU.
+        void *front = cpu_stack_pop();
+        if (front) {
+            void *back = front;
+            QwRawNodePool::chain_next(back) = 0;
+            for (size_t i=1; i < batchSize_; ++i) {
+                void *p = cpu_stack_pop();
+                if (!p)
+                    break;
+                QwRawNodePool::chain_next(p) = front;
+                front = p;
+            }
+            pool_.deallocate_chain(front, back);
+        }
+
+        if (cpu_stack_push(node))
+            return;
+    }
+
+    pool_.deallocate(node);
+}
+
+void QwRawPerCpuNodePoolCache::flush()
+{
+    for (int i=0; i < cpuCount_; ++i) {
+        CpuStack& s = cpu_stack(i);
+        if (s.count == 0)
+            continue;
+
+        void *back = s.nodes[0];
+        void *front = back;
+        QwRawNodePool::chain_next(back) = 0;
+        for (intptr_t j=1; j < s.count; ++j) {
+            QwRawNodePool::chain_next(s.nodes[j]) = front;
+            front = s.nodes[j];
+        }
+        pool_.deallocate_chain(front, back);
+        s.count = 0;
+    }
+}
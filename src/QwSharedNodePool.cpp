@@ -0,0 +1,119 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwSharedNodePool.h"
+
+#include <cassert>
+
+#include "QwNodePool.h"
+#include "qw_vm.h"
+
+
+static int segmentFlagsToVmFlags( int segmentFlags )
+{
+    return ((segmentFlags & QwRawSharedNodePool::CREATE_SEGMENT) ? QW_VM_SHARED_CREATE : 0)
+            | ((segmentFlags & QwRawSharedNodePool::FILE_SEGMENT) ? QW_VM_SHARED_FILE : 0);
+}
+
+size_t QwRawSharedNodePool::segment_size( size_t nodeSize, size_t maxNodes )
+{
+    // the header is a multiple of the cache line size, so nodes are cache line aligned
+    return sizeof(SegmentHeader) + QwRawNodePool::storage_size(nodeSize, maxNodes);
+}
+
+QwRawSharedNodePool::QwRawSharedNodePool( const char *name, int segmentFlags, size_t nodeSize, size_t maxNodes )
+    : header_( 0 )
+    , segmentSize_( 0 )
+    , nodeArrayBase_( 0 )
+    , nodeSize_( 0 )
+    , maxNodeIndex_( 0 )
+{
+    layout_.init_index_end(1); // (until map_header())
+
+    assert( sizeof(SegmentHeader) % CACHE_LINE_SIZE == 0 );
+
+    if (segmentFlags & CREATE_SEGMENT) {
+        assert( maxNodes > 0 );
+
+        size_t size = segment_size(nodeSize, maxNodes);
+        SegmentHeader *header = static_cast<SegmentHeader*>(qw_vm_map_shared(name, segmentFlagsToVmFlags(segmentFlags), size));
+        if (!header)
+            return;
+
+        header->layoutVersion = SEGMENT_LAYOUT_VERSION;
+        header->nodeSize = QwRawNodePool::node_size(nodeSize);
+        header->maxNodes = maxNodes;
+        header->top._nonatomic = NULL_NODE_INDEX; // (count 0)
+        header->bumpIndex._nonatomic = 1; // all nodes are above the high-water mark
+        header->allocCount._nonatomic = 0;
+
+        // publish the header to processes that open the segment
+        mint_thread_fence_release();
+        mint_store_32_relaxed(&header->magic, SEGMENT_MAGIC);
+
+        map_header(header, size);
+    } else {
+        size_t size = 0;
+        SegmentHeader *header = static_cast<SegmentHeader*>(qw_vm_map_shared(name, segmentFlagsToVmFlags(segmentFlags), size));
+        if (!header)
+            return;
+
+        // the segment may still be being initialized by its creator, or may not be a pool at all
+        bool valid = (size >= sizeof(SegmentHeader) && mint_load_32_relaxed(&header->magic) == SEGMENT_MAGIC);
+        mint_thread_fence_acquire();
+        if (valid) {
+            valid = (header->layoutVersion == SEGMENT_LAYOUT_VERSION
+                    && header->nodeSize == QwRawNodePool::node_size(static_cast<size_t>(header->nodeSize))
+                    && size >= segment_size(static_cast<size_t>(header->nodeSize), static_cast<size_t>(header->maxNodes)));
+        }
+
+        if (!valid) {
+            qw_vm_unmap_shared(header, size);
+            return;
+        }
+
+        map_header(header, size);
+    }
+}
+
+void QwRawSharedNodePool::map_header( void *segment, size_t segmentSize )
+{
+    header_ = static_cast<SegmentHeader*>(segment);
+    segmentSize_ = segmentSize;
+
+    nodeSize_ = static_cast<size_t>(header_->nodeSize);
+    maxNodeIndex_ = header_->maxNodes; // node indices are 1-based
+    nodeArrayBase_ = reinterpret_cast<int8_t*>(header_ + 1) - nodeSize_;
+
+    // the same (count,index) packing as QwRawNodePool. All processes compute the same masks.
+    layout_.init(maxNodeIndex_);
+}
+
+QwRawSharedNodePool::~QwRawSharedNodePool()
+{
+    if (header_)
+        qw_vm_unmap_shared(header_, segmentSize_);
+}
+
+bool QwRawSharedNodePool::remove_segment( const char *name, int segmentFlags )
+{
+    return qw_vm_remove_shared(name, segmentFlagsToVmFlags(segmentFlags));
+}
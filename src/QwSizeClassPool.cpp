@@ -0,0 +1,102 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwSizeClassPool.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "qw_freelist.h"
+#include "qw_vm.h"
+
+
+// class sizes in cache lines: 1, 2, 3, 4, 6, 8, 12, 16, 24, 32 ...
+static size_t nextClassLineCount(size_t lineCount)
+{
+    if (lineCount == 1)
+        return 2;
+    else if ((lineCount & (lineCount-1)) == 0) // power of two
+        return lineCount + (lineCount/2);
+    else
+        return lineCount + (lineCount/3);
+}
+
+QwSizeClassPool::QwSizeClassPool( size_t maxAllocationSize, size_t bytesPerClass, int vmFlags )
+{
+    assert( maxAllocationSize > 0 );
+
+    size_t maxLineCount = (maxAllocationSize + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE;
+
+    classCount_ = 1;
+    size_t lineCount = 1;
+    while (lineCount < maxLineCount) {
+        lineCount = nextClassLineCount(lineCount);
+        ++classCount_;
+    }
+    maxLineCount = lineCount;
+    maxAllocationSize_ = maxLineCount * CACHE_LINE_SIZE;
+    assert( classCount_ <= 256 ); // class indices are stored in uint8_t
+
+    // build the size class table
+    classSizes_ = new size_t[classCount_];
+    classOfLineCount_ = new uint8_t[maxLineCount + 1];
+    classOfLineCount_[0] = 0;
+    lineCount = 1;
+    size_t tableIndex = 1;
+    for (size_t i=0; i < classCount_; ++i) {
+        classSizes_[i] = lineCount * CACHE_LINE_SIZE;
+        for (; tableIndex <= lineCount; ++tableIndex)
+            classOfLineCount_[tableIndex] = static_cast<uint8_t>(i);
+        lineCount = nextClassLineCount(lineCount);
+    }
+
+    // allocate the arena, one power-of-two sized region per class
+    size_t regionSize = qw_round_up_to_power_of_two(std::max(bytesPerClass, maxAllocationSize_));
+    regionBitShift_ = 0;
+    while ((static_cast<size_t>(1) << regionBitShift_) < regionSize)
+        ++regionBitShift_;
+
+    arenaSize_ = regionSize * classCount_;
+    size_t hugePageSize = qw_vm_huge_page_size();
+    if ((vmFlags & QW_VM_HUGE_PAGES) && hugePageSize != 0)
+        arenaSize_ = (arenaSize_ + hugePageSize - 1) & ~(hugePageSize - 1);
+    arena_ = static_cast<int8_t*>(qw_vm_allocate(arenaSize_, vmFlags, arenaVmFlags_));
+    assert( arena_ != 0 );
+
+    classPools_ = new QwRawNodePool*[classCount_];
+    for (size_t i=0; i < classCount_; ++i) {
+        // (nodes are larger than the class size if the machine's cache lines are larger than CACHE_LINE_SIZE)
+        size_t nodeCount = regionSize / QwRawNodePool::node_size(classSizes_[i]);
+        classPools_[i] = new QwRawNodePool(classSizes_[i], nodeCount, arena_ + (i << regionBitShift_));
+    }
+}
+
+QwSizeClassPool::~QwSizeClassPool()
+{
+    for (size_t i=0; i < classCount_; ++i)
+        delete classPools_[i];
+    delete [] classPools_;
+
+    qw_vm_free(arena_, arenaSize_, arenaVmFlags_);
+
+    delete [] classOfLineCount_;
+    delete [] classSizes_;
+}
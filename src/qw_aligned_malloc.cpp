@@ -0,0 +1,59 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "qw_aligned_malloc.h"
+
+#include <cstdlib>
+#ifdef WIN32
+#include <malloc.h>
+#endif
+
+
+#ifdef WIN32
+
+void *qw_aligned_malloc( size_t size, size_t alignment )
+{
+    return _aligned_malloc(size, alignment);
+}
+
+void qw_aligned_free( void *memblock )
+{
+    _aligned_free(memblock);    
+}
+
+#else
+
+void *qw_aligned_malloc( size_t size, size_t alignment )
+{
+    void *result = 0;
+    
+    if (posix_memalign(&result, alignment, size)!=0)
+        result = 0;
+    
+    return result;
+}
+
+void qw_aligned_free( void *memblock )
+{
+    free(memblock);
+}
+
+#endif
@@ -0,0 +1,316 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "qw_cache_info.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "QwConfig.h"
+#include "qw_futex.h"
+
+#if defined(WIN32)
+
+#define NOMINMAX
+#include <windows.h>
+#include <intrin.h>
+#include <vector>
+
+#elif defined(__APPLE__)
+
+#include <sys/types.h>
+#include <sys/sysctl.h>
+
+#else
+
+#include <cstdio>
+#include <unistd.h>
+
+#endif
+
+#if (defined(__i386__) || defined(__x86_64__)) && !defined(WIN32)
+#include <cpuid.h>
+#endif
+
+#undef max
+#undef min
+
+namespace {
+
+    bool isPowerOfTwo( size_t x ) { return x != 0 && (x & (x - 1)) == 0; }
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+    // regs receives eax, ebx, ecx, edx. returns false if the leaf isn't supported
+    bool cpuid( unsigned int leaf, unsigned int regs[4] )
+    {
+#if defined(WIN32)
+        int r[4];
+        __cpuid(r, 0);
+        if (static_cast<unsigned int>(r[0]) < leaf)
+            return false;
+        __cpuid(r, static_cast<int>(leaf));
+        for (int i=0; i < 4; ++i)
+            regs[i] = static_cast<unsigned int>(r[i]);
+        return true;
+#else
+        return __get_cpuid(leaf, &regs[0], &regs[1], &regs[2], &regs[3]) != 0;
+#endif
+    }
+
+    // CLFLUSH line size from cpuid leaf 1. 0 if unknown
+    size_t cpuidLineSize()
+    {
+        unsigned int regs[4];
+        if (!cpuid(1, regs))
+            return 0;
+        return ((regs[1] >> 8) & 0xFF) * 8;
+    }
+
+    // Whether the L2 prefetches lines in aligned pairs. This depends on the processor family,
+    // and isn't reported by cpuid, so it is inferred from the vendor and family: Intel since
+    // the P6 family (the "spatial" or adjacent line prefetcher), and AMD since Zen (family 17h).
+    // Whether the prefetcher is enabled is only visible to the kernel (an MSR), so we assume
+    // that it is, which is the default.
+    bool cpuidAdjacentLinePrefetch()
+    {
+        unsigned int regs[4];
+        if (!cpuid(0, regs))
+            return false;
+        char vendor[13];
+        std::memcpy(vendor, &regs[1], 4); // (the vendor string is in ebx, edx, ecx)
+        std::memcpy(vendor + 4, &regs[3], 4);
+        std::memcpy(vendor + 8, &regs[2], 4);
+        vendor[12] = 0;
+
+        if (!cpuid(1, regs))
+            return false;
+        unsigned int family = (regs[0] >> 8) & 0xF;
+        if (family == 0xF)
+            family += (regs[0] >> 20) & 0xFF; // extended family
+
+        if (std::strcmp(vendor, "GenuineIntel") == 0)
+            return family >= 6;
+        if (std::strcmp(vendor, "AuthenticAMD") == 0 || std::strcmp(vendor, "HygonGenuine") == 0)
+            return family >= 0x17;
+        return false;
+    }
+#else
+    size_t cpuidLineSize() { return 0; }
+    bool cpuidAdjacentLinePrefetch() { return false; }
+#endif
+
+#if defined(WIN32)
+
+    void queryCacheInfo( QwCacheInfo& info )
+    {
+        DWORD length = 0;
+        GetLogicalProcessorInformation(0, &length);
+        if (length == 0)
+            return;
+
+        std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> buffer(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION) + 1);
+        if (!GetLogicalProcessorInformation(&buffer[0], &length))
+            return;
+
+        for (size_t i=0; i < length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION); ++i) {
+            if (buffer[i].Relationship != RelationCache)
+                continue;
+
+            const CACHE_DESCRIPTOR& cache = buffer[i].Cache;
+            switch (cache.Level) {
+            case 1:
+                if (cache.Type == CacheData || cache.Type == CacheUnified) {
+                    info.lineSize = cache.LineSize;
+                    info.l1DataSize = cache.Size;
+                }
+                break;
+            case 2:
+                info.l2Size = cache.Size;
+                break;
+            case 3:
+                info.l3Size = cache.Size;
+                break;
+            }
+        }
+    }
+
+#elif defined(__APPLE__)
+
+    size_t sysctlSize( const char *name )
+    {
+        int64_t value = 0;
+        size_t size = sizeof(value);
+        if (sysctlbyname(name, &value, &size, 0, 0) != 0)
+            return 0;
+        return (size == sizeof(int32_t)) ? static_cast<size_t>(*reinterpret_cast<int32_t*>(&value)) : static_cast<size_t>(value);
+    }
+
+    void queryCacheInfo( QwCacheInfo& info )
+    {
+        info.lineSize = sysctlSize("hw.cachelinesize");
+        info.l1DataSize = sysctlSize("hw.l1dcachesize");
+        info.l2Size = sysctlSize("hw.l2cachesize");
+        info.l3Size = sysctlSize("hw.l3cachesize");
+    }
+
+#else /* Linux and other POSIX */
+
+    size_t sysconfSize( int name )
+    {
+        long value = sysconf(name);
+        return (value > 0) ? static_cast<size_t>(value) : 0;
+    }
+
+#if defined(__linux__)
+    // Read a sysfs value such as "64" or "32K". Returns 0 on failure.
+    size_t readSysfsSize( int index, const char *attribute )
+    {
+        char path[128];
+        std::sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/%s", index, attribute);
+
+        FILE *f = std::fopen(path, "r");
+        if (!f)
+            return 0;
+
+        unsigned long value = 0;
+        char suffix = 0;
+        int n = std::fscanf(f, "%lu%c", &value, &suffix);
+        std::fclose(f);
+
+        if (n < 1)
+            return 0;
+        if (n == 2 && suffix == 'K')
+            value *= 1024;
+        else if (n == 2 && suffix == 'M')
+            value *= 1024 * 1024;
+        return static_cast<size_t>(value);
+    }
+
+    bool readSysfsType( int index, char *type, size_t typeSize )
+    {
+        char path[128];
+        std::sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/type", index);
+
+        FILE *f = std::fopen(path, "r");
+        if (!f)
+            return false;
+
+        bool result = (std::fgets(type, static_cast<int>(typeSize), f) != 0);
+        std::fclose(f);
+        return result;
+    }
+#endif
+
+    void queryCacheInfo( QwCacheInfo& info )
+    {
+        // glibc derives these from cpuid on x86. they are 0 on many other architectures
+#ifdef _SC_LEVEL1_DCACHE_LINESIZE
+        info.lineSize = sysconfSize(_SC_LEVEL1_DCACHE_LINESIZE);
+        info.l1DataSize = sysconfSize(_SC_LEVEL1_DCACHE_SIZE);
+        info.l2Size = sysconfSize(_SC_LEVEL2_CACHE_SIZE);
+        info.l3Size = sysconfSize(_SC_LEVEL3_CACHE_SIZE);
+#endif
+
+#if defined(__linux__)
+        // fill in the gaps from sysfs
+        for (int index=0; index < 8; ++index) {
+            size_t level = readSysfsSize(index, "level");
+            if (level == 0)
+                break;
+
+            char type[32];
+            if (!readSysfsType(index, type, sizeof(type)) || type[0] == 'I') // (skip the instruction cache)
+                continue;
+
+            size_t size = readSysfsSize(index, "size");
+            if (level == 1) {
+                if (info.lineSize == 0)
+                    info.lineSize = readSysfsSize(index, "coherency_line_size");
+                if (info.l1DataSize == 0)
+                    info.l1DataSize = size;
+            } else if (level == 2 && info.l2Size == 0) {
+                info.l2Size = size;
+            } else if (level == 3 && info.l3Size == 0) {
+                info.l3Size = size;
+            }
+        }
+#endif
+    }
+
+#endif
+
+    QwCacheInfo computeCacheInfo()
+    {
+        QwCacheInfo info;
+        info.lineSize = 0;
+        info.falseSharingSize = 0;
+        info.l1DataSize = 0;
+        info.l2Size = 0;
+        info.l3Size = 0;
+
+        queryCacheInfo(info);
+
+        if (info.lineSize == 0)
+            info.lineSize = cpuidLineSize();
+
+        // nodes are aligned to lineSize, so it must be a power of two. it is never less
+        // than CACHE_LINE_SIZE, the alignment that layouts are compiled for
+        if (!isPowerOfTwo(info.lineSize) || info.lineSize < CACHE_LINE_SIZE)
+            info.lineSize = CACHE_LINE_SIZE;
+
+        info.falseSharingSize = (cpuidAdjacentLinePrefetch()) ? 2 * info.lineSize : info.lineSize;
+
+        return info;
+    }
+
+} // end anonymous namespace
+
+// The info is computed once, by the first caller. (A function-local static would do, but
+// its initialization isn't thread-safe with MSVC 2010.) cacheInfoState_ is zero-initialized
+// before any code runs, so this is safe to call during static initialization too.
+namespace {
+
+    enum { CACHE_INFO_UNINITIALIZED=0, CACHE_INFO_INITIALIZING=1, CACHE_INFO_READY=2 };
+    mint_atomic32_t cacheInfoState_;
+    QwCacheInfo cacheInfo_;
+
+} // end anonymous namespace
+
+const QwCacheInfo& qw_cache_info()
+{
+    uint32_t state = mint_load_32_relaxed(&cacheInfoState_);
+    if (state != CACHE_INFO_READY) {
+        if (state == CACHE_INFO_UNINITIALIZED
+                && mint_compare_exchange_strong_32_relaxed(&cacheInfoState_, CACHE_INFO_UNINITIALIZED, CACHE_INFO_INITIALIZING) == CACHE_INFO_UNINITIALIZED) {
+            cacheInfo_ = computeCacheInfo();
+            mint_thread_fence_release();
+            mint_store_32_relaxed(&cacheInfoState_, CACHE_INFO_READY);
+            qw_futex_wake_all(&cacheInfoState_);
+        } else {
+            // another thread is computing the info. (a brief wait, the first call is not real-time safe anyway)
+            while ((state = mint_load_32_relaxed(&cacheInfoState_)) != CACHE_INFO_READY)
+                qw_futex_wait(&cacheInfoState_, state, QW_FUTEX_WAIT_FOREVER);
+        }
+    }
+
+    mint_thread_fence_acquire();
+    return cacheInfo_;
+}
@@ -0,0 +1,108 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "qw_futex.h"
+
+#if defined(WIN32)
+
+#define NOMINMAX
+#include <windows.h>
+
+#pragma comment(lib, "Synchronization.lib") // WaitOnAddress, WakeByAddressSingle/All (Windows 8 and later)
+
+void qw_futex_wait( mint_atomic32_t *address, uint32_t expected, int timeoutMs )
+{
+    WaitOnAddress(const_cast<uint32_t*>(&address->_nonatomic), &expected, sizeof(expected),
+            (timeoutMs < 0) ? INFINITE : static_cast<DWORD>(timeoutMs));
+}
+
+void qw_futex_wake_one( mint_atomic32_t *address )
+{
+    WakeByAddressSingle(const_cast<uint32_t*>(&address->_nonatomic));
+}
+
+void qw_futex_wake_all( mint_atomic32_t *address )
+{
+    WakeByAddressAll(const_cast<uint32_t*>(&address->_nonatomic));
+}
+
+uint64_t qw_monotonic_milliseconds()
+{
+    return GetTickCount64();
+}
+
+#else /* POSIX */
+
+#include <ctime>
+
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+void qw_futex_wait( mint_atomic32_t *address, uint32_t expected, int timeoutMs )
+{
+#if defined(__linux__)
+    struct timespec timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+    // (the timeout is relative for FUTEX_WAIT)
+    syscall(SYS_futex, &address->_nonatomic, FUTEX_WAIT_PRIVATE, expected, (timeoutMs < 0) ? 0 : &timeout, 0, 0);
+#else
+    // no futex. poll
+    if (mint_load_32_relaxed(address) == expected) {
+        struct timespec interval;
+        interval.tv_sec = 0;
+        interval.tv_nsec = ((timeoutMs >= 0 && timeoutMs < 1) ? timeoutMs : 1) * 1000000L;
+        nanosleep(&interval, 0);
+    }
+#endif
+}
+
+void qw_futex_wake_one( mint_atomic32_t *address )
+{
+#if defined(__linux__)
+    syscall(SYS_futex, &address->_nonatomic, FUTEX_WAKE_PRIVATE, 1, 0, 0, 0);
+#else
+    (void)address;
+#endif
+}
+
+void qw_futex_wake_all( mint_atomic32_t *address )
+{
+#if defined(__linux__)
+    syscall(SYS_futex, &address->_nonatomic, FUTEX_WAKE_PRIVATE, 0x7FFFFFFF, 0, 0, 0);
+#else
+    (void)address;
+#endif
+}
+
+uint64_t qw_monotonic_milliseconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000 + static_cast<uint64_t>(now.tv_nsec) / 1000000;
+}
+
+#endif
@@ -0,0 +1,174 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "qw_numa.h"
+
+#if defined(__linux__)
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace {
+
+    enum { MAX_NUMA_NODES = 1024 }; // (the kernel's largest MAX_NUMNODES)
+
+    // Read a list in the sysfs "cpulist" format (e.g. "0-3,8,10-11") and
+    // return one more than the largest value in the list, or 0 on failure.
+    // If member is non-negative, found is set to whether member is in the list.
+    // If values is non-null, the first maxValues values in the list are stored
+    // in values (in ascending order) and valueCount receives the number stored.
+    int readSysfsList( const char *path, int member, bool& found,
+            int *values=0, int maxValues=0, int *valueCount=0 )
+    {
+        found = false;
+        if (valueCount)
+            *valueCount = 0;
+
+        FILE *f = std::fopen(path, "r");
+        if (!f)
+            return 0;
+
+        char buf[4096];
+        size_t n = std::fread(buf, 1, sizeof(buf)-1, f);
+        std::fclose(f);
+        buf[n] = 0;
+
+        int result = 0;
+        char *p = buf;
+        while (*p >= '0' && *p <= '9') {
+            long first = std::strtol(p, &p, 10);
+            long last = first;
+            if (*p == '-') {
+                ++p;
+                last = std::strtol(p, &p, 10);
+            }
+
+            if (member >= first && member <= last)
+                found = true;
+            if (last + 1 > result)
+                result = static_cast<int>(last + 1);
+
+            if (values) {
+                for (long i=first; i <= last && *valueCount < maxValues; ++i)
+                    values[(*valueCount)++] = static_cast<int>(i);
+            }
+
+            if (*p == ',')
+                ++p;
+        }
+
+        return result;
+    }
+
+    // The operating system's ids of the online NUMA nodes, in ascending order.
+    // Ids may be sparse (e.g. "0,2"). Returns the number of nodes, 0 if unknown.
+    int onlineNumaNodeIds( int *ids )
+    {
+        bool found;
+        int count = 0;
+        readSysfsList("/sys/devices/system/node/online", -1, found, ids, MAX_NUMA_NODES, &count);
+        return count;
+    }
+
+} // end anonymous namespace
+
+int qw_numa_node_count()
+{
+    int ids[MAX_NUMA_NODES];
+    int result = onlineNumaNodeIds(ids);
+    return (result > 0) ? result : 1;
+}
+
+int qw_cpu_count()
+{
+    bool found;
+    int result = readSysfsList("/sys/devices/system/cpu/possible", -1, found);
+    if (result <= 0)
+        result = static_cast<int>(sysconf(_SC_NPROCESSORS_CONF));
+    return (result > 0) ? result : 1;
+}
+
+int qw_numa_node_of_cpu( int cpu )
+{
+    int ids[MAX_NUMA_NODES];
+    int nodeCount = onlineNumaNodeIds(ids);
+    for (int node=0; node < nodeCount; ++node) {
+        char path[128];
+        std::sprintf(path, "/sys/devices/system/node/node%d/cpulist", ids[node]);
+        bool found;
+        readSysfsList(path, cpu, found);
+        if (found)
+            return node;
+    }
+    return 0;
+}
+
+int qw_current_cpu()
+{
+    return sched_getcpu();
+}
+
+bool qw_numa_bind_memory( void *p, size_t size, int numaNode )
+{
+#ifdef SYS_mbind
+    int ids[MAX_NUMA_NODES];
+    int nodeCount = onlineNumaNodeIds(ids);
+    if (numaNode < 0 || numaNode >= nodeCount)
+        return false;
+    int nodeId = ids[numaNode];
+
+    const int bitsPerWord = 8*sizeof(unsigned long);
+    enum { QW_MPOL_PREFERRED=1, MASK_WORDS=MAX_NUMA_NODES/(8*sizeof(unsigned long)) };
+    if (nodeId >= MASK_WORDS*bitsPerWord)
+        return false;
+
+    unsigned long nodeMask[MASK_WORDS];
+    std::memset(nodeMask, 0, sizeof(nodeMask));
+    nodeMask[nodeId / bitsPerWord] = 1UL << (nodeId % bitsPerWord);
+
+    // MPOL_PREFERRED rather than MPOL_BIND: if the node runs out of memory
+    // we'd rather get remote memory than fail.
+    // maxnode is one more than the number of bits in the mask, see mbind(2).
+    return syscall(SYS_mbind, p, size, QW_MPOL_PREFERRED, nodeMask, MASK_WORDS*bitsPerWord + 1, 0) == 0;
+#else
+    (void)p; (void)size; (void)numaNode;
+    return false;
+#endif
+}
+
+#else /* !__linux__ */
+
+int qw_numa_node_count() { return 1; }
+
+int qw_cpu_count() { return 1; }
+
+int qw_numa_node_of_cpu( int ) { return 0; }
+
+int qw_current_cpu() { return -1; }
+
+bool qw_numa_bind_memory( void *, size_t, int ) { return false; }
+
+#endif
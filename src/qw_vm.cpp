@@ -0,0 +1,345 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "qw_vm.h"
+
+#include <cstring>
+
+#include "mintomic/mintomic.h"
+
+#if defined(WIN32)
+
+#define NOMINMAX
+#include <windows.h>
+
+size_t qw_vm_page_size()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+}
+
+size_t qw_vm_huge_page_size()
+{
+    return GetLargePageMinimum();
+}
+
+void *qw_vm_allocate( size_t size, int flags, int& appliedFlags )
+{
+    appliedFlags = 0;
+    void *result = 0;
+
+    if (flags & QW_VM_HUGE_PAGES) {
+        // requires SeLockMemoryPrivilege. large pages are always locked and committed.
+        size_t hugePageSize = qw_vm_huge_page_size();
+        if (hugePageSize != 0 && (size % hugePageSize) == 0) {
+            result = VirtualAlloc(0, size, MEM_RESERVE|MEM_COMMIT|MEM_LARGE_PAGES, PAGE_READWRITE);
+            if (result)
+                appliedFlags |= QW_VM_HUGE_PAGES | (flags & (QW_VM_PREFAULT|QW_VM_LOCK));
+        }
+    }
+
+    if (!result) {
+        result = VirtualAlloc(0, size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+        if (!result)
+            return 0;
+
+        if (flags & QW_VM_LOCK) {
+            if (VirtualLock(result, size))
+                appliedFlags |= QW_VM_LOCK | QW_VM_PREFAULT;
+        }
+
+        if ((flags & QW_VM_PREFAULT) && !(appliedFlags & QW_VM_PREFAULT)) {
+            size_t pageSize = qw_vm_page_size();
+            for (size_t i=0; i < size; i += pageSize)
+                static_cast<volatile char*>(result)[i] = 0;
+            appliedFlags |= QW_VM_PREFAULT;
+        }
+    }
+
+    return result;
+}
+
+void qw_vm_free( void *p, size_t size, int appliedFlags )
+{
+    if (appliedFlags & QW_VM_LOCK)
+        VirtualUnlock(p, size);
+    VirtualFree(p, 0, MEM_RELEASE);
+}
+
+bool qw_vm_release_pages( void *p, size_t size )
+{
+    return VirtualAlloc(p, size, MEM_RESET, PAGE_READWRITE) != 0;
+}
+
+void *qw_vm_map_shared( const char *name, int flags, size_t& size )
+{
+    HANDLE file = INVALID_HANDLE_VALUE;
+    if (flags & QW_VM_SHARED_FILE) {
+        file = CreateFileA(name, GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE, 0,
+                (flags & QW_VM_SHARED_CREATE) ? CREATE_NEW : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+        if (file == INVALID_HANDLE_VALUE)
+            return 0;
+    }
+
+    HANDLE mapping;
+    if (flags & (QW_VM_SHARED_CREATE|QW_VM_SHARED_FILE)) {
+        ULARGE_INTEGER mappingSize;
+        mappingSize.QuadPart = (flags & QW_VM_SHARED_CREATE) ? size : 0; // (0 maps the whole file)
+        mapping = CreateFileMappingA(file, 0, PAGE_READWRITE, mappingSize.HighPart, mappingSize.LowPart,
+                (flags & QW_VM_SHARED_FILE) ? 0 : name);
+        if (mapping && !(flags & QW_VM_SHARED_FILE) && GetLastError() == ERROR_ALREADY_EXISTS) {
+            CloseHandle(mapping);
+            mapping = 0;
+        }
+    } else {
+        mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+    }
+
+    if (file != INVALID_HANDLE_VALUE)
+        CloseHandle(file); // the mapping holds a reference to the file
+    if (!mapping)
+        return 0;
+
+    void *result = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    CloseHandle(mapping); // the view holds a reference to the mapping
+
+    if (result && !(flags & QW_VM_SHARED_CREATE)) {
+        MEMORY_BASIC_INFORMATION info;
+        VirtualQuery(result, &info, sizeof(info));
+        size = info.RegionSize;
+    }
+
+    return result;
+}
+
+void qw_vm_unmap_shared( void *p, size_t )
+{
+    UnmapViewOfFile(p);
+}
+
+bool qw_vm_remove_shared( const char *name, int flags )
+{
+    if (flags & QW_VM_SHARED_FILE)
+        return DeleteFileA(name) != 0;
+
+    return true; // named mappings are removed when the last view is unmapped
+}
+
+#else /* POSIX */
+
+#include <cstdio>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+size_t qw_vm_page_size()
+{
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+#if defined(__linux__)
+namespace {
+
+    // the huge page size plus one, or 0 if /proc/meminfo hasn't been read yet.
+    // zero-initialized before any code runs
+    mint_atomic64_t hugePageSizePlusOne_;
+
+    size_t readHugePageSize()
+    {
+        size_t result = 0;
+        if (std::FILE *f = std::fopen("/proc/meminfo", "r")) {
+            char line[256];
+            while (std::fgets(line, sizeof(line), f)) {
+                unsigned long kb = 0;
+                if (std::sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+                    result = static_cast<size_t>(kb) * 1024;
+                    break;
+                }
+            }
+            std::fclose(f);
+        }
+        return result;
+    }
+
+} // end anonymous namespace
+#endif
+
+size_t qw_vm_huge_page_size()
+{
+#if defined(__linux__)
+    // Threads that race on the first call each read /proc/meminfo, and store the same value.
+    uint64_t sizePlusOne = mint_load_64_relaxed(&hugePageSizePlusOne_);
+    if (sizePlusOne == 0) {
+        sizePlusOne = static_cast<uint64_t>(readHugePageSize()) + 1;
+        mint_store_64_relaxed(&hugePageSizePlusOne_, sizePlusOne);
+    }
+    return static_cast<size_t>(sizePlusOne - 1);
+#else
+    return 0;
+#endif
+}
+
+namespace {
+
+    void *mapAnonymous( size_t size, int extraFlags )
+    {
+        void *result = mmap(0, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|extraFlags, -1, 0);
+        return (result == MAP_FAILED) ? 0 : result;
+    }
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    // map size bytes aligned to alignment by over-allocating and trimming the excess
+    void *mapAnonymousAligned( size_t size, size_t alignment )
+    {
+        char *p = static_cast<char*>(mapAnonymous(size + alignment, 0));
+        if (!p)
+            return 0;
+
+        char *aligned = reinterpret_cast<char*>((reinterpret_cast<size_t>(p) + alignment - 1) & ~(alignment - 1));
+        if (aligned != p)
+            munmap(p, aligned - p);
+        size_t tail = (p + size + alignment) - (aligned + size);
+        if (tail != 0)
+            munmap(aligned + size, tail);
+
+        return aligned;
+    }
+#endif
+
+} // end anonymous namespace
+
+void *qw_vm_allocate( size_t size, int flags, int& appliedFlags )
+{
+    appliedFlags = 0;
+    void *result = 0;
+
+#if defined(__linux__)
+    if (flags & QW_VM_HUGE_PAGES) {
+        size_t hugePageSize = qw_vm_huge_page_size();
+        if (hugePageSize != 0 && (size % hugePageSize) == 0) {
+#ifdef MAP_HUGETLB
+            // explicit huge pages. fails unless the administrator has reserved some
+            result = mapAnonymous(size, MAP_HUGETLB | ((flags & (QW_VM_PREFAULT|QW_VM_LOCK)) ? MAP_POPULATE : 0));
+            if (result)
+                appliedFlags |= QW_VM_HUGE_PAGES | ((flags & (QW_VM_PREFAULT|QW_VM_LOCK)) ? QW_VM_PREFAULT : 0);
+#endif
+#ifdef MADV_HUGEPAGE
+            if (!result) {
+                // transparent huge pages. align the mapping so that the kernel can use huge pages throughout
+                result = mapAnonymousAligned(size, hugePageSize);
+                if (result && madvise(result, size, MADV_HUGEPAGE) == 0)
+                    appliedFlags |= QW_VM_HUGE_PAGES;
+            }
+#endif
+        }
+    }
+#endif
+
+    if (!result) {
+        result = mapAnonymous(size, 0);
+        if (!result)
+            return 0;
+    }
+
+    if (flags & QW_VM_LOCK) {
+        // mlock faults in the pages
+        if (mlock(result, size) == 0)
+            appliedFlags |= QW_VM_LOCK | QW_VM_PREFAULT;
+    }
+
+    if ((flags & (QW_VM_PREFAULT|QW_VM_LOCK)) && !(appliedFlags & QW_VM_PREFAULT)) {
+        // write to every page. reading is not enough, it maps the shared zero page
+        size_t pageSize = qw_vm_page_size();
+        for (size_t i=0; i < size; i += pageSize)
+            static_cast<volatile char*>(result)[i] = 0;
+        appliedFlags |= QW_VM_PREFAULT;
+    }
+
+    return result;
+}
+
+void qw_vm_free( void *p, size_t size, int appliedFlags )
+{
+    if (appliedFlags & QW_VM_LOCK)
+        munlock(p, size);
+    munmap(p, size);
+}
+
+bool qw_vm_release_pages( void *p, size_t size )
+{
+#if defined(MADV_DONTNEED)
+    // (on Linux, MADV_DONTNEED drops the pages immediately. MADV_FREE would only drop them under memory pressure)
+    return madvise(p, size, MADV_DONTNEED) == 0;
+#else
+    (void)p; (void)size;
+    return false;
+#endif
+}
+
+void *qw_vm_map_shared( const char *name, int flags, size_t& size )
+{
+    int openFlags = O_RDWR | ((flags & QW_VM_SHARED_CREATE) ? (O_CREAT|O_EXCL) : 0);
+    int fd = (flags & QW_VM_SHARED_FILE) ? open(name, openFlags, 0600) : shm_open(name, openFlags, 0600);
+    if (fd == -1)
+        return 0;
+
+    bool sized;
+    if (flags & QW_VM_SHARED_CREATE) {
+        sized = (ftruncate(fd, static_cast<off_t>(size)) == 0); // (new pages are zero filled)
+    } else {
+        struct stat st;
+        sized = (fstat(fd, &st) == 0 && st.st_size > 0);
+        if (sized)
+            size = static_cast<size_t>(st.st_size);
+    }
+
+    void *result = 0;
+    if (sized) {
+        result = mmap(0, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        if (result == MAP_FAILED)
+            result = 0;
+    }
+    close(fd); // the mapping holds a reference to the file
+
+    if (!result && (flags & QW_VM_SHARED_CREATE))
+        qw_vm_remove_shared(name, flags);
+
+    return result;
+}
+
+void qw_vm_unmap_shared( void *p, size_t size )
+{
+    munmap(p, size);
+}
+
+bool qw_vm_remove_shared( const char *name, int flags )
+{
+    return (((flags & QW_VM_SHARED_FILE) ? unlink(name) : shm_unlink(name)) == 0);
+}
+
+#endif
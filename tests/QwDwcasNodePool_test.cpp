@@ -0,0 +1,110 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwDwcasNodePool.h"
+#include "QwSList.h"
+#include "QwSTailList.h"
+
+#include "catch.hpp"
+
+#if QW_HAVE_ATOMIC128
+
+namespace {
+
+    struct TestNode{
+        TestNode *links_[2];
+        enum { LINK_INDEX_1, LINK_COUNT };
+
+        int value;
+
+        TestNode()
+            : value( 0 )
+        {
+            for( int i=0; i < LINK_COUNT; ++i )
+                links_[i] = 0;
+        }
+    };
+
+    typedef QwNodePool<TestNode, QwRawDwcasNodePool> dwcas_node_pool_t;
+    typedef QwSList<TestNode*, TestNode::LINK_INDEX_1> node_slist_t;
+    typedef QwSTailList<TestNode*, TestNode::LINK_INDEX_1> node_stail_list_t;
+
+} // end anonymous namespace
+
+TEST_CASE( "qw/dwcas_node_pool", "QwRawDwcasNodePool single threaded test" ) {
+
+    const size_t maxNodes = 20;
+    dwcas_node_pool_t pool(maxNodes);
+    REQUIRE( pool.high_water_mark() == 0 );
+
+    TestNode *nodes[maxNodes];
+    for (size_t i=0; i < maxNodes; ++i) {
+        nodes[i] = pool.allocate();
+        REQUIRE( nodes[i] != 0 );
+        REQUIRE( (reinterpret_cast<uintptr_t>(nodes[i]) & (CACHE_LINE_SIZE-1)) == 0 );
+        nodes[i]->value = (int)i;
+    }
+    REQUIRE( pool.high_water_mark() == maxNodes );
+    REQUIRE( pool.allocate() == 0 );
+
+    for (size_t i=0; i < maxNodes; ++i)
+        REQUIRE( nodes[i]->value == (int)i );
+
+    // LIFO reuse
+    pool.deallocate(nodes[3]);
+    pool.deallocate(nodes[7]);
+    REQUIRE( pool.allocate() == nodes[7] );
+    REQUIRE( pool.allocate() == nodes[3] );
+
+    for (size_t i=0; i < maxNodes; ++i)
+        pool.deallocate(nodes[i]);
+}
+
+TEST_CASE( "qw/dwcas_node_pool/batch", "QwRawDwcasNodePool allocate_n and deallocate_all" ) {
+
+    const size_t maxNodes = 20;
+    dwcas_node_pool_t pool(maxNodes);
+
+    node_slist_t slist;
+    node_stail_list_t tailList;
+
+    // never-allocated nodes
+    REQUIRE( pool.allocate_n(5, slist) == 5 );
+    REQUIRE( pool.high_water_mark() == 5 );
+
+    // freed nodes, topped up with never-allocated nodes
+    pool.deallocate_all(slist);
+    REQUIRE( slist.empty() );
+    REQUIRE( pool.allocate_n(8, tailList) == 8 );
+    REQUIRE( pool.high_water_mark() == 8 );
+
+    REQUIRE( pool.allocate_n(maxNodes, slist) == maxNodes - 8 );
+    REQUIRE( pool.allocate() == 0 );
+    REQUIRE( pool.allocate_n(1, slist) == 0 );
+
+    pool.deallocate_all(tailList);
+    pool.deallocate_all(slist);
+
+    REQUIRE( pool.allocate_n(maxNodes, tailList) == maxNodes );
+    pool.deallocate_all(tailList);
+}
+
+#endif /* QW_HAVE_ATOMIC128 */
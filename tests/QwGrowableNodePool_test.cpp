@@ -0,0 +1,108 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwGrowableNodePool.h"
+#include "QwSList.h"
+
+#include "catch.hpp"
+
+
+namespace {
+
+    struct TestNode{
+        TestNode *links_[2];
+        enum { LINK_INDEX_1, LINK_COUNT };
+
+        int value;
+
+        TestNode()
+            : value( 0 )
+        {
+            for( int i=0; i < LINK_COUNT; ++i )
+                links_[i] = 0;
+        }
+    };
+
+    typedef QwSList<TestNode*, TestNode::LINK_INDEX_1> node_slist_t;
+
+    size_t allocateAll( QwGrowableNodePool<TestNode>& pool, node_slist_t& allocatedNodes )
+    {
+        size_t result = 0;
+        while (TestNode *n = pool.allocate()) {
+            n->value = (int)result;
+            allocatedNodes.push_front(n);
+            ++result;
+        }
+        return result;
+    }
+
+} // end anonymous namespace
+
+TEST_CASE( "qw/growable_node_pool", "QwGrowableNodePool single threaded test" ) {
+
+    size_t segmentNodeCount = 16;
+    size_t maxSegments = 4;
+
+    QwGrowableNodePool<TestNode> pool( segmentNodeCount, maxSegments );
+
+    size_t nodesPerSegment = pool.nodes_per_segment();
+    REQUIRE( nodesPerSegment == segmentNodeCount-1 );
+    REQUIRE( pool.active_segment_count() == 1 );
+
+    node_slist_t allocatedNodes;
+
+    REQUIRE( allocateAll(pool, allocatedNodes) == nodesPerSegment );
+
+    // grow() makes a new segment available immediately
+    REQUIRE( pool.grow() == true );
+    REQUIRE( pool.active_segment_count() == 2 );
+    REQUIRE( allocateAll(pool, allocatedNodes) == nodesPerSegment );
+
+    // reserved segments are activated by allocate() when the freelist is empty
+    REQUIRE( pool.reserve(2) == true );
+    REQUIRE( pool.allocated_segment_count() == 4 );
+    REQUIRE( pool.active_segment_count() == 2 );
+    REQUIRE( allocateAll(pool, allocatedNodes) == 2*nodesPerSegment );
+    REQUIRE( pool.active_segment_count() == 4 );
+
+    // upper bound
+    REQUIRE( pool.grow() == false );
+    REQUIRE( pool.reserve(1) == false );
+    REQUIRE( pool.allocate() == 0 );
+
+    // all nodes are distinct
+    size_t count = 0;
+    for (node_slist_t::iterator i=allocatedNodes.begin(); i!=allocatedNodes.end(); ++i) {
+        REQUIRE( (*i)->value >= 0 );
+        (*i)->value = -1;
+        ++count;
+    }
+    REQUIRE( count == maxSegments*nodesPerSegment );
+
+    while (!allocatedNodes.empty())
+        pool.deallocate(allocatedNodes.pop_front());
+
+    // freed nodes can be reallocated
+    REQUIRE( allocateAll(pool, allocatedNodes) == maxSegments*nodesPerSegment );
+
+    while (!allocatedNodes.empty())
+        pool.deallocate(allocatedNodes.pop_front());
+}
@@ -0,0 +1,122 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwMpmcBoundedQueue.h"
+
+#include "catch.hpp"
+
+
+namespace {
+
+    struct TestNode{
+        int value;
+
+        TestNode()
+            : value( 0 ) {}
+    };
+
+    typedef QwMpmcBoundedQueue<TestNode*> mpmc_bounded_queue_t;
+
+} // end anonymous namespace
+
+
+TEST_CASE( "qw/mpmc_bounded_queue", "QwMpmcBoundedQueue single threaded test" ) {
+
+    TestNode nodes[4];
+    TestNode *a = &nodes[0];
+    TestNode *b = &nodes[1];
+    TestNode *c = &nodes[2];
+    TestNode *d = &nodes[3];
+
+    mpmc_bounded_queue_t q(3);
+    REQUIRE( q.capacity() == 4 ); // rounded up to a power of two
+    {
+        mpmc_bounded_queue_t minimal0(0), minimal1(1); // (at least 2 slots)
+        REQUIRE( minimal0.capacity() == 2 );
+        REQUIRE( minimal1.capacity() == 2 );
+    }
+
+    REQUIRE( q.empty() == true );
+    REQUIRE( q.try_pop() == 0 );
+
+    // bool try_push( node_ptr_type n )
+    // node_ptr_type try_pop()
+
+    REQUIRE( q.try_push( a ) == true );
+    REQUIRE( q.empty() == false );
+    REQUIRE( q.try_pop() == a );
+    REQUIRE( q.empty() == true );
+
+    // fill to capacity
+    REQUIRE( q.try_push( a ) == true );
+    REQUIRE( q.try_push( b ) == true );
+    REQUIRE( q.try_push( c ) == true );
+    REQUIRE( q.try_push( d ) == true );
+    REQUIRE( q.try_push( a ) == false ); // full
+
+    REQUIRE( q.try_pop() == a );
+    REQUIRE( q.try_push( a ) == true ); // wraps around
+    REQUIRE( q.try_push( a ) == false );
+
+    REQUIRE( q.try_pop() == b );
+    REQUIRE( q.try_pop() == c );
+    REQUIRE( q.try_pop() == d );
+    REQUIRE( q.try_pop() == a );
+    REQUIRE( q.try_pop() == 0 );
+    REQUIRE( q.empty() == true );
+}
+
+TEST_CASE( "qw/mpmc_bounded_queue/laps", "QwMpmcBoundedQueue FIFO order over many laps of the ring" ) {
+
+    const int NODE_COUNT = 100;
+    TestNode nodes[NODE_COUNT];
+    for (int i=0; i < NODE_COUNT; ++i)
+        nodes[i].value = i;
+
+    mpmc_bounded_queue_t q(8);
+
+    int pushed = 0;
+    int popped = 0;
+    for (int round=0; round < 10; ++round) {
+        // push up to 5, pop up to 3, so the queue fills and the positions lap the ring
+        for (int i=0; i < 5; ++i) {
+            if (q.try_push(&nodes[pushed % NODE_COUNT])) {
+                ++pushed;
+            } else {
+                int count = pushed - popped;
+                REQUIRE( count == (int)q.capacity() );
+            }
+        }
+
+        for (int i=0; i < 3; ++i) {
+            TestNode *n = q.try_pop();
+            REQUIRE( n != 0 );
+            REQUIRE( n->value == popped % NODE_COUNT );
+            ++popped;
+        }
+    }
+
+    while (TestNode *n = q.try_pop()) {
+        REQUIRE( n->value == popped % NODE_COUNT );
+        ++popped;
+    }
+    REQUIRE( popped == pushed );
+}
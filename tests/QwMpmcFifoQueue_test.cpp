@@ -0,0 +1,357 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwMpmcFifoQueue.h"
+
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "catch.hpp"
+
+#if QW_HAVE_ATOMIC128
+
+namespace {
+
+    struct TestNode{
+        TestNode *links_[2];
+        enum { LINK_INDEX_1, LINK_INDEX_2, LINK_COUNT };
+
+        int value;
+
+        TestNode()
+            : value( 0 )
+        {
+            for( int i=0; i < LINK_COUNT; ++i )
+                links_[i] = 0;
+        }
+    };
+
+    typedef QwMpmcFifoQueue<TestNode*, TestNode::LINK_INDEX_1> mpmc_fifo_queue_t;
+    typedef QwMpmcFifoQueue<TestNode*, TestNode::LINK_INDEX_2> mpmc_fifo_queue_2_t;
+
+    TestNode*& next_(TestNode*n) { return n->links_[TestNode::LINK_INDEX_1]; }
+
+    struct StressNode{
+        StressNode *links_[1];
+        enum { LINK_INDEX_1, LINK_COUNT };
+
+        int producer;
+        int sequence;                   // position in the producer's push order
+        mint_atomic32_t dequeueCount;
+
+        StressNode()
+            : producer( 0 )
+            , sequence( 0 )
+        {
+            links_[0] = 0;
+            dequeueCount._nonatomic = 0;
+        }
+    };
+
+    typedef QwMpmcFifoQueue<StressNode*, StressNode::LINK_INDEX_1> stress_queue_t;
+
+    // state shared by the producers and consumers of a stress test
+    struct StressTest {
+        stress_queue_t queue;
+        int producerCount;
+        int nodesPerProducer;
+        std::vector<StressNode> nodes; // producer p pushes nodes [p*nodesPerProducer, (p+1)*nodesPerProducer)
+        mint_atomic32_t started;        // threads spin until this is set, so that they start together
+        mint_atomic32_t popCount;
+
+        StressTest( int producerCount_, int nodesPerProducer_ )
+            : producerCount( producerCount_ )
+            , nodesPerProducer( nodesPerProducer_ )
+            , nodes( producerCount_ * nodesPerProducer_ )
+        {
+            for (int p=0; p < producerCount; ++p) {
+                for (int i=0; i < nodesPerProducer; ++i) {
+                    StressNode& n = nodes[p * nodesPerProducer + i];
+                    n.producer = p;
+                    n.sequence = i;
+                }
+            }
+            started._nonatomic = 0;
+            popCount._nonatomic = 0;
+        }
+    };
+
+    // pushes one producer's nodes, or pops nodes until every node has been popped
+    class StressThread {
+        StressTest& test_;
+        int producer_;                  // the producer id, or -1 for a consumer
+        int orderErrors_;               // consumer: nodes that arrived out of their producer's order
+        int popped_;
+
+        void produce()
+        {
+            StressNode *nodes = &test_.nodes[producer_ * test_.nodesPerProducer];
+            for (int i=0; i < test_.nodesPerProducer; ) {
+                if (i % 3 == 0 && i + 1 < test_.nodesPerProducer) {
+                    // push a pair of nodes with push_multiple
+                    nodes[i].links_[0] = &nodes[i + 1];
+                    test_.queue.push_multiple(&nodes[i], &nodes[i + 1]);
+                    i += 2;
+                } else {
+                    test_.queue.push(&nodes[i]);
+                    ++i;
+                }
+            }
+        }
+
+        void consume()
+        {
+            std::vector<int> lastSequence(test_.producerCount, -1);
+            uint32_t total = static_cast<uint32_t>(test_.nodes.size());
+            while (mint_load_32_relaxed(&test_.popCount) < total) {
+                StressNode *n = test_.queue.pop();
+                if (!n)
+                    continue;
+
+                // FIFO: a consumer sees each producer's nodes in push order
+                if (n->sequence <= lastSequence[n->producer])
+                    ++orderErrors_;
+                lastSequence[n->producer] = n->sequence;
+
+                mint_fetch_add_32_relaxed(&n->dequeueCount, 1);
+                mint_fetch_add_32_relaxed(&test_.popCount, 1);
+                ++popped_;
+            }
+        }
+
+        void run()
+        {
+            while (mint_load_32_relaxed(&test_.started) == 0)
+                ;
+            if (producer_ >= 0)
+                produce();
+            else
+                consume();
+        }
+
+#if defined(_WIN32)
+        HANDLE thread_;
+        static DWORD WINAPI threadMain( LPVOID p ) { static_cast<StressThread*>(p)->run(); return 0; }
+#else
+        pthread_t thread_;
+        static void *threadMain( void *p ) { static_cast<StressThread*>(p)->run(); return 0; }
+#endif
+
+    public:
+        StressThread( StressTest& test, int producer )
+            : test_( test )
+            , producer_( producer )
+            , orderErrors_( 0 )
+            , popped_( 0 )
+        {
+#if defined(_WIN32)
+            thread_ = CreateThread(0, 0, threadMain, this, 0, 0);
+#else
+            pthread_create(&thread_, 0, threadMain, this);
+#endif
+        }
+
+        void join()
+        {
+#if defined(_WIN32)
+            WaitForSingleObject(thread_, INFINITE);
+            CloseHandle(thread_);
+#else
+            pthread_join(thread_, 0);
+#endif
+        }
+
+        int order_errors() const { return orderErrors_; }
+        int popped() const { return popped_; }
+    };
+
+} // end anonymous namespace
+
+
+TEST_CASE( "qw/mpmc_fifo_queue", "QwMpmcFifoQueue single threaded test" ) {
+
+    TestNode nodes[4];
+    TestNode *a = &nodes[0];
+    TestNode *b = &nodes[1];
+    TestNode *c = &nodes[2];
+    TestNode *d = &nodes[3];
+
+    mpmc_fifo_queue_t q;
+
+    REQUIRE( q.empty() == true );
+    REQUIRE( q.pop() == 0 );
+
+    // void push( node_ptr_type n )
+    // bool empty() const
+    // node_ptr_type pop()
+
+    q.push( a );
+    REQUIRE( q.empty() == false );
+    REQUIRE( q.pop() == a );
+    REQUIRE( q.empty() == true );
+    REQUIRE( q.pop() == 0 );
+
+    q.push( a );
+    q.push( b );
+    q.push( c );
+
+    REQUIRE( q.empty() == false );
+    REQUIRE( q.pop() == a );
+    REQUIRE( q.pop() == b );
+    q.push( a ); // interleave pushes with pops
+    REQUIRE( q.pop() == c );
+    REQUIRE( q.pop() == a );
+    REQUIRE( q.empty() == true );
+    REQUIRE( q.pop() == 0 );
+
+#ifdef QW_VALIDATE_NODE_LINKS
+    // popped nodes have their links cleared
+    for (int i=0; i < 4; ++i)
+        REQUIRE( next_(&nodes[i]) == 0 );
+#endif
+
+    // void push_multiple( node_ptr_type front, node_ptr_type back )
+
+    // front is popped first
+    next_(a) = b;
+    next_(b) = c;
+    next_(c) = 0;
+    q.push_multiple( a, c );
+    q.push_multiple( d, d );
+
+    REQUIRE( q.pop() == a );
+    REQUIRE( q.pop() == b );
+    REQUIRE( q.pop() == c );
+    REQUIRE( q.pop() == d );
+    REQUIRE( q.pop() == 0 );
+}
+
+TEST_CASE( "qw/mpmc_fifo_queue/repush", "QwMpmcFifoQueue pushing popped nodes again" ) {
+
+    // (without QW_VALIDATE_NODE_LINKS a popped node keeps its link. push() must not follow it)
+    TestNode nodes[2];
+    TestNode *a = &nodes[0];
+    TestNode *b = &nodes[1];
+
+    mpmc_fifo_queue_t q;
+
+    q.push( a );
+    REQUIRE( q.pop() == a );
+    q.push( a );
+    REQUIRE( q.pop() == a );
+    REQUIRE( q.pop() == 0 );
+
+    // a is popped while it links to b, then pushed again as the last element
+    q.push( a );
+    q.push( b );
+    REQUIRE( q.pop() == a );
+    q.push( a );
+    REQUIRE( q.pop() == b );
+    REQUIRE( q.pop() == a );
+    REQUIRE( q.pop() == 0 );
+    REQUIRE( q.empty() );
+}
+
+TEST_CASE( "qw/mpmc_fifo_queue/link_index", "QwMpmcFifoQueue with a link that isn't the first member" ) {
+
+    const int NODE_COUNT = 100;
+    TestNode nodes[NODE_COUNT];
+    for (int i=0; i < NODE_COUNT; ++i)
+        nodes[i].value = i;
+
+    mpmc_fifo_queue_2_t q;
+
+    // the queue repeatedly runs dry, so the stub is recycled many times
+    for (int round=0; round < 3; ++round) {
+        for (int i=0; i < NODE_COUNT; ++i) {
+            q.push( &nodes[i] );
+            if (i % 3 == 0) {
+                TestNode *n = q.pop();
+                REQUIRE( n != 0 );
+            }
+        }
+
+        while (TestNode *n = q.pop()) {
+#ifdef QW_VALIDATE_NODE_LINKS
+            REQUIRE( n->links_[TestNode::LINK_INDEX_2] == 0 );
+#else
+            (void)n;
+#endif
+        }
+
+        REQUIRE( q.empty() );
+    }
+
+    // FIFO order
+    for (int i=0; i < NODE_COUNT; ++i)
+        q.push( &nodes[i] );
+    for (int i=0; i < NODE_COUNT; ++i)
+        REQUIRE( q.pop()->value == i );
+    REQUIRE( q.pop() == 0 );
+}
+
+TEST_CASE( "qw/mpmc_fifo_queue/stress", "QwMpmcFifoQueue multiple producers and consumers" ) {
+
+    const int producerCount = 4;
+    const int consumerCount = 4;
+    const int nodesPerProducer = 100000;
+
+    StressTest test(producerCount, nodesPerProducer);
+
+    std::vector<StressThread*> threads;
+    for (int p=0; p < producerCount; ++p)
+        threads.push_back(new StressThread(test, p));
+    for (int c=0; c < consumerCount; ++c)
+        threads.push_back(new StressThread(test, -1));
+
+    mint_store_32_relaxed(&test.started, 1);
+
+    int orderErrors = 0;
+    int popped = 0;
+    for (size_t i=0; i < threads.size(); ++i) {
+        threads[i]->join();
+        orderErrors += threads[i]->order_errors();
+        popped += threads[i]->popped();
+        delete threads[i];
+    }
+    mint_thread_fence_acquire();
+
+    REQUIRE( orderErrors == 0 );
+    REQUIRE( popped == producerCount * nodesPerProducer );
+
+    // every node was dequeued exactly once
+    int wrongCount = 0;
+    for (size_t i=0; i < test.nodes.size(); ++i) {
+        if (test.nodes[i].dequeueCount._nonatomic != 1)
+            ++wrongCount;
+    }
+    REQUIRE( wrongCount == 0 );
+
+    REQUIRE( test.queue.pop() == 0 );
+    REQUIRE( test.queue.empty() );
+}
+
+#endif /* QW_HAVE_ATOMIC128 */
@@ -117,3 +117,92 @@ TEST_CASE( "qw/mpsc_fifo_queue", "QwMpscFifoQueue single threaded test" ) {
     REQUIRE( q.pop() == c );
     REQUIRE( q.pop() == d );
 }
+
+
+namespace {
+
+    struct DrainRecorder{
+        TestNode **out_;
+
+        DrainRecorder( TestNode **out ) : out_( out ) {}
+
+        void operator()( TestNode *n ) { *out_++ = n; }
+    };
+
+    int drainSum_ = 0;
+    void sumDrainedValue( TestNode *n ) { drainSum_ += n->value; }
+
+} // end anonymous namespace
+
+
+TEST_CASE( "qw/mpsc_fifo_queue/pop_all_fifo", "QwMpscFifoQueue pop_all_fifo() and drain()" ) {
+
+    TestNode nodes[4];
+    TestNode *a = &nodes[0];
+    TestNode *b = &nodes[1];
+    TestNode *c = &nodes[2];
+    TestNode *d = &nodes[3];
+
+    mpsc_fifo_queue_t q;
+
+    // fifo_list_type pop_all_fifo()
+
+    REQUIRE( q.pop_all_fifo().empty() == true );
+
+    q.push( a );
+    q.push( b );
+    q.push( c );
+    {
+        mpsc_fifo_queue_t::fifo_list_type all = q.pop_all_fifo();
+        REQUIRE( q.consumer_empty() == true );
+        REQUIRE( all.front() == a );
+        REQUIRE( all.back() == c );
+        REQUIRE( all.pop_front() == a );
+        REQUIRE( all.pop_front() == b );
+        REQUIRE( all.pop_front() == c );
+        REQUIRE( all.empty() == true );
+    }
+
+    // nodes left in the consumer's local queue by pop() come first
+
+    q.push( a );
+    q.push( b );
+    REQUIRE( q.pop() == a ); // b is now in the local queue
+    q.push( c );
+    q.push( d );
+    {
+        mpsc_fifo_queue_t::fifo_list_type all = q.pop_all_fifo();
+        REQUIRE( all.pop_front() == b );
+        REQUIRE( all.pop_front() == c );
+        REQUIRE( all.pop_front() == d );
+        REQUIRE( all.empty() == true );
+    }
+    REQUIRE( q.consumer_empty() == true );
+
+    // template<typename F> size_t drain( F f, size_t maxCount )
+
+    TestNode *drained[4] = { 0, 0, 0, 0 };
+    REQUIRE( q.drain( DrainRecorder(drained), 4 ) == 0 );
+
+    q.push( a );
+    q.push( b );
+    q.push( c );
+    REQUIRE( q.drain( DrainRecorder(drained), 2 ) == 2 );
+    REQUIRE( drained[0] == a );
+    REQUIRE( drained[1] == b );
+
+    q.push( d );
+    REQUIRE( q.drain( DrainRecorder(drained), 4 ) == 2 );
+    REQUIRE( drained[0] == c );
+    REQUIRE( drained[1] == d );
+    REQUIRE( q.consumer_empty() == true );
+
+    for( int i=0; i < 4; ++i ){
+        nodes[i].value = i + 1;
+        q.push( &nodes[i] );
+    }
+    drainSum_ = 0;
+    REQUIRE( q.drain( sumDrainedValue, 10 ) == 4 );
+    REQUIRE( drainSum_ == 10 );
+    REQUIRE( q.consumer_empty() == true );
+}
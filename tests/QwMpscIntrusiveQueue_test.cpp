@@ -0,0 +1,258 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwMpscIntrusiveQueue.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "QwMpscFifoQueue.h"
+
+#include "catch.hpp"
+
+
+namespace {
+
+    struct TestNode{
+        TestNode *links_[2];
+        enum { LINK_INDEX_1, LINK_INDEX_2, LINK_COUNT };
+
+        int value;
+
+        TestNode()
+            : value( 0 )
+        {
+            for( int i=0; i < LINK_COUNT; ++i )
+                links_[i] = 0;
+        }
+    };
+
+    typedef QwMpscIntrusiveQueue<TestNode*, TestNode::LINK_INDEX_1> mpsc_intrusive_queue_t;
+    typedef QwMpscIntrusiveQueue<TestNode*, TestNode::LINK_INDEX_2> mpsc_intrusive_queue_2_t;
+
+    TestNode*& next_(TestNode*n) { return n->links_[TestNode::LINK_INDEX_1]; }
+
+    uint64_t nowNanoseconds()
+    {
+#if defined(_WIN32)
+        LARGE_INTEGER frequency, now;
+        QueryPerformanceFrequency(&frequency);
+        QueryPerformanceCounter(&now);
+        return static_cast<uint64_t>(now.QuadPart * (1000000000.0 / frequency.QuadPart));
+#else
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return static_cast<uint64_t>(now.tv_sec) * 1000000000 + static_cast<uint64_t>(now.tv_nsec);
+#endif
+    }
+
+    // pushes burstCount bursts of burstSize nodes, timing each pop() that drains them.
+    // prints the median, p99, p99.9 and maximum pop() latency in nanoseconds.
+    template<typename QueueT>
+    void measureBurstPopLatency( const char *queueName, int burstSize, int burstCount )
+    {
+        std::vector<TestNode> nodes(burstSize);
+        std::vector<uint64_t> latencies;
+        latencies.reserve(static_cast<size_t>(burstSize) * burstCount);
+
+        QueueT q;
+        int misordered = 0;
+        for (int i=0; i < burstCount; ++i) {
+            for (int j=0; j < burstSize; ++j)
+                q.push( &nodes[j] );
+
+            for (int j=0; j < burstSize; ++j) {
+                uint64_t start = nowNanoseconds();
+                TestNode *n = q.pop();
+                uint64_t end = nowNanoseconds();
+                if (n != &nodes[j])
+                    ++misordered;
+                latencies.push_back(end - start);
+            }
+        }
+        REQUIRE( misordered == 0 );
+        REQUIRE( q.consumer_empty() );
+
+        std::sort(latencies.begin(), latencies.end());
+        size_t count = latencies.size();
+        std::printf("%-22s %6d %8d %8d %8d %10d\n", queueName, burstSize,
+                (int)latencies[count / 2], (int)latencies[count * 99 / 100],
+                (int)latencies[count * 999 / 1000], (int)latencies[count - 1]);
+    }
+
+} // end anonymous namespace
+
+
+TEST_CASE( "qw/mpsc_intrusive_queue", "QwMpscIntrusiveQueue single threaded test" ) {
+
+    TestNode nodes[4];
+    TestNode *a = &nodes[0];
+    TestNode *b = &nodes[1];
+    TestNode *c = &nodes[2];
+    TestNode *d = &nodes[3];
+
+    mpsc_intrusive_queue_t q;
+
+    REQUIRE( q.consumer_empty() == true );
+    REQUIRE( q.pop() == 0 );
+
+    // void push( node_ptr_type n )
+    // bool consumer_empty() const
+    // node_ptr_type pop()
+
+    q.push( a );
+    REQUIRE( q.consumer_empty() == false );
+    REQUIRE( q.pop() == a );
+    REQUIRE( q.consumer_empty() == true );
+
+    q.push( a );
+    q.push( b );
+    q.push( c );
+
+    REQUIRE( q.consumer_empty() == false );
+    REQUIRE( q.pop() == a );
+    REQUIRE( q.pop() == b );
+    REQUIRE( q.pop() == c );
+    REQUIRE( q.consumer_empty() == true );
+
+    // void push( node_ptr_type n, bool& wasEmpty )
+
+    bool wasEmpty = false;
+    q.push( a, wasEmpty );
+    REQUIRE( wasEmpty == true );
+
+    q.push( b, wasEmpty );
+    REQUIRE( wasEmpty == false );
+
+    REQUIRE( q.consumer_empty() == false );
+    REQUIRE( q.pop() == a );
+
+    q.push( c, wasEmpty );
+    REQUIRE( wasEmpty == false ); // (QwMpscFifoQueue gets this wrong)
+
+    REQUIRE( q.pop() == b );
+    REQUIRE( q.pop() == c );
+    REQUIRE( q.consumer_empty() == true );
+
+    // void push_multiple( node_ptr_type front, node_ptr_type back, bool& wasEmpty )
+
+    // As with QwMpscFifoQueue, the last item in the list (a) is the first to be popped.
+    next_(c) = b;
+    next_(b) = a;
+    next_(a) = 0;
+    wasEmpty=false;
+    q.push_multiple( c, a, wasEmpty );
+    REQUIRE( wasEmpty == true );
+    q.push_multiple( d, d, wasEmpty );
+    REQUIRE( wasEmpty == false );
+
+    REQUIRE( q.pop() == a );
+    REQUIRE( q.pop() == b );
+    REQUIRE( q.pop() == c );
+    REQUIRE( q.pop() == d );
+    REQUIRE( q.pop() == 0 );
+    REQUIRE( q.consumer_empty() == true );
+}
+
+TEST_CASE( "qw/mpsc_intrusive_queue/repush", "QwMpscIntrusiveQueue pushing popped nodes again" ) {
+
+    // (without QW_VALIDATE_NODE_LINKS a popped node keeps its link. push() must not follow it)
+    TestNode nodes[2];
+    TestNode *a = &nodes[0];
+    TestNode *b = &nodes[1];
+
+    mpsc_intrusive_queue_t q;
+
+    // a is popped while it links to b, then pushed again as the last element
+    q.push( a );
+    q.push( b );
+    REQUIRE( q.pop() == a );
+    q.push( a );
+    REQUIRE( q.pop() == b );
+    REQUIRE( q.pop() == a );
+    REQUIRE( q.pop() == 0 );
+    REQUIRE( q.consumer_empty() == true );
+
+    bool wasEmpty = false;
+    q.push( a, wasEmpty );
+    q.push( b, wasEmpty );
+    REQUIRE( q.pop() == a );
+    q.push( a, wasEmpty );
+    REQUIRE( wasEmpty == false );
+    REQUIRE( q.pop() == b );
+    REQUIRE( q.pop() == a );
+    REQUIRE( q.pop() == 0 );
+    REQUIRE( q.consumer_empty() == true );
+}
+
+TEST_CASE( "qw/mpsc_intrusive_queue/link_index", "QwMpscIntrusiveQueue with a link that isn't the first member" ) {
+
+    const int NODE_COUNT = 100;
+    TestNode nodes[NODE_COUNT];
+    for (int i=0; i < NODE_COUNT; ++i)
+        nodes[i].value = i;
+
+    mpsc_intrusive_queue_2_t q;
+
+    // FIFO order while the queue repeatedly runs dry, so the stub is recycled many times
+    int popped = 0;
+    for (int i=0; i < NODE_COUNT; ++i) {
+        q.push( &nodes[i] );
+        if (i % 3 == 0) {
+            while (TestNode *n = q.pop()) {
+                REQUIRE( n->value == popped );
+#ifdef QW_VALIDATE_NODE_LINKS
+                REQUIRE( n->links_[TestNode::LINK_INDEX_2] == 0 );
+#endif
+                ++popped;
+            }
+            REQUIRE( q.consumer_empty() );
+        }
+    }
+
+    while (TestNode *n = q.pop()) {
+        REQUIRE( n->value == popped );
+        ++popped;
+    }
+    REQUIRE( popped == NODE_COUNT );
+}
+
+
+// Not run by default. QwMpscFifoQueue pays for the whole burst in the first pop() after
+// the burst arrives, QwMpscIntrusiveQueue pays a constant cost per pop().
+TEST_CASE( "qw/mpsc_intrusive_queue/burst_latency", "[.] pop() latency under bursts, QwMpscIntrusiveQueue vs QwMpscFifoQueue" ) {
+
+    typedef QwMpscFifoQueue<TestNode*, TestNode::LINK_INDEX_1> mpsc_fifo_queue_t;
+
+    std::printf("queue                   burst   median      p99    p99.9        max (ns)\n");
+    for (int burstSize=16; burstSize <= 4096; burstSize *= 4) {
+        const int burstCount = (1 << 20) / burstSize;
+        measureBurstPopLatency<mpsc_fifo_queue_t>("QwMpscFifoQueue", burstSize, burstCount);
+        measureBurstPopLatency<mpsc_intrusive_queue_t>("QwMpscIntrusiveQueue", burstSize, burstCount);
+    }
+}
@@ -0,0 +1,173 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwNodePoolMagazineCache.h"
+#include "QwSList.h"
+
+#include "catch.hpp"
+
+
+namespace {
+
+    struct TestNode{
+        TestNode *links_[2];
+        enum { LINK_INDEX_1, LINK_COUNT };
+
+        int value;
+
+        TestNode()
+            : value( 0 )
+        {
+            for( int i=0; i < LINK_COUNT; ++i )
+                links_[i] = 0;
+        }
+    };
+
+    typedef QwSList<TestNode*, TestNode::LINK_INDEX_1> node_slist_t;
+
+} // end anonymous namespace
+
+TEST_CASE( "qw/node_pool/magazine_cache", "QwNodePoolMagazineCache single threaded test" ) {
+
+    size_t maxNodes = 100;
+    size_t magazineSize = 8;
+
+    QwNodePool<TestNode> pool( maxNodes );
+
+    node_slist_t allocatedNodes;
+
+    {
+        QwNodePoolMagazineCache<TestNode> cache( pool, magazineSize );
+
+        // initially the depot is empty, magazines are filled from the pool
+        for (size_t i=0; i < maxNodes; ++i) {
+            TestNode *n = cache.allocate();
+            REQUIRE( n != 0 );
+            n->value = (int)i;
+            allocatedNodes.push_front(n);
+        }
+
+        REQUIRE( cache.allocate() == 0 );
+
+        // free everything into the cache. full magazines overflow into the depot
+        while (!allocatedNodes.empty())
+            cache.deallocate(allocatedNodes.pop_front());
+
+        // reallocating should be served from the cache and the depot
+        for (size_t i=0; i < maxNodes; ++i) {
+            TestNode *n = cache.allocate();
+            REQUIRE( n != 0 );
+            allocatedNodes.push_front(n);
+        }
+
+        REQUIRE( cache.allocate() == 0 );
+
+        while (!allocatedNodes.empty())
+            cache.deallocate(allocatedNodes.pop_front());
+
+        // cache dtor flushes the cached magazines to the depot
+    }
+
+    // the pool falls back to the depot when the freelist is empty
+    for (size_t i=0; i < maxNodes; ++i) {
+        TestNode *n = pool.allocate();
+        REQUIRE( n != 0 );
+        allocatedNodes.push_front(n);
+    }
+
+    REQUIRE( pool.allocate() == 0 );
+
+    while (!allocatedNodes.empty())
+        pool.deallocate(allocatedNodes.pop_front());
+}
+
+TEST_CASE( "qw/node_pool/magazine_cache/two_caches", "QwNodePoolMagazineCache nodes migrate between caches via the depot" ) {
+
+    size_t maxNodes = 64;
+    size_t magazineSize = 4;
+
+    QwNodePool<TestNode> pool( maxNodes );
+
+    QwNodePoolMagazineCache<TestNode> producer( pool, magazineSize );
+    QwNodePoolMagazineCache<TestNode> consumer( pool, magazineSize );
+
+    node_slist_t allocatedNodes;
+
+    // the consumer retains at most two magazines, everything else
+    // reaches the producer via the depot.
+    size_t available = maxNodes - 2*magazineSize;
+
+    for (int round=0; round < 3; ++round) {
+        // producer allocates, consumer frees
+        for (size_t i=0; i < available; ++i) {
+            TestNode *n = producer.allocate();
+            REQUIRE( n != 0 );
+            allocatedNodes.push_front(n);
+        }
+
+        while (!allocatedNodes.empty())
+            consumer.deallocate(allocatedNodes.pop_front());
+    }
+
+    consumer.flush();
+    producer.flush();
+}
+
+TEST_CASE( "qw/node_pool/magazine_cache/freelist_refill", "QwNodePoolMagazineCache takes a whole magazine from the freelist when the depot is empty" ) {
+
+    size_t maxNodes = 16;
+    size_t magazineSize = 8;
+
+    QwNodePool<TestNode> pool( maxNodes );
+
+    // put all nodes on the pool's freelist
+    node_slist_t allocatedNodes;
+    for (size_t i=0; i < maxNodes; ++i)
+        allocatedNodes.push_front(pool.allocate());
+    REQUIRE( pool.allocate() == 0 );
+    while (!allocatedNodes.empty())
+        pool.deallocate(allocatedNodes.pop_front());
+
+    QwNodePoolMagazineCache<TestNode> cache( pool, magazineSize );
+
+    // the first allocation loads a full magazine from the freelist
+    TestNode *n = cache.allocate();
+    REQUIRE( n != 0 );
+
+    size_t remaining = 0;
+    while (TestNode *p = pool.allocate()) {
+        allocatedNodes.push_front(p);
+        ++remaining;
+    }
+    REQUIRE( remaining == maxNodes - magazineSize );
+
+    // the rest of the magazine is served without touching the pool
+    for (size_t i=1; i < magazineSize; ++i) {
+        TestNode *p = cache.allocate();
+        REQUIRE( p != 0 );
+        allocatedNodes.push_front(p);
+    }
+    REQUIRE( cache.allocate() == 0 );
+
+    cache.deallocate(n);
+    while (!allocatedNodes.empty())
+        pool.deallocate(allocatedNodes.pop_front());
+}
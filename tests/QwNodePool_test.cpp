@@ -20,7 +20,24 @@
     SOFTWARE.
 */
 #include "QwNodePool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
 #include "QwSList.h"
+#include "QwSTailList.h"
+#include "QwStaticNodePool.h"
+#include "qw_aligned_malloc.h"
+#include "qw_cache_info.h"
+#include "qw_numa.h"
 
 #include "catch.hpp"
 
@@ -42,6 +59,280 @@ namespace {
     };
 
     typedef QwSList<TestNode*, TestNode::LINK_INDEX_1> node_slist_t;
+    typedef QwSTailList<TestNode*, TestNode::LINK_INDEX_1> node_stail_list_t;
+
+    template<typename ListT>
+    size_t countElements( ListT& list )
+    {
+        size_t result = 0;
+        for (typename ListT::iterator i=list.begin(); i!=list.end(); ++i)
+            ++result;
+        return result;
+    }
+
+    // calls trim() repeatedly on another thread until stopped
+    class TrimThread {
+        QwNodePool<TestNode>& pool_;
+        mint_atomic32_t stop_;
+        mint_atomic32_t trimCount_;
+
+        void run()
+        {
+            while (mint_load_32_relaxed(&stop_) == 0) {
+                pool_.trim();
+                mint_fetch_add_32_relaxed(&trimCount_, 1);
+            }
+        }
+
+#if defined(_WIN32)
+        HANDLE thread_;
+        static DWORD WINAPI threadMain( LPVOID p ) { static_cast<TrimThread*>(p)->run(); return 0; }
+#else
+        pthread_t thread_;
+        static void *threadMain( void *p ) { static_cast<TrimThread*>(p)->run(); return 0; }
+#endif
+
+    public:
+        TrimThread( QwNodePool<TestNode>& pool )
+            : pool_( pool )
+        {
+            stop_._nonatomic = 0;
+            trimCount_._nonatomic = 0;
+#if defined(_WIN32)
+            thread_ = CreateThread(0, 0, threadMain, this, 0, 0);
+#else
+            pthread_create(&thread_, 0, threadMain, this);
+#endif
+        }
+
+        uint32_t trim_count() { return mint_load_32_relaxed(&trimCount_); }
+
+        void stop()
+        {
+            mint_store_32_relaxed(&stop_, 1);
+#if defined(_WIN32)
+            WaitForSingleObject(thread_, INFINITE);
+            CloseHandle(thread_);
+#else
+            pthread_join(thread_, 0);
+#endif
+        }
+    };
+
+    // calls allocate_wait() on another thread, then counts its return in returnedCount
+    class WaiterThread {
+        QwNodePool<TestNode>& pool_;
+        mint_atomic32_t& returnedCount_;
+        TestNode *node_;
+
+        void run()
+        {
+            node_ = pool_.allocate_wait(QW_FUTEX_WAIT_FOREVER);
+            mint_thread_fence_release();
+            mint_fetch_add_32_relaxed(&returnedCount_, 1);
+            qw_futex_wake_all(&returnedCount_);
+        }
+
+#if defined(_WIN32)
+        HANDLE thread_;
+        static DWORD WINAPI threadMain( LPVOID p ) { static_cast<WaiterThread*>(p)->run(); return 0; }
+#else
+        pthread_t thread_;
+        static void *threadMain( void *p ) { static_cast<WaiterThread*>(p)->run(); return 0; }
+#endif
+
+    public:
+        WaiterThread( QwNodePool<TestNode>& pool, mint_atomic32_t& returnedCount )
+            : pool_( pool )
+            , returnedCount_( returnedCount )
+            , node_( 0 )
+        {
+#if defined(_WIN32)
+            thread_ = CreateThread(0, 0, threadMain, this, 0, 0);
+#else
+            pthread_create(&thread_, 0, threadMain, this);
+#endif
+        }
+
+        // returns the node that allocate_wait() returned
+        TestNode *join()
+        {
+#if defined(_WIN32)
+            WaitForSingleObject(thread_, INFINITE);
+            CloseHandle(thread_);
+#else
+            pthread_join(thread_, 0);
+#endif
+            mint_thread_fence_acquire();
+            return node_;
+        }
+    };
+
+    // wait until count reaches expected, for at most timeoutMs milliseconds. returns the count
+    uint32_t waitForCount( mint_atomic32_t *count, uint32_t expected, int timeoutMs )
+    {
+        uint64_t deadline = qw_monotonic_milliseconds() + timeoutMs;
+        uint32_t value;
+        while ((value = mint_load_32_relaxed(count)) < expected) {
+            uint64_t now = qw_monotonic_milliseconds();
+            if (now >= deadline)
+                break;
+            qw_futex_wait(count, value, static_cast<int>(deadline - now));
+        }
+        return value;
+    }
+
+    void sleepMilliseconds( int ms )
+    {
+        mint_atomic32_t never;
+        never._nonatomic = 0;
+        waitForCount(&never, 1, ms);
+    }
+
+    // allocates and deallocates nodes on another thread until stopped. each round
+    // holds HELD_COUNT nodes, marked with the thread's id to detect nodes that are
+    // handed to two threads at once
+    template<typename PoolT>
+    class ChurnThread {
+        enum { HELD_COUNT = 2 };
+
+        PoolT& pool_;
+        int id_;
+        mint_atomic32_t& stop_;
+        uint64_t operationCount_;
+        int duplicateCount_;
+
+        void run()
+        {
+            TestNode *held[HELD_COUNT];
+            while (mint_load_32_relaxed(&stop_) == 0) {
+                int count = 0;
+                while (count < HELD_COUNT) {
+                    TestNode *n = pool_.allocate();
+                    if (!n)
+                        break; // (transiently empty while other threads' nodes are in flight)
+                    n->value = id_;
+                    held[count++] = n;
+                }
+
+                for (int i=0; i < count; ++i) {
+                    if (held[i]->value != id_)
+                        ++duplicateCount_;
+                    pool_.deallocate(held[i]);
+                }
+                operationCount_ += 2 * count;
+            }
+        }
+
+#if defined(_WIN32)
+        HANDLE thread_;
+        static DWORD WINAPI threadMain( LPVOID p ) { static_cast<ChurnThread*>(p)->run(); return 0; }
+#else
+        pthread_t thread_;
+        static void *threadMain( void *p ) { static_cast<ChurnThread*>(p)->run(); return 0; }
+#endif
+
+    public:
+        static size_t held_count() { return HELD_COUNT; }
+
+        ChurnThread( PoolT& pool, int id, mint_atomic32_t& stop )
+            : pool_( pool )
+            , id_( id )
+            , stop_( stop )
+            , operationCount_( 0 )
+            , duplicateCount_( 0 )
+        {
+#if defined(_WIN32)
+            thread_ = CreateThread(0, 0, threadMain, this, 0, 0);
+#else
+            pthread_create(&thread_, 0, threadMain, this);
+#endif
+        }
+
+        void join()
+        {
+#if defined(_WIN32)
+            WaitForSingleObject(thread_, INFINITE);
+            CloseHandle(thread_);
+#else
+            pthread_join(thread_, 0);
+#endif
+        }
+
+        uint64_t operation_count() const { return operationCount_; }
+        int duplicate_count() const { return duplicateCount_; }
+    };
+
+    // increments a counter on another thread until stopped
+    class CounterThread {
+        mint_atomic32_t *counter_;
+        mint_atomic32_t& stop_;
+
+        void run()
+        {
+            while (mint_load_32_relaxed(&stop_) == 0) {
+                for (int i=0; i < 1000; ++i)
+                    mint_fetch_add_32_relaxed(counter_, 1);
+            }
+        }
+
+#if defined(_WIN32)
+        HANDLE thread_;
+        static DWORD WINAPI threadMain( LPVOID p ) { static_cast<CounterThread*>(p)->run(); return 0; }
+#else
+        pthread_t thread_;
+        static void *threadMain( void *p ) { static_cast<CounterThread*>(p)->run(); return 0; }
+#endif
+
+    public:
+        CounterThread( mint_atomic32_t *counter, mint_atomic32_t& stop )
+            : counter_( counter )
+            , stop_( stop )
+        {
+#if defined(_WIN32)
+            thread_ = CreateThread(0, 0, threadMain, this, 0, 0);
+#else
+            pthread_create(&thread_, 0, threadMain, this);
+#endif
+        }
+
+        void join()
+        {
+#if defined(_WIN32)
+            WaitForSingleObject(thread_, INFINITE);
+            CloseHandle(thread_);
+#else
+            pthread_join(thread_, 0);
+#endif
+        }
+    };
+
+    // runs threadCount ChurnThreads on pool for durationMs. returns the number of
+    // allocations and deallocations. duplicateCount receives the number of nodes
+    // that were found to be held by two threads
+    template<typename PoolT>
+    uint64_t churn( PoolT& pool, int threadCount, int durationMs, int& duplicateCount )
+    {
+        mint_atomic32_t stop;
+        stop._nonatomic = 0;
+
+        std::vector<ChurnThread<PoolT>*> threads;
+        for (int i=0; i < threadCount; ++i)
+            threads.push_back(new ChurnThread<PoolT>(pool, i + 1, stop));
+
+        sleepMilliseconds(durationMs);
+        mint_store_32_relaxed(&stop, 1);
+
+        uint64_t operationCount = 0;
+        duplicateCount = 0;
+        for (int i=0; i < threadCount; ++i) {
+            threads[i]->join();
+            operationCount += threads[i]->operation_count();
+            duplicateCount += threads[i]->duplicate_count();
+            delete threads[i];
+        }
+        return operationCount;
+    }
 
 } // end anonymous namespace
 
@@ -65,6 +356,653 @@ TEST_CASE( "qw/node_pool", "QwNodePool single threaded test" ) {
         pool.deallocate(allocatedNodes.pop_front()); 
 }
 
+TEST_CASE( "qw/node_pool/batch", "QwNodePool allocate_n and deallocate_all" ) {
+
+    size_t maxNodes = 50;
+
+    QwNodePool<TestNode> pool( maxNodes );
+
+    node_slist_t slist;
+    node_stail_list_t tailList;
+
+    REQUIRE( pool.allocate_n(0, slist) == 0 );
+    REQUIRE( slist.empty() );
+
+    REQUIRE( pool.allocate_n(16, slist) == 16 );
+    REQUIRE( countElements(slist) == 16 );
+
+    REQUIRE( pool.allocate_n(30, tailList) == 30 );
+    REQUIRE( countElements(tailList) == 30 );
+
+    // only 4 nodes left
+    REQUIRE( pool.allocate_n(16, slist) == 4 );
+    REQUIRE( countElements(slist) == 20 );
+    REQUIRE( pool.allocate() == 0 );
+    REQUIRE( pool.allocate_n(16, slist) == 0 );
+
+    // allocated nodes are constructed and distinct
+    int value = 0;
+    for (node_slist_t::iterator i=slist.begin(); i!=slist.end(); ++i) {
+        REQUIRE( (*i)->value == 0 );
+        (*i)->value = ++value;
+    }
+    for (node_stail_list_t::iterator i=tailList.begin(); i!=tailList.end(); ++i) {
+        REQUIRE( (*i)->value == 0 );
+        (*i)->value = ++value;
+    }
+
+    pool.deallocate_all(slist);
+    REQUIRE( slist.empty() );
+
+    // mix batch and single node operations
+    TestNode *n = pool.allocate();
+    REQUIRE( n != 0 );
+    REQUIRE( pool.allocate_n(maxNodes, slist) == 19 );
+    slist.push_front(n);
+
+    pool.deallocate_all(tailList);
+    REQUIRE( tailList.empty() );
+    pool.deallocate_all(slist);
+
+    // empty list is a no-op
+    pool.deallocate_all(slist);
+
+    REQUIRE( pool.allocate_n(maxNodes, tailList) == maxNodes );
+    pool.deallocate_all(tailList);
+}
+
+TEST_CASE( "qw/node_pool/high_water_mark", "QwNodePool lazy node initialization" ) {
+
+    const size_t maxNodes = 20;
+    QwNodePool<TestNode> pool(maxNodes);
+    REQUIRE( pool.high_water_mark() == 0 );
+
+    TestNode *a = pool.allocate();
+    TestNode *b = pool.allocate();
+    REQUIRE( pool.high_water_mark() == 2 );
+
+    // freed nodes are reused before never-allocated nodes
+    pool.deallocate(a);
+    TestNode *c = pool.allocate();
+    REQUIRE( c == a );
+    REQUIRE( pool.high_water_mark() == 2 );
+
+    // batch allocation takes freed nodes first, then never-allocated nodes
+    pool.deallocate(b);
+    node_slist_t slist;
+    REQUIRE( pool.allocate_n(5, slist) == 5 );
+    REQUIRE( pool.high_water_mark() == 6 );
+
+    node_stail_list_t tailList;
+    REQUIRE( pool.allocate_n(maxNodes, tailList) == maxNodes - 6 );
+    REQUIRE( pool.high_water_mark() == maxNodes );
+    REQUIRE( pool.allocate() == 0 );
+    REQUIRE( pool.allocate_n(1, slist) == 0 );
+    REQUIRE( pool.high_water_mark() == maxNodes );
+
+    pool.deallocate(c);
+    pool.deallocate_all(slist);
+    pool.deallocate_all(tailList);
+}
+
+TEST_CASE( "qw/node_pool/fresh_order", "QwNodePool fresh node allocation order" ) {
+
+    const size_t maxNodes = 1000;
+    const size_t nodeSize = QwRawNodePool::node_size(sizeof(TestNode));
+
+    {
+        QwNodePool<TestNode> pool(maxNodes, 0, QwFreshNodeOrder::ASCENDING_ADDRESS_ORDER);
+        TestNode *prev = pool.allocate();
+        node_slist_t slist;
+        slist.push_front(prev);
+        for (size_t i=1; i < maxNodes; ++i) {
+            TestNode *n = pool.allocate();
+            REQUIRE( reinterpret_cast<int8_t*>(n) == reinterpret_cast<int8_t*>(prev) + nodeSize );
+            slist.push_front(n);
+            prev = n;
+        }
+        pool.deallocate_all(slist);
+    }
+
+    {
+        QwNodePool<TestNode> pool(maxNodes, 0, QwFreshNodeOrder::DESCENDING_ADDRESS_ORDER);
+        node_slist_t slist;
+        REQUIRE( pool.allocate_n(maxNodes, slist) == maxNodes );
+        // allocate_n pushes to the front, so the list is in reverse allocation order
+        TestNode *prev = 0;
+        for (node_slist_t::iterator i=slist.begin(); i!=slist.end(); ++i) {
+            if (prev)
+                REQUIRE( reinterpret_cast<int8_t*>(*i) == reinterpret_cast<int8_t*>(prev) + nodeSize );
+            prev = *i;
+        }
+        pool.deallocate_all(slist);
+    }
+
+    {
+        QwFreshNodeOrder order;
+        const size_t pageSize = 4096;
+        order.init(QwFreshNodeOrder::PAGE_INTERLEAVED_ORDER, maxNodes, nodeSize, pageSize);
+        const size_t nodesPerPage = pageSize / nodeSize;
+        const size_t pageCount = maxNodes / nodesPerPage;
+
+        // the first allocation from each page, then the second from each page, ...
+        REQUIRE( order.position(0) == 0 );
+        REQUIRE( order.position(1) == nodesPerPage );
+        REQUIRE( order.position(pageCount) == 1 );
+
+        // order is a permutation of all positions
+        std::vector<bool> seen(maxNodes, false);
+        for (size_t k=0; k < maxNodes; ++k) {
+            size_t position = order.position(k);
+            REQUIRE( position < maxNodes );
+            REQUIRE( !seen[position] );
+            seen[position] = true;
+        }
+
+        QwNodePool<TestNode> pool(maxNodes, 0, QwFreshNodeOrder::PAGE_INTERLEAVED_ORDER);
+        node_slist_t slist;
+        REQUIRE( pool.allocate_n(maxNodes, slist) == maxNodes );
+        REQUIRE( pool.allocate() == 0 );
+        pool.deallocate_all(slist);
+    }
+}
+
+#ifdef QW_NODE_POOL_STATISTICS
+
+TEST_CASE( "qw/node_pool/statistics", "QwNodePool statistics counters" ) {
+
+    const size_t maxNodes = 10;
+    QwNodePool<TestNode> pool(maxNodes);
+
+    QwNodePoolStatistics stats = pool.statistics_snapshot();
+    REQUIRE( stats.allocations == 0 );
+    REQUIRE( stats.deallocations == 0 );
+    REQUIRE( stats.allocationFailures == 0 );
+    REQUIRE( stats.occupancy == 0 );
+    REQUIRE( stats.highWaterOccupancy == 0 );
+    REQUIRE( stats.capacity == maxNodes );
+
+    TestNode *a = pool.allocate();
+    TestNode *b = pool.allocate();
+    pool.deallocate(a);
+
+    stats = pool.statistics_snapshot();
+    REQUIRE( stats.allocations == 2 );
+    REQUIRE( stats.deallocations == 1 );
+    REQUIRE( stats.occupancy == 1 );
+    REQUIRE( stats.highWaterOccupancy == 2 );
+
+    node_slist_t slist;
+    REQUIRE( pool.allocate_n(maxNodes, slist) == maxNodes - 1 );
+    REQUIRE( pool.allocate() == 0 );
+    REQUIRE( pool.allocate_n(1, slist) == 0 );
+
+    stats = pool.statistics_snapshot();
+    REQUIRE( stats.allocations == 2 + maxNodes - 1 );
+    REQUIRE( stats.allocationFailures == 2 );
+    REQUIRE( stats.occupancy == maxNodes );
+    REQUIRE( stats.highWaterOccupancy == maxNodes );
+
+    pool.deallocate_all(slist);
+    pool.deallocate(b);
+
+    stats = pool.statistics_snapshot();
+    REQUIRE( stats.deallocations == stats.allocations );
+    REQUIRE( stats.occupancy == 0 );
+    REQUIRE( stats.highWaterOccupancy == maxNodes );
+
+    // no contention in a single threaded test
+    REQUIRE( stats.pushRetries == 0 );
+    REQUIRE( stats.popRetries == 0 );
+}
+
+#endif /* QW_NODE_POOL_STATISTICS */
+
+namespace {
+
+    template<size_t N>
+    struct SizedTestNode{
+        int8_t data[N];
+    };
+
+    template<size_t N>
+    void testNodeSize( size_t expectedNodeSize )
+    {
+        REQUIRE( QwRawNodePool::node_size(N) == expectedNodeSize );
+
+        const size_t maxNodes = 100;
+        QwNodePool< SizedTestNode<N> > pool(maxNodes);
+
+        SizedTestNode<N> *nodes[maxNodes];
+        for (size_t i=0; i < maxNodes; ++i) {
+            nodes[i] = pool.allocate();
+            REQUIRE( nodes[i] != 0 );
+            REQUIRE( (reinterpret_cast<uintptr_t>(nodes[i]) & (qw_cache_line_size()-1)) == 0 );
+            std::memset(nodes[i]->data, (int)i, N);
+        }
+        REQUIRE( pool.allocate() == 0 );
+
+        // nodes are packed at expectedNodeSize intervals and don't overlap
+        std::sort(nodes, nodes+maxNodes);
+        for (size_t i=1; i < maxNodes; ++i)
+            REQUIRE( (size_t)(reinterpret_cast<int8_t*>(nodes[i]) - reinterpret_cast<int8_t*>(nodes[i-1])) == expectedNodeSize );
+
+        // index/pointer conversion round trips through deallocate and allocate
+        for (size_t i=0; i < maxNodes; ++i)
+            pool.deallocate(nodes[i]);
+        for (size_t i=0; i < maxNodes; ++i)
+            nodes[i] = pool.allocate();
+        std::sort(nodes, nodes+maxNodes);
+        for (size_t i=1; i < maxNodes; ++i)
+            REQUIRE( nodes[i] != nodes[i-1] );
+        for (size_t i=0; i < maxNodes; ++i)
+            pool.deallocate(nodes[i]);
+    }
+
+} // end anonymous namespace
+
+TEST_CASE( "qw/node_pool/cache_info", "QwNodePool runtime cache geometry" ) {
+
+    const QwCacheInfo& info = qw_cache_info();
+    REQUIRE( info.lineSize >= CACHE_LINE_SIZE );
+    REQUIRE( (info.lineSize & (info.lineSize - 1)) == 0 );
+    REQUIRE( info.falseSharingSize >= info.lineSize );
+    REQUIRE( &qw_cache_info() == &info ); // queried once
+
+    // nodes are aligned to, and sized in multiples of, the runtime line size
+    REQUIRE( QwRawNodePool::node_size(1) == info.lineSize );
+    REQUIRE( QwRawNodePool::node_size(info.lineSize + 1) == 2 * info.lineSize );
+}
+
+TEST_CASE( "qw/node_pool/elimination", "QwNodePool concurrent allocation and deallocation" ) {
+
+    // a small pool shared by many threads, so that CASes on the freelist top
+    // collide and pushes and pops meet in the elimination array
+    const int threadCount = 8;
+    const size_t maxNodes = threadCount * ChurnThread< QwNodePool<TestNode> >::held_count();
+    QwNodePool<TestNode> pool(maxNodes);
+
+    int duplicateCount = 0;
+    uint64_t operationCount = churn(pool, threadCount, 200, duplicateCount);
+    REQUIRE( operationCount > 0 );
+    REQUIRE( duplicateCount == 0 );
+
+#ifdef QW_NODE_POOL_STATISTICS
+    // with more than one CPU, eliminations happen. keep going until we've seen some
+    for (int round=0; round < 20 && qw_cpu_count() > 1 && pool.statistics_snapshot().eliminations == 0; ++round) {
+        churn(pool, threadCount, 100, duplicateCount);
+        REQUIRE( duplicateCount == 0 );
+    }
+
+    QwNodePoolStatistics stats = pool.statistics_snapshot();
+    if (qw_cpu_count() > 1)
+        REQUIRE( stats.eliminations > 0 );
+    REQUIRE( (stats.eliminations % 2) == 0 ); // (each exchange is counted by its pusher and its popper)
+    REQUIRE( stats.deallocations == stats.allocations );
+    REQUIRE( stats.occupancy == 0 );
+#endif
+
+    // no node was lost or duplicated
+    std::vector<TestNode*> nodes;
+    for (size_t j=0; j < maxNodes; ++j) {
+        TestNode *n = pool.allocate();
+        REQUIRE( n != 0 );
+        nodes.push_back(n);
+    }
+    REQUIRE( pool.allocate() == 0 );
+
+    std::sort(nodes.begin(), nodes.end());
+    REQUIRE( std::unique(nodes.begin(), nodes.end()) == nodes.end() );
+
+    for (size_t j=0; j < maxNodes; ++j)
+        pool.deallocate(nodes[j]);
+}
+
+// Not run by default. Compares QwNodePool, which eliminates under contention, with
+// QwStaticNodePool, a plain IBM freelist, as the number of threads grows.
+TEST_CASE( "qw/node_pool/elimination/benchmark", "[.] QwNodePool elimination throughput, 2 to 64 threads" ) {
+
+    const int durationMs = 500;
+    std::printf("threads   QwNodePool ops/ms   QwStaticNodePool ops/ms\n");
+
+    for (int threadCount=2; threadCount <= 64; threadCount *= 2) {
+        const size_t maxNodes = threadCount * ChurnThread< QwNodePool<TestNode> >::held_count();
+        int duplicateCount = 0;
+
+        QwNodePool<TestNode> pool(maxNodes);
+        uint64_t poolOperations = churn(pool, threadCount, durationMs, duplicateCount);
+        REQUIRE( duplicateCount == 0 );
+
+        static QwStaticNodePool<TestNode, 128> staticPool; // (128 nodes are enough for 64 threads)
+        uint64_t staticPoolOperations = churn(staticPool, threadCount, durationMs, duplicateCount);
+        REQUIRE( duplicateCount == 0 );
+
+        std::printf("%7d   %17.0f   %23.0f\n", threadCount,
+                (double)poolOperations / durationMs, (double)staticPoolOperations / durationMs);
+    }
+}
+
+// Not run by default. Two threads increment counters that are distance bytes apart.
+// Throughput should stop improving at falseSharingSize.
+TEST_CASE( "qw/node_pool/cache_info/false_sharing_benchmark", "[.] false sharing as a function of distance" ) {
+
+    const QwCacheInfo& info = qw_cache_info();
+    std::printf("lineSize %d, falseSharingSize %d\n", (int)info.lineSize, (int)info.falseSharingSize);
+    std::printf("distance   increments/ms\n");
+
+    const size_t maxDistance = 4 * info.falseSharingSize;
+    int8_t *buffer = static_cast<int8_t*>(qw_aligned_malloc(2 * maxDistance, maxDistance));
+    REQUIRE( buffer != 0 );
+
+    const int durationMs = 500;
+    for (size_t distance=sizeof(mint_atomic32_t); distance <= maxDistance; distance *= 2) {
+        mint_atomic32_t *a = reinterpret_cast<mint_atomic32_t*>(buffer);
+        mint_atomic32_t *b = reinterpret_cast<mint_atomic32_t*>(buffer + distance);
+        a->_nonatomic = 0;
+        b->_nonatomic = 0;
+
+        mint_atomic32_t stop;
+        stop._nonatomic = 0;
+        CounterThread threadA(a, stop);
+        CounterThread threadB(b, stop);
+        sleepMilliseconds(durationMs);
+        mint_store_32_relaxed(&stop, 1);
+        threadA.join();
+        threadB.join();
+
+        double total = (double)mint_load_32_relaxed(a) + (double)mint_load_32_relaxed(b);
+        std::printf("%8d   %13.0f\n", (int)distance, total / durationMs);
+    }
+
+    qw_aligned_free(buffer);
+}
+
+TEST_CASE( "qw/node_pool/node_size", "QwNodePool non-power-of-two node sizes" ) {
+
+    // (the expected sizes assume that the machine's cache line size is CACHE_LINE_SIZE)
+    if (qw_cache_line_size() != CACHE_LINE_SIZE)
+        return;
+
+    // node sizes are rounded up to a multiple of the cache line size, not to a power of two
+    testNodeSize<1>( CACHE_LINE_SIZE );
+    testNodeSize<CACHE_LINE_SIZE>( CACHE_LINE_SIZE );
+    testNodeSize<CACHE_LINE_SIZE + 8>( 2*CACHE_LINE_SIZE );
+    testNodeSize<3*CACHE_LINE_SIZE>( 3*CACHE_LINE_SIZE );
+    testNodeSize<5*CACHE_LINE_SIZE - 1>( 5*CACHE_LINE_SIZE );
+    testNodeSize<8*CACHE_LINE_SIZE + 8>( 9*CACHE_LINE_SIZE );
+    testNodeSize<12*CACHE_LINE_SIZE>( 12*CACHE_LINE_SIZE );
+}
+
+TEST_CASE( "qw/node_pool/storage_flags", "QwNodePool with huge page, prefaulted and locked storage" ) {
+
+    const int flagCombinations[] = {
+        0,
+        QwRawNodePool::PREFAULTED_STORAGE,
+        QwRawNodePool::HUGE_PAGE_STORAGE,
+        QwRawNodePool::HUGE_PAGE_STORAGE | QwRawNodePool::PREFAULTED_STORAGE,
+        QwRawNodePool::LOCKED_STORAGE,
+        QwRawNodePool::HUGE_PAGE_STORAGE | QwRawNodePool::PREFAULTED_STORAGE | QwRawNodePool::LOCKED_STORAGE
+    };
+
+    for (size_t i=0; i < sizeof(flagCombinations)/sizeof(flagCombinations[0]); ++i) {
+        const int requestedFlags = flagCombinations[i];
+        const size_t maxNodes = 1000;
+        QwNodePool<TestNode> pool(maxNodes, requestedFlags);
+
+        // flags are best-effort: only requested flags may be applied (locking implies prefaulting)
+        int impliedFlags = requestedFlags;
+        if (requestedFlags & QwRawNodePool::LOCKED_STORAGE)
+            impliedFlags |= QwRawNodePool::PREFAULTED_STORAGE;
+        REQUIRE( (pool.storage_flags() & ~impliedFlags) == 0 );
+        if (requestedFlags & QwRawNodePool::PREFAULTED_STORAGE)
+            REQUIRE( (pool.storage_flags() & QwRawNodePool::PREFAULTED_STORAGE) != 0 );
+
+        TestNode *nodes[maxNodes];
+        for (size_t j=0; j < maxNodes; ++j) {
+            nodes[j] = pool.allocate();
+            REQUIRE( nodes[j] != 0 );
+            nodes[j]->value = (int)j;
+        }
+        REQUIRE( pool.allocate() == 0 );
+
+        for (size_t j=0; j < maxNodes; ++j) {
+            REQUIRE( nodes[j]->value == (int)j );
+            pool.deallocate(nodes[j]);
+        }
+    }
+}
+
+TEST_CASE( "qw/node_pool/trim", "QwNodePool releases fully free pages" ) {
+
+    const int flagCombinations[] = { 0, QwRawNodePool::PREFAULTED_STORAGE, QwRawNodePool::LOCKED_STORAGE };
+
+    for (size_t i=0; i < sizeof(flagCombinations)/sizeof(flagCombinations[0]); ++i) {
+        const size_t maxNodes = 2000;
+        QwNodePool<TestNode> pool(maxNodes, flagCombinations[i]);
+
+        REQUIRE( pool.trim() == 0 ); // nothing to release
+
+        std::vector<TestNode*> nodes(maxNodes);
+        for (size_t j=0; j < maxNodes; ++j) {
+            nodes[j] = pool.allocate();
+            REQUIRE( nodes[j] != 0 );
+        }
+
+        // keep every 16th node allocated. no page is completely free
+        for (size_t j=0; j < maxNodes; ++j) {
+            if (j % 16 != 0)
+                pool.deallocate(nodes[j]);
+        }
+        REQUIRE( pool.trim() == 0 );
+
+        for (size_t j=0; j < maxNodes; ++j) {
+            if (j % 16 == 0)
+                pool.deallocate(nodes[j]);
+        }
+
+        size_t released = pool.trim();
+        if (pool.storage_flags() & QwRawNodePool::LOCKED_STORAGE) {
+            REQUIRE( released == 0 ); // locked pages are never released
+        } else {
+            REQUIRE( released > 0 );
+            REQUIRE( released <= QwRawNodePool::storage_size(sizeof(TestNode), maxNodes) );
+        }
+        REQUIRE( pool.trim() == 0 ); // already released
+
+        // released nodes are reused before the high-water mark grows. all nodes are still available
+        for (size_t j=0; j < maxNodes; ++j) {
+            nodes[j] = pool.allocate();
+            REQUIRE( nodes[j] != 0 );
+            nodes[j]->value = (int)j;
+        }
+        REQUIRE( pool.allocate() == 0 );
+
+        std::vector<TestNode*> sortedNodes(nodes);
+        std::sort(sortedNodes.begin(), sortedNodes.end());
+        REQUIRE( std::unique(sortedNodes.begin(), sortedNodes.end()) == sortedNodes.end() );
+
+        for (size_t j=0; j < maxNodes; ++j) {
+            REQUIRE( nodes[j]->value == (int)j );
+            pool.deallocate(nodes[j]);
+        }
+    }
+}
+
+TEST_CASE( "qw/node_pool/trim/high_water_mark", "QwNodePool prefers released nodes to never-allocated nodes" ) {
+
+    const size_t maxNodes = 4000;
+    QwNodePool<TestNode> pool(maxNodes, QwRawNodePool::PREFAULTED_STORAGE);
+
+    std::vector<TestNode*> nodes(maxNodes / 2);
+    for (size_t j=0; j < nodes.size(); ++j)
+        nodes[j] = pool.allocate();
+    for (size_t j=0; j < nodes.size(); ++j)
+        pool.deallocate(nodes[j]);
+
+    REQUIRE( pool.trim() > 0 );
+
+    // the nodes that weren't released are allocated first, then the released
+    // nodes. the high-water mark doesn't grow
+    for (size_t j=0; j < nodes.size(); ++j) {
+        nodes[j] = pool.allocate();
+        REQUIRE( nodes[j] != 0 );
+    }
+    REQUIRE( pool.high_water_mark() == maxNodes / 2 );
+
+    for (size_t j=0; j < nodes.size(); ++j)
+        pool.deallocate(nodes[j]);
+}
+
+TEST_CASE( "qw/node_pool/trim/concurrent_allocate", "QwNodePool allocation doesn't fail while trim() runs" ) {
+
+    const size_t maxNodes = 4000;
+    QwNodePool<TestNode> pool(maxNodes);
+
+    // hand out every node, so that allocations can only be satisfied by free nodes
+    std::vector<TestNode*> nodes(maxNodes);
+    for (size_t j=0; j < maxNodes; ++j) {
+        nodes[j] = pool.allocate();
+        REQUIRE( nodes[j] != 0 );
+    }
+
+    // keep every 16th node allocated, so that no block is released and
+    // allocations can't fall back on released blocks
+    std::vector<TestNode*> keptNodes;
+    for (size_t j=0; j < maxNodes; ++j) {
+        if (j % 16 == 0)
+            keptNodes.push_back(nodes[j]);
+        else
+            pool.deallocate(nodes[j]);
+    }
+
+    // at least half of the pool is always free. trim() must not hide it from allocate()
+    TrimThread trimThread(pool);
+    size_t failures = 0;
+    for (int round=0; round < 200 || trimThread.trim_count() < 10; ++round) {
+        for (size_t j=0; j < maxNodes / 2; ++j) {
+            nodes[j] = pool.allocate();
+            if (!nodes[j]) {
+                ++failures;
+                break;
+            }
+            nodes[j]->value = (int)j;
+        }
+
+        for (size_t j=0; j < maxNodes / 2 && nodes[j]; ++j) {
+            REQUIRE( nodes[j]->value == (int)j );
+            pool.deallocate(nodes[j]);
+        }
+    }
+    trimThread.stop();
+
+    REQUIRE( failures == 0 );
+    REQUIRE( pool.high_water_mark() == maxNodes );
+
+    for (size_t j=0; j < keptNodes.size(); ++j)
+        pool.deallocate(keptNodes[j]);
+
+    // all nodes are still available
+    for (size_t j=0; j < maxNodes; ++j) {
+        nodes[j] = pool.allocate();
+        REQUIRE( nodes[j] != 0 );
+    }
+    REQUIRE( pool.allocate() == 0 );
+
+    for (size_t j=0; j < maxNodes; ++j)
+        pool.deallocate(nodes[j]);
+}
+
+TEST_CASE( "qw/node_pool/exhausted", "QwNodePool allocation from an exhausted pool" ) {
+
+    const size_t maxNodes = 4;
+    QwNodePool<TestNode> pool(maxNodes);
+
+    TestNode *nodes[maxNodes];
+    for (size_t j=0; j < maxNodes; ++j) {
+        nodes[j] = pool.try_allocate();
+        REQUIRE( nodes[j] != 0 );
+    }
+
+    REQUIRE( pool.allocate() == 0 );
+    REQUIRE( pool.try_allocate() == 0 );
+
+    // allocate_wait times out
+    REQUIRE( pool.allocate_wait(0) == 0 );
+    uint64_t begin = qw_monotonic_milliseconds();
+    REQUIRE( pool.allocate_wait(20) == 0 );
+    uint64_t elapsed = qw_monotonic_milliseconds() - begin;
+    REQUIRE( elapsed >= 19 ); // (allow for clock granularity)
+
+    // allocate_wait returns immediately when a node is available
+    pool.deallocate(nodes[0]);
+    nodes[0] = pool.allocate_wait();
+    REQUIRE( nodes[0] != 0 );
+    REQUIRE( nodes[0]->value == 0 );
+
+    for (size_t j=0; j < maxNodes; ++j)
+        pool.deallocate(nodes[j]);
+}
+
+TEST_CASE( "qw/node_pool/exhausted/wakeup", "QwNodePool deallocation wakes threads blocked in allocate_wait" ) {
+
+    const size_t maxNodes = 8;
+    const size_t waiterCount = 6;
+    const size_t singleCount = 3; // nodes deallocated one at a time, the rest as a chain
+    const int timeoutMs = 10000; // (only reached if a wakeup is lost)
+
+    QwNodePool<TestNode> pool(maxNodes);
+
+    TestNode *nodes[maxNodes];
+    for (size_t j=0; j < maxNodes; ++j) {
+        nodes[j] = pool.allocate();
+        REQUIRE( nodes[j] != 0 );
+    }
+
+    mint_atomic32_t returnedCount;
+    returnedCount._nonatomic = 0;
+
+    std::vector<WaiterThread*> waiters;
+    for (size_t j=0; j < waiterCount; ++j)
+        waiters.push_back(new WaiterThread(pool, returnedCount));
+
+    // give the waiters time to block. (the test is valid whether or not they have)
+    REQUIRE( waitForCount(&returnedCount, 1, 50) == 0 );
+
+    // each single node deallocation wakes one waiter, and no wakeup is lost
+    for (size_t j=0; j < singleCount; ++j) {
+        pool.deallocate(nodes[j]);
+        REQUIRE( waitForCount(&returnedCount, (uint32_t)(j + 1), timeoutMs) == j + 1 );
+    }
+
+    // the remaining waiters stay blocked
+    REQUIRE( waitForCount(&returnedCount, (uint32_t)(singleCount + 1), 50) == singleCount );
+
+    // a chain deallocation wakes every waiter
+    node_slist_t chain;
+    for (size_t j=singleCount; j < waiterCount; ++j)
+        chain.push_front(nodes[j]);
+    pool.deallocate_all(chain);
+    REQUIRE( waitForCount(&returnedCount, (uint32_t)waiterCount, timeoutMs) == waiterCount );
+
+    // every waiter got a distinct node, and the nodes that we kept weren't handed out
+    std::vector<TestNode*> received;
+    for (size_t j=0; j < waiterCount; ++j) {
+        TestNode *n = waiters[j]->join();
+        delete waiters[j];
+        REQUIRE( n != 0 );
+        received.push_back(n);
+    }
+    for (size_t j=waiterCount; j < maxNodes; ++j)
+        received.push_back(nodes[j]);
+
+    std::sort(received.begin(), received.end());
+    REQUIRE( std::unique(received.begin(), received.end()) == received.end() );
+    REQUIRE( pool.allocate() == 0 );
+
+    for (size_t j=0; j < maxNodes; ++j)
+        pool.deallocate(received[j]);
+}
+
 /* -----------------------------------------------------------------------
 Last reviewed: April 22, 2014
 Last reviewed by: Ross B.
@@ -0,0 +1,130 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwNumaNodePool.h"
+#include "QwSList.h"
+#include "qw_numa.h"
+
+#include "catch.hpp"
+
+
+namespace {
+
+    struct TestNode{
+        TestNode *links_[2];
+        enum { LINK_INDEX_1, LINK_COUNT };
+
+        int value;
+
+        TestNode()
+            : value( 0 )
+        {
+            for( int i=0; i < LINK_COUNT; ++i )
+                links_[i] = 0;
+        }
+    };
+
+    typedef QwSList<TestNode*, TestNode::LINK_INDEX_1> node_slist_t;
+
+} // end anonymous namespace
+
+TEST_CASE( "qw/numa_node_pool", "QwNumaNodePool single threaded test" ) {
+
+    size_t maxNodesPerNumaNode = 10;
+
+    QwNumaNodePool<TestNode> pool( maxNodesPerNumaNode );
+
+    REQUIRE( pool.numa_node_count() >= 1 );
+    REQUIRE( pool.current_numa_node() >= 0 );
+    REQUIRE( pool.current_numa_node() < pool.numa_node_count() );
+
+    node_slist_t allocatedNodes;
+
+    size_t totalNodes = maxNodesPerNumaNode * pool.numa_node_count();
+    for (size_t i=0; i < totalNodes; ++i) {
+        TestNode *n = pool.allocate();
+        REQUIRE( n != 0 );
+        allocatedNodes.push_front(n);
+    }
+
+    REQUIRE( pool.allocate() == 0 );
+
+    while (!allocatedNodes.empty())
+        pool.deallocate(allocatedNodes.pop_front());
+}
+
+TEST_CASE( "qw/numa_node_pool/simulated", "QwNumaNodePool with simulated NUMA nodes" ) {
+
+    size_t maxNodesPerNumaNode = 10;
+    int numaNodeCount = 3;
+
+    QwNumaNodePool<TestNode> pool( maxNodesPerNumaNode, numaNodeCount );
+
+    REQUIRE( pool.numa_node_count() == numaNodeCount );
+
+    node_slist_t allocatedNodes;
+
+    // local allocations come from the preferred node until it is exhausted
+    for (size_t i=0; i < maxNodesPerNumaNode; ++i) {
+        TestNode *n = pool.allocate(1);
+        REQUIRE( n != 0 );
+        REQUIRE( pool.numa_node_of(n) == 1 );
+        allocatedNodes.push_front(n);
+    }
+
+    // then nodes are stolen from the other nodes
+    for (size_t i=0; i < 2*maxNodesPerNumaNode; ++i) {
+        TestNode *n = pool.allocate(1);
+        REQUIRE( n != 0 );
+        REQUIRE( pool.numa_node_of(n) != 1 );
+        allocatedNodes.push_front(n);
+    }
+
+    REQUIRE( pool.allocate(0) == 0 );
+
+    // deallocated nodes are returned to the node that owns them
+    TestNode *n = allocatedNodes.pop_front();
+    int owner = pool.numa_node_of(n);
+    pool.deallocate(n);
+    n = pool.allocate((owner + 1) % numaNodeCount);
+    REQUIRE( n != 0 );
+    REQUIRE( pool.numa_node_of(n) == owner );
+    allocatedNodes.push_front(n);
+
+    while (!allocatedNodes.empty())
+        pool.deallocate(allocatedNodes.pop_front());
+}
+
+TEST_CASE( "qw/numa/dense_node_indices", "qw_numa_node_of_cpu returns dense indices less than qw_numa_node_count" ) {
+
+    int numaNodeCount = qw_numa_node_count();
+    REQUIRE( numaNodeCount >= 1 );
+
+    int cpuCount = qw_cpu_count();
+    for (int cpu=0; cpu < cpuCount; ++cpu) {
+        int numaNode = qw_numa_node_of_cpu(cpu);
+        REQUIRE( numaNode >= 0 );
+        REQUIRE( numaNode < numaNodeCount );
+    }
+
+    // binding to a node index outside the dense range must fail
+    REQUIRE( !qw_numa_bind_memory(0, 0, numaNodeCount) );
+}
@@ -0,0 +1,133 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwObjectCacheNodePool.h"
+
+#include <vector>
+
+#include "catch.hpp"
+
+
+namespace {
+
+    int constructCount_ = 0;
+    int destructCount_ = 0;
+    int resetCount_ = 0;
+
+    struct TestNode{
+        TestNode *links_[2];
+        enum { LINK_INDEX_1, LINK_COUNT };
+
+        int value;
+        int scratch[32]; // stands in for an expensive pre-sized buffer
+
+        TestNode()
+            : value( 0 )
+        {
+            for( int i=0; i < LINK_COUNT; ++i )
+                links_[i] = 0;
+            ++constructCount_;
+        }
+
+        ~TestNode()
+        {
+            ++destructCount_;
+        }
+    };
+
+    struct TestNodeReset {
+        static void reset( TestNode *n )
+        {
+            n->value = 0;
+            ++resetCount_;
+        }
+    };
+
+    typedef QwObjectCacheNodePool<TestNode, TestNodeReset> object_cache_pool_t;
+
+} // end anonymous namespace
+
+
+TEST_CASE( "qw/object_cache_node_pool", "QwObjectCacheNodePool constructs nodes once" ) {
+
+    constructCount_ = 0;
+    destructCount_ = 0;
+    resetCount_ = 0;
+
+    const size_t maxNodes = 50;
+    {
+        object_cache_pool_t pool( maxNodes );
+        REQUIRE( constructCount_ == 0 ); // nothing is constructed up front
+
+        std::vector<TestNode*> nodes;
+        for (size_t i=0; i < 10; ++i) {
+            TestNode *n = pool.allocate();
+            REQUIRE( n != 0 );
+            REQUIRE( (reinterpret_cast<uintptr_t>(n) % QwAlignmentOf<TestNode>::value) == 0 );
+            n->value = (int)i + 1;
+            n->scratch[0] = (int)i + 1; // not reset
+            nodes.push_back(n);
+        }
+        REQUIRE( constructCount_ == 10 );
+
+        for (size_t i=0; i < nodes.size(); ++i)
+            pool.deallocate(nodes[i]);
+        REQUIRE( resetCount_ == 10 );
+        REQUIRE( destructCount_ == 0 );
+
+        // reallocated nodes are reset, not reconstructed. the freelist doesn't overwrite them
+        for (size_t i=0; i < nodes.size(); ++i) {
+            nodes[i] = pool.allocate();
+            REQUIRE( nodes[i]->value == 0 );
+            REQUIRE( nodes[i]->scratch[0] != 0 );
+        }
+        REQUIRE( constructCount_ == 10 );
+
+        // allocate the rest of the pool
+        for (size_t i=10; i < maxNodes; ++i)
+            nodes.push_back(pool.allocate());
+        REQUIRE( pool.allocate() == 0 );
+        REQUIRE( constructCount_ == (int)maxNodes );
+        REQUIRE( pool.high_water_mark() == maxNodes );
+
+        for (size_t i=0; i < nodes.size(); ++i)
+            pool.deallocate(nodes[i]);
+    }
+
+    // all nodes are destroyed with the pool
+    REQUIRE( destructCount_ == (int)maxNodes );
+}
+
+TEST_CASE( "qw/object_cache_node_pool/default_reset", "QwObjectCacheNodePool with the default reset policy" ) {
+
+    destructCount_ = 0;
+    {
+        QwObjectCacheNodePool<TestNode> pool( 8 );
+        TestNode *n = pool.allocate();
+        n->value = 42;
+        pool.deallocate(n);
+
+        n = pool.allocate();
+        REQUIRE( n->value == 42 ); // (the default policy doesn't reset anything)
+        pool.deallocate(n);
+    }
+    REQUIRE( destructCount_ == 1 );
+}
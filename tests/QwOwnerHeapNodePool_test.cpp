@@ -0,0 +1,124 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwOwnerHeapNodePool.h"
+
+#include <vector>
+
+#include "catch.hpp"
+
+
+namespace {
+
+    struct TestNode{
+        TestNode *links_[2];
+        enum { LINK_INDEX_1, LINK_COUNT };
+
+        int value;
+
+        TestNode()
+            : value( 0 )
+        {
+            for( int i=0; i < LINK_COUNT; ++i )
+                links_[i] = 0;
+        }
+    };
+
+} // end anonymous namespace
+
+TEST_CASE( "qw/owner_heap_node_pool", "QwOwnerHeapNodePool single threaded test" ) {
+
+    const size_t nodesPerHeap = 10;
+    const int heapCount = 3;
+    QwOwnerHeapNodePool<TestNode> pool( nodesPerHeap, heapCount );
+
+    REQUIRE( pool.heap_count() == heapCount );
+    REQUIRE( pool.nodes_per_heap() == nodesPerHeap );
+
+    // each heap allocates from its own slice, and only from its own slice
+    std::vector<TestNode*> nodes[heapCount];
+    for (int heap=0; heap < heapCount; ++heap) {
+        for (size_t i=0; i < nodesPerHeap; ++i) {
+            TestNode *n = pool.allocate(heap);
+            REQUIRE( n != 0 );
+            REQUIRE( pool.owner_of(n) == heap );
+            n->value = heap;
+            nodes[heap].push_back(n);
+        }
+        REQUIRE( pool.allocate(heap) == 0 );
+    }
+
+    // slices are packed back to back, with no gaps between them
+    std::ptrdiff_t nodeStride = (int8_t*)nodes[0][1] - (int8_t*)nodes[0][0];
+    for (int heap=1; heap < heapCount; ++heap) {
+        std::ptrdiff_t gap = (int8_t*)nodes[heap].front() - (int8_t*)nodes[heap-1].back();
+        REQUIRE( gap == nodeStride );
+    }
+
+    // local free: immediately reusable by the owner
+    TestNode *n = nodes[0].back();
+    nodes[0].pop_back();
+    pool.deallocate(0, n);
+    REQUIRE( pool.allocate(0) == n );
+    nodes[0].push_back(n);
+
+    // remote frees: reclaimed by the owner when its local freelist is empty
+    n = nodes[1].back();
+    nodes[1].pop_back();
+    pool.deallocate(2, n);
+    TestNode *m = nodes[1].back();
+    nodes[1].pop_back();
+    pool.deallocate(QwOwnerHeapNodePool<TestNode>::NO_HEAP, m);
+
+    REQUIRE( pool.allocate(2) == 0 ); // remote frees go to the owner, not the freeing heap
+
+    TestNode *a = pool.allocate(1);
+    TestNode *b = pool.allocate(1);
+    REQUIRE( ((a == n && b == m) || (a == m && b == n)) );
+    REQUIRE( pool.allocate(1) == 0 );
+    nodes[1].push_back(a);
+    nodes[1].push_back(b);
+
+    // local frees are used before remote frees
+    pool.deallocate(1, a);
+    pool.deallocate(0, b);
+    REQUIRE( pool.allocate(1) == a );
+    REQUIRE( pool.allocate(1) == b );
+
+    for (int heap=0; heap < heapCount; ++heap) {
+        for (size_t i=0; i < nodes[heap].size(); ++i)
+            pool.deallocate((heap + (int)i) % heapCount, nodes[heap][i]);
+    }
+
+    // all nodes are available to their owners again
+    for (int heap=0; heap < heapCount; ++heap) {
+        nodes[heap].clear();
+        for (size_t i=0; i < nodesPerHeap; ++i) {
+            TestNode *p = pool.allocate(heap);
+            REQUIRE( p != 0 );
+            REQUIRE( p->value == 0 ); // constructed
+            nodes[heap].push_back(p);
+        }
+        REQUIRE( pool.allocate(heap) == 0 );
+        for (size_t i=0; i < nodesPerHeap; ++i)
+            pool.deallocate(heap, nodes[heap][i]);
+    }
+}
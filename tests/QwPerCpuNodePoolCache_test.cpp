@@ -0,0 +1,146 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwPerCpuNodePoolCache.h"
+#include "QwSList.h"
+
+#include "catch.hpp"
+
+
+namespace {
+
+    struct TestNode{
+        TestNode *links_[2];
+        enum { LINK_INDEX_1, LINK_COUNT };
+
+        int value;
+
+        TestNode()
+            : value( 0 )
+        {
+            for( int i=0; i < LINK_COUNT; ++i )
+                links_[i] = 0;
+        }
+    };
+
+    typedef QwSList<TestNode*, TestNode::LINK_INDEX_1> node_slist_t;
+
+    // Allocate until the cache fails. Returns the number of nodes allocated.
+    // (Nodes that are cached on other CPUs can't be allocated, so if the
+    // thread migrates, fewer than maxNodes nodes may be available.)
+    size_t allocateAll( QwPerCpuNodePoolCache<TestNode>& cache, node_slist_t& allocatedNodes, size_t maxNodes )
+    {
+        size_t result = 0;
+        while (TestNode *n = cache.allocate()) {
+            n->value = (int)result;
+            allocatedNodes.push_front(n);
+            ++result;
+            REQUIRE( result <= maxNodes );
+        }
+        return result;
+    }
+
+} // end anonymous namespace
+
+TEST_CASE( "qw/node_pool/per_cpu_cache", "QwPerCpuNodePoolCache single threaded test" ) {
+
+    size_t maxNodes = 200;
+
+    QwNodePool<TestNode> pool( maxNodes );
+
+    node_slist_t allocatedNodes;
+
+    size_t batchSizes[] = { 1, 4, QwRawPerCpuNodePoolCache::DEFAULT_BATCH_SIZE };
+    for (size_t i=0; i < sizeof(batchSizes)/sizeof(size_t); ++i) {
+        QwPerCpuNodePoolCache<TestNode> cache( pool, batchSizes[i] );
+
+        for (int round=0; round < 3; ++round) {
+            REQUIRE( allocateAll(cache, allocatedNodes, maxNodes) > 0 );
+
+            // free everything. full CPU stacks overflow into the pool
+            while (!allocatedNodes.empty())
+                cache.deallocate(allocatedNodes.pop_front());
+        }
+
+        // interleave allocations and deallocations, mostly served by the CPU stack
+        for (int j=0; j < 1000; ++j) {
+            TestNode *a = cache.allocate();
+            TestNode *b = cache.allocate();
+            REQUIRE( a != 0 );
+            REQUIRE( b != 0 );
+            REQUIRE( a != b );
+            cache.deallocate(a);
+            cache.deallocate(b);
+        }
+
+        // cache dtor flushes the CPU stacks to the pool
+    }
+
+    // all nodes were returned to the pool
+    for (size_t i=0; i < maxNodes; ++i) {
+        TestNode *n = pool.allocate();
+        REQUIRE( n != 0 );
+        allocatedNodes.push_front(n);
+    }
+
+    REQUIRE( pool.allocate() == 0 );
+
+    while (!allocatedNodes.empty())
+        pool.deallocate(allocatedNodes.pop_front());
+}
+
+TEST_CASE( "qw/node_pool/per_cpu_cache/flush", "QwPerCpuNodePoolCache flush returns cached nodes to the pool" ) {
+
+    size_t maxNodes = 64;
+
+    QwNodePool<TestNode> pool( maxNodes );
+    QwPerCpuNodePoolCache<TestNode> cache( pool, 8 );
+
+    node_slist_t allocatedNodes;
+
+    TestNode *n = cache.allocate();
+    REQUIRE( n != 0 );
+    cache.deallocate(n);
+
+    if (cache.is_per_cpu_available()) {
+        // the rest of the batch is cached on a CPU stack, not in the pool
+        size_t count = 0;
+        while (TestNode *m = pool.allocate()) {
+            allocatedNodes.push_front(m);
+            ++count;
+        }
+        REQUIRE( count < maxNodes );
+
+        while (!allocatedNodes.empty())
+            pool.deallocate(allocatedNodes.pop_front());
+    }
+
+    cache.flush();
+
+    for (size_t i=0; i < maxNodes; ++i) {
+        TestNode *m = pool.allocate();
+        REQUIRE( m != 0 );
+        allocatedNodes.push_front(m);
+    }
+
+    while (!allocatedNodes.empty())
+        pool.deallocate(allocatedNodes.pop_front());
+}
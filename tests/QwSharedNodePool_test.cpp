@@ -0,0 +1,124 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwSharedNodePool.h"
+
+#include "catch.hpp"
+
+
+namespace {
+
+    struct TestNode{
+        uint64_t nextIndex; // (nodes link by index, not by pointer)
+        int value;
+
+        TestNode()
+            : nextIndex( 0 )
+            , value( 0 )
+        {}
+    };
+
+    typedef QwSharedNodePool<TestNode> shared_pool_t;
+
+    void testSharedPool( const char *name, int segmentFlags )
+    {
+        const size_t maxNodes = 100;
+
+        shared_pool_t::remove_segment(name, segmentFlags); // (remove leftovers from an earlier failed run)
+
+        REQUIRE( shared_pool_t(name, segmentFlags).is_open() == false ); // doesn't exist yet
+
+        {
+            // two mappings of the same segment stand in for two processes
+            shared_pool_t creator( name, segmentFlags | shared_pool_t::CREATE_SEGMENT, maxNodes );
+            REQUIRE( creator.is_open() );
+            REQUIRE( creator.max_nodes() == maxNodes );
+
+            REQUIRE( shared_pool_t(name, segmentFlags | shared_pool_t::CREATE_SEGMENT, maxNodes).is_open() == false ); // already exists
+
+            shared_pool_t opener( name, segmentFlags );
+            REQUIRE( opener.is_open() );
+            REQUIRE( opener.max_nodes() == maxNodes );
+
+            // allocate everything, alternating between the mappings
+            TestNode *nodes[maxNodes];
+            for (size_t i=0; i < maxNodes; ++i) {
+                shared_pool_t& pool = (i & 1) ? opener : creator;
+                nodes[i] = pool.allocate();
+                REQUIRE( nodes[i] != 0 );
+                nodes[i]->value = (int)i;
+            }
+
+            REQUIRE( creator.allocate() == 0 );
+            REQUIRE( opener.allocate() == 0 );
+            REQUIRE( creator.high_water_mark() == maxNodes );
+            REQUIRE( opener.high_water_mark() == maxNodes );
+
+            // hand off nodes by index. the other mapping sees the same node contents
+            for (size_t i=0; i < maxNodes; ++i) {
+                shared_pool_t& from = (i & 1) ? opener : creator;
+                shared_pool_t& to = (i & 1) ? creator : opener;
+
+                shared_pool_t::node_index_type index = from.node_index(nodes[i]);
+                REQUIRE( index >= 1 );
+                REQUIRE( index <= maxNodes );
+
+                TestNode *n = to.node_at_index(index);
+                REQUIRE( n->value == (int)i );
+                to.deallocate(n);
+            }
+
+            // everything is back on the shared freelist
+            for (size_t i=0; i < maxNodes; ++i) {
+                nodes[i] = opener.allocate();
+                REQUIRE( nodes[i] != 0 );
+            }
+            REQUIRE( creator.allocate() == 0 );
+
+            for (size_t i=0; i < maxNodes; ++i)
+                creator.deallocate(creator.node_at_index(opener.node_index(nodes[i])));
+        }
+
+        // the segment persists after all mappings are gone
+#if defined(WIN32)
+        if (segmentFlags & shared_pool_t::FILE_SEGMENT) // (Windows removes shared memory objects with their last mapping)
+#endif
+        {
+            shared_pool_t opener( name, segmentFlags );
+            REQUIRE( opener.is_open() );
+            TestNode *n = opener.allocate();
+            REQUIRE( n != 0 );
+            opener.deallocate(n);
+        }
+
+        REQUIRE( shared_pool_t::remove_segment(name, segmentFlags) );
+    }
+
+} // end anonymous namespace
+
+
+TEST_CASE( "qw/shared_node_pool/shared_memory", "QwSharedNodePool in a shared memory object" ) {
+    testSharedPool( "/QwSharedNodePool_test", 0 );
+}
+
+TEST_CASE( "qw/shared_node_pool/file", "QwSharedNodePool in a memory-mapped file" ) {
+    testSharedPool( "QwSharedNodePool_test.bin", shared_pool_t::FILE_SEGMENT );
+}
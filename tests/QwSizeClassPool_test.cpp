@@ -0,0 +1,93 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwSizeClassPool.h"
+
+#include <cstring>
+#include <vector>
+
+#include "catch.hpp"
+
+
+TEST_CASE( "qw/size_class_pool/classes", "QwSizeClassPool size class table" ) {
+
+    QwSizeClassPool pool( 10*CACHE_LINE_SIZE, 16*1024 );
+
+    // classes are 1, 2, 3, 4, 6, 8, 12 cache lines
+    REQUIRE( pool.class_count() == 7 );
+    REQUIRE( pool.max_allocation_size() == 12*CACHE_LINE_SIZE );
+    const size_t expectedLineCounts[] = { 1, 2, 3, 4, 6, 8, 12 };
+    for (size_t i=0; i < pool.class_count(); ++i)
+        REQUIRE( pool.class_size(i) == expectedLineCounts[i]*CACHE_LINE_SIZE );
+
+    // each size maps to the smallest class that can hold it
+    for (size_t size=1; size <= pool.max_allocation_size(); ++size) {
+        size_t c = pool.class_index_of_size(size);
+        REQUIRE( pool.class_size(c) >= size );
+        if (c > 0)
+            REQUIRE( pool.class_size(c-1) < size );
+    }
+
+    REQUIRE( pool.allocate(pool.max_allocation_size() + 1) == 0 );
+}
+
+TEST_CASE( "qw/size_class_pool", "QwSizeClassPool single threaded test" ) {
+
+    const size_t bytesPerClass = 64*1024;
+    QwSizeClassPool pool( 1024, bytesPerClass );
+
+    std::vector<void*> blocks;
+
+    // blocks are recovered to the class that they were allocated from
+    for (size_t size=1; size <= pool.max_allocation_size(); size += 7) {
+        void *p = pool.allocate(size);
+        REQUIRE( p != 0 );
+        REQUIRE( (reinterpret_cast<uintptr_t>(p) & (CACHE_LINE_SIZE-1)) == 0 );
+        REQUIRE( pool.class_index_of_block(p) == pool.class_index_of_size(size) );
+        REQUIRE( pool.block_size(p) >= size );
+        std::memset(p, 0xFF, size);
+        blocks.push_back(p);
+    }
+
+    for (size_t i=0; i < blocks.size(); ++i)
+        pool.deallocate(blocks[i]);
+    blocks.clear();
+
+    // exhaust the largest class, smaller classes are unaffected
+    size_t largest = pool.max_allocation_size();
+    void *p;
+    while ((p = pool.allocate(largest)) != 0)
+        blocks.push_back(p);
+    REQUIRE( blocks.size() == bytesPerClass / largest );
+
+    p = pool.allocate(1);
+    REQUIRE( p != 0 );
+    pool.deallocate(p);
+
+    for (size_t i=0; i < blocks.size(); ++i)
+        pool.deallocate(blocks[i]);
+
+    // zero-sized allocations return the smallest class
+    p = pool.allocate(0);
+    REQUIRE( p != 0 );
+    REQUIRE( pool.block_size(p) == CACHE_LINE_SIZE );
+    pool.deallocate(p);
+}
@@ -0,0 +1,129 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwSpscBoundedQueue.h"
+
+#include "catch.hpp"
+
+
+namespace {
+
+    struct TestNode{
+        int value;
+
+        TestNode()
+            : value( 0 ) {}
+    };
+
+    typedef QwSpscBoundedQueue<TestNode*> spsc_bounded_queue_t;
+
+} // end anonymous namespace
+
+
+TEST_CASE( "qw/spsc_bounded_queue", "QwSpscBoundedQueue single threaded test" ) {
+
+    TestNode nodes[4];
+    TestNode *a = &nodes[0];
+    TestNode *b = &nodes[1];
+    TestNode *c = &nodes[2];
+    TestNode *d = &nodes[3];
+
+    spsc_bounded_queue_t q(4);
+    REQUIRE( q.capacity() == 4 );
+    {
+        spsc_bounded_queue_t minimal0(0), minimal1(1); // (at least 2 slots)
+        REQUIRE( minimal0.capacity() == 2 );
+        REQUIRE( minimal1.capacity() == 2 );
+    }
+
+    REQUIRE( q.empty() == true );
+    REQUIRE( q.try_pop() == 0 );
+
+    // bool try_push( node_ptr_type n )
+    // node_ptr_type try_pop()
+
+    REQUIRE( q.try_push( a ) == true );
+    REQUIRE( q.empty() == false );
+    REQUIRE( q.try_pop() == a );
+    REQUIRE( q.empty() == true );
+
+    REQUIRE( q.try_push( a ) == true );
+    REQUIRE( q.try_push( b ) == true );
+    REQUIRE( q.try_push( c ) == true );
+    REQUIRE( q.try_push( d ) == true );
+    REQUIRE( q.try_push( a ) == false ); // full
+
+    REQUIRE( q.try_pop() == a );
+    REQUIRE( q.try_push( a ) == true ); // wraps around
+    REQUIRE( q.try_push( a ) == false );
+
+    REQUIRE( q.try_pop() == b );
+    REQUIRE( q.try_pop() == c );
+    REQUIRE( q.try_pop() == d );
+    REQUIRE( q.try_pop() == a );
+    REQUIRE( q.try_pop() == 0 );
+}
+
+TEST_CASE( "qw/spsc_bounded_queue/batch", "QwSpscBoundedQueue push_n and pop_n" ) {
+
+    const int NODE_COUNT = 10;
+    TestNode nodes[NODE_COUNT];
+    TestNode *nodePtrs[NODE_COUNT];
+    for (int i=0; i < NODE_COUNT; ++i) {
+        nodes[i].value = i;
+        nodePtrs[i] = &nodes[i];
+    }
+
+    spsc_bounded_queue_t q(8);
+
+    // size_t push_n( const node_ptr_type *nodes, size_t count )
+
+    REQUIRE( q.push_n( nodePtrs, 0 ) == 0 );
+    REQUIRE( q.push_n( nodePtrs, 5 ) == 5 );
+    REQUIRE( q.push_n( nodePtrs + 5, 5 ) == 3 ); // only 3 slots free
+
+    // size_t pop_n( node_ptr_type *result, size_t maxCount )
+
+    TestNode *result[NODE_COUNT];
+    REQUIRE( q.pop_n( result, 6 ) == 6 );
+    for (int i=0; i < 6; ++i)
+        REQUIRE( result[i]->value == i );
+
+    REQUIRE( q.push_n( nodePtrs + 8, 2 ) == 2 ); // wraps around
+
+    REQUIRE( q.pop_n( result, NODE_COUNT ) == 4 );
+    for (int i=0; i < 4; ++i)
+        REQUIRE( result[i]->value == 6 + i );
+
+    REQUIRE( q.pop_n( result, NODE_COUNT ) == 0 );
+    REQUIRE( q.empty() == true );
+
+    // batches interoperate with single pushes and pops
+    for (int round=0; round < 20; ++round) {
+        REQUIRE( q.try_push( nodePtrs[0] ) == true );
+        REQUIRE( q.push_n( nodePtrs + 1, 2 ) == 2 );
+        REQUIRE( q.pop_n( result, 2 ) == 2 );
+        REQUIRE( result[0]->value == 0 );
+        REQUIRE( result[1]->value == 1 );
+        REQUIRE( q.try_pop()->value == 2 );
+    }
+    REQUIRE( q.empty() == true );
+}
@@ -0,0 +1,105 @@
+/* 
+    Queue World is copyright (c) 2014 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwStaticNodePool.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "catch.hpp"
+
+
+namespace {
+
+    struct TestNode{
+        TestNode *links_[2];
+        enum { LINK_INDEX_1, LINK_COUNT };
+
+        int value;
+
+        TestNode()
+            : value( 0 )
+        {
+            for( int i=0; i < LINK_COUNT; ++i )
+                links_[i] = 0;
+        }
+    };
+
+    struct LargeTestNode{
+        char data[CACHE_LINE_SIZE + 1];
+    };
+
+    typedef QwStaticNodePool<TestNode, 100> static_pool_t;
+
+    static_pool_t staticPool_; // static storage, no allocation at startup
+
+} // end anonymous namespace
+
+
+TEST_CASE( "qw/static_node_pool", "QwStaticNodePool single threaded test" ) {
+
+    REQUIRE( static_pool_t::NODE_SIZE == CACHE_LINE_SIZE );
+    REQUIRE( (QwStaticNodePool<LargeTestNode, 10>::NODE_SIZE) == 2 * CACHE_LINE_SIZE );
+    REQUIRE( static_pool_t::MAX_NODE_COUNT == 100 );
+
+    REQUIRE( static_cast<size_t>(QwStaticPowerOfTwoAbove<0>::value) == 1 );
+    REQUIRE( static_cast<size_t>(QwStaticPowerOfTwoAbove<100>::value) == 128 );
+    REQUIRE( static_cast<size_t>(QwStaticPowerOfTwoAbove<128>::value) == 256 );
+
+    REQUIRE( staticPool_.high_water_mark() == 0 );
+
+    std::vector<TestNode*> nodes;
+    for (int round=0; round < 3; ++round) {
+        for (size_t i=0; i < static_pool_t::MAX_NODE_COUNT; ++i) {
+            TestNode *n = staticPool_.allocate();
+            REQUIRE( n != 0 );
+            REQUIRE( (reinterpret_cast<uintptr_t>(n) & (CACHE_LINE_SIZE - 1)) == 0 );
+            n->value = (int)i;
+            nodes.push_back(n);
+        }
+
+        REQUIRE( staticPool_.allocate() == 0 );
+        REQUIRE( staticPool_.high_water_mark() == static_pool_t::MAX_NODE_COUNT );
+
+        std::vector<TestNode*> sortedNodes(nodes);
+        std::sort(sortedNodes.begin(), sortedNodes.end());
+        REQUIRE( std::unique(sortedNodes.begin(), sortedNodes.end()) == sortedNodes.end() );
+
+        for (size_t i=0; i < nodes.size(); ++i) {
+            REQUIRE( nodes[i]->value == (int)i );
+            staticPool_.deallocate(nodes[i]);
+        }
+        nodes.clear();
+    }
+
+    // pools can also live on the stack
+    QwStaticNodePool<LargeTestNode, 10> stackPool;
+    LargeTestNode *a = stackPool.allocate();
+    LargeTestNode *b = stackPool.allocate();
+    REQUIRE( a != 0 );
+    REQUIRE( b != 0 );
+    ptrdiff_t stride = reinterpret_cast<char*>(b) - reinterpret_cast<char*>(a);
+    REQUIRE( stride == (ptrdiff_t)(2 * CACHE_LINE_SIZE) );
+    stackPool.deallocate(a);
+    REQUIRE( stackPool.allocate() == a );
+    stackPool.deallocate(a);
+    stackPool.deallocate(b);
+}